@@ -15,6 +15,11 @@ SFEED_CFLAGS = ${CFLAGS}
 SFEED_LDFLAGS = ${LDFLAGS}
 SFEED_CPPFLAGS = -D_POSIX_C_SOURCE=200809L -D_XOPEN_SOURCE=700 -D_BSD_SOURCE
 
+# sfeed_run: fetch https:// urls with the built-in HTTP client and OpenSSL or
+# LibreSSL instead of curl(1).
+#SFEED_TLS_CPPFLAGS = -DUSE_TLS
+#SFEED_TLS_LDFLAGS = -lssl -lcrypto
+
 # debug
 #SFEED_CFLAGS = -fstack-protector-all -O0 -g -std=c99 -Wall -Wextra -pedantic \
 #               -Wno-unused-parameter
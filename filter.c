@@ -0,0 +1,320 @@
+#include <ctype.h>
+#include <err.h>
+#include <regex.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+#include "filter.h"
+
+static const char *fieldnames[] = {
+	"timestamp", "title", "link", "content", "contenttype", "id", "author",
+	"enclosure", "any"
+};
+
+static const char *typenames[] = {
+	"contains", "icontains", "regex", "iregex"
+};
+
+static int
+lookupname(const char **names, size_t n, const char *s)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		if (!strcmp(names[i], s))
+			return i;
+	}
+	return -1;
+}
+
+/* add a state to the automaton, returns its index */
+static uint32_t
+acnewstate(struct acmatcher *ac)
+{
+	size_t size;
+
+	if (ac->nstates + 1 >= ac->size) {
+		size = ac->size ? ac->size * 2 : 256;
+		if (!(ac->go = realloc(ac->go, size * ac->nclasses * sizeof(*ac->go))) ||
+		    !(ac->fail = realloc(ac->fail, size * sizeof(*ac->fail))) ||
+		    !(ac->out = realloc(ac->out, size * sizeof(*ac->out))) ||
+		    !(ac->dict = realloc(ac->dict, size * sizeof(*ac->dict))))
+			err(1, "realloc");
+		ac->size = size;
+	}
+	memset(ac->go + ac->nstates * ac->nclasses, 0,
+	       ac->nclasses * sizeof(*ac->go));
+	ac->fail[ac->nstates] = ac->dict[ac->nstates] = 0;
+	ac->out[ac->nstates] = 0;
+
+	return ac->nstates++;
+}
+
+/* build the automaton of the literal patterns of the rules of type `type`:
+   a trie of the patterns, completed to a DFA with the failure links. */
+static void
+acbuild(struct acmatcher *ac, struct filterrule *rules, char **patterns,
+	size_t nrules, int type)
+{
+	const unsigned char *p;
+	uint32_t *queue, s, t;
+	size_t i, c, head, tail, nc;
+
+	/* the bytes of the patterns each get a class, the other bytes are
+	   class 0 and always go back to the root. */
+	memset(ac->cls, 0, sizeof(ac->cls));
+	ac->nclasses = 1;
+	for (i = 0; i < nrules; i++) {
+		if (rules[i].type != type)
+			continue;
+		for (p = (unsigned char *)patterns[i]; *p; p++) {
+			c = type == RuleIContains ? tolower(*p) : *p;
+			if (!ac->cls[c])
+				ac->cls[c] = ac->nclasses++;
+		}
+		ac->fields |= rules[i].field == FieldAny ?
+		              (1U << FieldLast) - 1 : 1U << rules[i].field;
+	}
+	if (type == RuleIContains) {
+		for (c = 0; c < 256; c++) {
+			if (ac->cls[c] && islower(c))
+				ac->cls[toupper(c)] = ac->cls[c];
+		}
+	}
+	nc = ac->nclasses;
+
+	acnewstate(ac); /* root */
+	for (i = 0; i < nrules; i++) {
+		if (rules[i].type != type)
+			continue;
+		s = 0;
+		for (p = (unsigned char *)patterns[i]; *p; p++) {
+			c = ac->cls[*p];
+			if (!ac->go[s * nc + c]) {
+				t = acnewstate(ac);
+				ac->go[s * nc + c] = t;
+			}
+			s = ac->go[s * nc + c];
+		}
+		rules[i].next = ac->out[s];
+		ac->out[s] = i + 1;
+	}
+
+	/* breadth-first: the failure link of a state is the longest proper
+	   suffix in the trie, the missing transitions are those of the failure
+	   state which is complete already. */
+	if (!(queue = calloc(ac->nstates, sizeof(*queue))))
+		err(1, "calloc");
+	head = tail = 0;
+	for (c = 0; c < nc; c++) {
+		if ((t = ac->go[c]))
+			queue[tail++] = t;
+	}
+	while (head < tail) {
+		s = queue[head++];
+		for (c = 0; c < nc; c++) {
+			t = ac->go[s * nc + c];
+			if (!t) {
+				ac->go[s * nc + c] = ac->go[ac->fail[s] * nc + c];
+				continue;
+			}
+			ac->fail[t] = ac->go[ac->fail[s] * nc + c];
+			ac->dict[t] = ac->out[ac->fail[t]] ?
+			              ac->fail[t] : ac->dict[ac->fail[t]];
+			queue[tail++] = t;
+		}
+	}
+	free(queue);
+	free(ac->fail);
+	ac->fail = NULL;
+}
+
+/* scan the text with the automaton, returns the lowest index of a matching
+   rule for field `field` which is lower than `best` */
+static size_t
+acscan(const struct acmatcher *ac, const struct filterrule *rules,
+	const char *text, int field, size_t best)
+{
+	const unsigned char *p;
+	uint32_t s, t;
+	size_t r, nc = ac->nclasses;
+
+	for (s = 0, p = (const unsigned char *)text; *p; p++) {
+		s = ac->go[s * nc + ac->cls[*p]];
+		for (t = ac->out[s] ? s : ac->dict[s]; t; t = ac->dict[t]) {
+			for (r = ac->out[t]; r; r = rules[r - 1].next) {
+				if (r - 1 < best && (rules[r - 1].field == field ||
+				    rules[r - 1].field == FieldAny))
+					best = r - 1;
+			}
+		}
+		if (!best)
+			break;
+	}
+	return best;
+}
+
+void
+filter_free(struct filter *f)
+{
+	size_t i;
+
+	for (i = 0; i < f->nrules; i++) {
+		if (f->rules[i].type == RuleRegex ||
+		    f->rules[i].type == RuleIRegex)
+			regfree(&(f->rules[i].re));
+	}
+	free(f->rules);
+	for (i = 0; i < 2; i++) {
+		free(f->ac[i].go);
+		free(f->ac[i].fail);
+		free(f->ac[i].out);
+		free(f->ac[i].dict);
+	}
+	memset(f, 0, sizeof(*f));
+}
+
+/* Load the rules from a file, one rule per line with the TAB-separated
+ * fields: field, match type, pattern, action. Empty lines and lines
+ * starting with '#' are ignored. Returns -1 on error. */
+int
+filter_load(struct filter *f, const char *path)
+{
+	struct filterrule *r;
+	FILE *fp;
+	char *line = NULL, *fields[4], *s, **patterns = NULL, errbuf[256];
+	size_t linesize = 0, lineno = 0, size = 0, i;
+	ssize_t n;
+	int e, ret = -1;
+
+	memset(f, 0, sizeof(*f));
+	if (!(fp = fopen(path, "r"))) {
+		warn("fopen: %s", path);
+		return -1;
+	}
+	while ((n = getline(&line, &linesize, fp)) > 0) {
+		lineno++;
+		if (line[n - 1] == '\n')
+			line[--n] = '\0';
+		if (!n || line[0] == '#')
+			continue;
+
+		fields[0] = line;
+		for (i = 1; i < 4; i++) {
+			if (!(s = strchr(fields[i - 1], '\t')))
+				break;
+			*s = '\0';
+			fields[i] = s + 1;
+		}
+		if (i < 4 || strchr(fields[3], '\t')) {
+			warnx("%s:%zu: expected 4 TAB-separated fields", path, lineno);
+			goto end;
+		}
+
+		if (f->nrules + 1 >= size) {
+			size = size ? size * 2 : 64;
+			if (!(f->rules = realloc(f->rules, size * sizeof(*f->rules))) ||
+			    !(patterns = realloc(patterns, size * sizeof(*patterns))))
+				err(1, "realloc");
+		}
+		r = &(f->rules[f->nrules]);
+		memset(r, 0, sizeof(*r));
+		if ((r->field = lookupname(fieldnames, sizeof(fieldnames) /
+		     sizeof(*fieldnames), fields[0])) == -1) {
+			warnx("%s:%zu: unknown field: %s", path, lineno, fields[0]);
+			goto end;
+		}
+		if ((r->type = lookupname(typenames, sizeof(typenames) /
+		     sizeof(*typenames), fields[1])) == -1) {
+			warnx("%s:%zu: unknown match type: %s", path, lineno, fields[1]);
+			goto end;
+		}
+		if (!fields[2][0]) {
+			warnx("%s:%zu: empty pattern", path, lineno);
+			goto end;
+		}
+		if (!strcmp(fields[3], "drop")) {
+			r->drop = 1;
+		} else if (strcmp(fields[3], "keep")) {
+			warnx("%s:%zu: unknown action: %s", path, lineno, fields[3]);
+			goto end;
+		}
+
+		patterns[f->nrules] = NULL;
+		if (r->type == RuleRegex || r->type == RuleIRegex) {
+			if ((e = regcomp(&(r->re), fields[2], REG_EXTENDED | REG_NOSUB |
+			    (r->type == RuleIRegex ? REG_ICASE : 0)))) {
+				regerror(e, &(r->re), errbuf, sizeof(errbuf));
+				warnx("%s:%zu: %s", path, lineno, errbuf);
+				goto end;
+			}
+			f->hasregex = 1;
+		} else if (!(patterns[f->nrules] = strdup(fields[2]))) {
+			err(1, "strdup");
+		}
+		f->nrules++;
+	}
+	if (ferror(fp)) {
+		warn("getline: %s", path);
+		goto end;
+	}
+
+	acbuild(&(f->ac[0]), f->rules, patterns, f->nrules, RuleContains);
+	acbuild(&(f->ac[1]), f->rules, patterns, f->nrules, RuleIContains);
+	ret = 0;
+end:
+	for (i = 0; i < f->nrules; i++)
+		free(patterns[i]);
+	free(patterns);
+	free(line);
+	fclose(fp);
+	if (ret == -1)
+		filter_free(f);
+
+	return ret;
+}
+
+/* Returns 1 if the item with the parsed fields is kept, else 0: the first
+ * rule in the order of the file which matches decides. An item which matches
+ * no rule is kept. */
+int
+filter_match(const struct filter *f, char *fields[FieldLast])
+{
+	const struct filterrule *r;
+	size_t best = f->nrules, i;
+	int field;
+
+	/* the lowest matching literal rule: one pass per field and automaton */
+	for (i = 0; i < 2; i++) {
+		for (field = 0; best && field < FieldLast; field++) {
+			if (f->ac[i].fields & (1U << field))
+				best = acscan(&(f->ac[i]), f->rules, fields[field],
+				              field, best);
+		}
+	}
+
+	/* only the regexes before it can decide otherwise */
+	for (i = 0; f->hasregex && i < best; i++) {
+		r = &(f->rules[i]);
+		if (r->type != RuleRegex && r->type != RuleIRegex)
+			continue;
+		if (r->field != FieldAny) {
+			if (!regexec(&(r->re), fields[r->field], 0, NULL, 0))
+				break;
+			continue;
+		}
+		for (field = 0; field < FieldLast; field++) {
+			if (!regexec(&(r->re), fields[field], 0, NULL, 0))
+				break;
+		}
+		if (field < FieldLast)
+			break;
+	}
+	if (f->hasregex)
+		best = i;
+
+	return best < f->nrules ? !f->rules[best].drop : 1;
+}
@@ -0,0 +1,45 @@
+#ifndef _FILTER_H
+#define _FILTER_H
+
+#include <regex.h>
+#include <stdint.h>
+
+/* match types of a rule */
+enum { RuleContains = 0, RuleIContains, RuleRegex, RuleIRegex };
+
+/* field of a rule which matches any field */
+#define FieldAny FieldLast
+
+struct filterrule {
+	int     field;  /* field index or FieldAny */
+	int     type;   /* match type */
+	int     drop;   /* action: drop or keep the item */
+	regex_t re;     /* compiled regex for RuleRegex and RuleIRegex */
+	size_t  next;   /* next rule with the same literal pattern + 1 */
+};
+
+/* Aho-Corasick automaton of the literal patterns: a DFA on byte classes */
+struct acmatcher {
+	unsigned char  cls[256]; /* byte to class, 0: not in any pattern */
+	size_t         nclasses;
+	uint32_t      *go;       /* transitions: state * nclasses + class */
+	uint32_t      *fail;     /* failure links (only used when building) */
+	size_t        *out;      /* first rule which ends in the state + 1 */
+	uint32_t      *dict;     /* next state with rules on the failure path */
+	size_t         nstates, size;
+	unsigned int   fields;   /* bitmask of the fields to scan */
+};
+
+struct filter {
+	struct filterrule *rules;
+	size_t             nrules;
+	/* literals: case-sensitive and case-insensitive */
+	struct acmatcher   ac[2];
+	int                hasregex;
+};
+
+void filter_free(struct filter *);
+int  filter_load(struct filter *, const char *);
+int  filter_match(const struct filter *, char *[FieldLast]);
+
+#endif
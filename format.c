@@ -0,0 +1,723 @@
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <err.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "util.h"
+#include "format.h"
+
+static char *line;
+static size_t linesize;
+static char host[256], *user, mtimebuf[32];
+
+/* returns 1 if the item is new: it is not read or, without a set of read
+   items, newer than comparetime */
+int
+formatisnew(const struct formatopts *o, const struct item *item)
+{
+	if (o->read)
+		return !keyset_find(o->read, keyset_itemkey(item->fields[FieldLink],
+		                    item->fields[FieldId]));
+	return item->timestamp >= o->comparetime;
+}
+
+/* Suppress the items of which the link was already shown: the set is sized
+ * for the items of the n files, or of stdin without files. */
+void
+formatdedup(struct formatopts *o, char **files, size_t n)
+{
+	struct stat st;
+	size_t i, size = 0;
+
+	if (!(o->emitted = malloc(sizeof(*o->emitted))))
+		err(1, "malloc");
+	for (i = 0; i < n; i++) {
+		if (stat(files[i], &st) == 0)
+			size += st.st_size;
+	}
+	if (!n && fstat(0, &st) == 0)
+		size = st.st_size;
+	/* about the size of a line without content */
+	hashset_init(o->emitted, size / 512);
+}
+
+/* returns 1 if the link of the item was shown, else it is added to the shown
+   links */
+int
+formatisdup(const struct formatopts *o, const struct item *item)
+{
+	return !hashset_add(o->emitted, linkkey(item->fields[FieldLink],
+	                    item->fields[FieldId]));
+}
+
+/* Read the items of a feed file and pass each item to the n formats with
+ * their output file: the line is parsed once for all formats. The counts of
+ * the feed are updated with the items which are shown. */
+void
+formatfeed(FILE *fpin, struct feed *f, const struct formatopts *o,
+	const struct format **fmts, FILE **fps, size_t n)
+{
+	struct item item;
+	uint64_t namehash;
+	ssize_t linelen;
+	size_t i;
+	int rawhash = 0;
+
+	for (i = 0; i < n; i++) {
+		rawhash |= fmts[i]->rawhash;
+		if (fmts[i]->feed)
+			fmts[i]->feed(fps[i], f);
+	}
+	namehash = hashbuf(HASHINIT, f->name, strlen(f->name) + 1);
+
+	while ((linelen = getline(&line, &linesize, fpin)) > 0) {
+		if (line[linelen - 1] == '\n')
+			line[--linelen] = '\0';
+		if (rawhash)
+			item.hash = hashbuf(namehash, line, linelen);
+		parseline(line, item.fields);
+
+		item.timestamp = 0;
+		if (strtotime(item.fields[FieldUnixTimestamp], &item.timestamp))
+			continue;
+		/* the items are sorted newest first: the rest is older */
+		if (o->cutoff && item.timestamp < o->cutoff)
+			break;
+		if (o->emitted && formatisdup(o, &item))
+			continue;
+
+		item.isnew = formatisnew(o, &item);
+		item.anchor = 0;
+		f->totalnew += item.isnew;
+		f->total++;
+		if (f->total == 1 || item.timestamp > f->timenewest)
+			f->timenewest = item.timestamp;
+		if (f->total == 1 || item.timestamp < f->timeoldest)
+			f->timeoldest = item.timestamp;
+		if (item.isnew && (f->totalnew == 1 ||
+		    item.timestamp < f->timeoldestnew))
+			f->timeoldestnew = item.timestamp;
+
+		for (i = 0; i < n; i++)
+			fmts[i]->item(fps[i], &item, f);
+		if (o->maxitems && f->total >= o->maxitems)
+			break;
+	}
+}
+
+static void
+atom_content(FILE *fp, const char *s)
+{
+	for (; *s; ++s) {
+		switch (*s) {
+		case '<':  fputs("&lt;",   fp); break;
+		case '>':  fputs("&gt;",   fp); break;
+		case '\'': fputs("&#39;",  fp); break;
+		case '&':  fputs("&amp;",  fp); break;
+		case '"':  fputs("&quot;", fp); break;
+		case '\\':
+			s++;
+			switch (*s) {
+			case 'n':  putc('\n', fp); break;
+			case '\\': putc('\\', fp); break;
+			case 't':  putc('\t', fp); break;
+			}
+			break;
+		default:  putc(*s, fp);
+		}
+	}
+}
+
+static void
+atom_header(FILE *fp, int sidebar)
+{
+	fputs("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	      "<feed xmlns=\"http://www.w3.org/2005/Atom\" xml:lang=\"en\">\n",
+	      fp);
+}
+
+static void
+atom_item(FILE *fp, const struct item *item, const struct feed *f)
+{
+	char *const *fields = item->fields;
+	struct tm *tm;
+
+	if (!(tm = localtime(&item->timestamp)))
+		err(1, "localtime");
+
+	fputs("<entry>\n\t<title>", fp);
+	if (f->name[0]) {
+		fputs("[", fp);
+		xmlencode(f->name, fp);
+		fputs("] ", fp);
+	}
+	xmlencode(fields[FieldTitle], fp);
+	fputs("</title>\n", fp);
+	if (fields[FieldLink][0]) {
+		fputs("\t<link rel=\"alternate\" href=\"", fp);
+		xmlencode(fields[FieldLink], fp);
+		fputs("\" />\n", fp);
+	}
+	if (fields[FieldEnclosure][0]) {
+		fputs("\t<link rel=\"enclosure\" href=\"", fp);
+		xmlencode(fields[FieldEnclosure], fp);
+		fputs("\" />\n", fp);
+	}
+	fprintf(fp, "\t<published>%04d-%02d-%02dT%02d:%02d:%02dZ</published>\n",
+	        tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday,
+	        tm->tm_hour, tm->tm_min, tm->tm_sec);
+	if (fields[FieldAuthor][0]) {
+		fputs("\t<author><name>", fp);
+		xmlencode(fields[FieldAuthor], fp);
+		fputs("</name></author>\n", fp);
+	}
+	if (fields[FieldContent][0]) {
+		if (!strcmp(fields[FieldContentType], "html")) {
+			fputs("\t<content type=\"html\">", fp);
+		} else {
+			/* NOTE: an RSS/Atom viewer may or may not format
+			   whitespace such as newlines.
+			   Workaround: type="html" and <![CDATA[<pre></pre>]]> */
+			fputs("\t<content type=\"text\">", fp);
+		}
+		atom_content(fp, fields[FieldContent]);
+		fputs("</content>\n", fp);
+	}
+	fputs("</entry>\n", fp);
+}
+
+static void
+atom_footer(FILE *fp, struct feed **feeds, size_t n, int sidebar)
+{
+	fputs("</feed>\n", fp);
+}
+
+const struct format format_atom = {
+	"atom", 0, atom_header, NULL, atom_item, atom_footer
+};
+
+/* the heading of a named feed: the target of the links in the sidebar */
+static void
+html_feed(FILE *fp, const struct feed *f)
+{
+	if (!f->name[0])
+		return;
+	fputs("<h2 id=\"", fp);
+	xmlencode(f->name, fp);
+	fputs("\"><a href=\"#", fp);
+	xmlencode(f->name, fp);
+	fputs("\">", fp);
+	xmlencode(f->name, fp);
+	fputs("</a></h2>\n", fp);
+}
+
+/* item of sfeed_html and sfeed_frames: with showname the feed name is shown
+   before the title, for the timeline of all feeds: then the anchor item of a
+   feed is the target of the links in the sidebar */
+void
+html_item(FILE *fp, const struct item *item, const struct feed *f,
+	int showname)
+{
+	char *const *fields = item->fields;
+	struct tm *tm;
+
+	if (!(tm = localtime(&item->timestamp)))
+		err(1, "localtime");
+
+	fprintf(fp, "%04d-%02d-%02d&nbsp;%02d:%02d ",
+	        tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday,
+	        tm->tm_hour, tm->tm_min);
+	if (showname) {
+		if (item->anchor) {
+			fputs("<span id=\"", fp);
+			xmlencode(f->name, fp);
+			fputs("\">", fp);
+		}
+		xmlencode(f->name, fp);
+		if (item->anchor)
+			fputs("</span>", fp);
+		fputs(": ", fp);
+	}
+	if (item->isnew)
+		fputs("<b><u>", fp);
+	if (fields[FieldLink][0]) {
+		fputs("<a href=\"", fp);
+		xmlencode(fields[FieldLink], fp);
+		fputs("\">", fp);
+		xmlencode(fields[FieldTitle], fp);
+		fputs("</a>", fp);
+	} else {
+		xmlencode(fields[FieldTitle], fp);
+	}
+	if (item->isnew)
+		fputs("</u></b>", fp);
+	fputs("\n", fp);
+}
+
+static void
+html_feeditem(FILE *fp, const struct item *item, const struct feed *f)
+{
+	html_item(fp, item, f, 0);
+}
+
+static unsigned long
+totalnew(struct feed **feeds, size_t n)
+{
+	unsigned long total = 0;
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		total += feeds[i]->totalnew;
+	return total;
+}
+
+static void
+html_header(FILE *fp, int sidebar)
+{
+	fputs("<!DOCTYPE HTML>\n"
+	      "<html>\n"
+	      "\t<head>\n"
+	      "\t<meta name=\"referrer\" content=\"no-referrer\" />\n"
+	      "\t\t<meta http-equiv=\"Content-Type\" content=\"text/html; charset=UTF-8\" />\n"
+	      "\t\t<link rel=\"stylesheet\" type=\"text/css\" href=\"style.css\" />\n"
+	      "\t</head>\n"
+	      "\t<body class=\"noframe\">\n", fp);
+
+	if (sidebar)
+		fputs("\t\t<div id=\"items\">\n", fp);
+	else
+		fputs("\t\t<div id=\"items\" class=\"nosidebar\">\n", fp);
+	fputs("<pre>\n", fp);
+}
+
+static void
+html_footer(FILE *fp, struct feed **feeds, size_t n, int sidebar)
+{
+	struct feed *f;
+	size_t i;
+
+	fputs("</pre>\n</div>\n", fp); /* div items */
+
+	if (sidebar) {
+		fputs("\t<div id=\"sidebar\">\n\t\t<ul>\n", fp);
+
+		for (i = 0; i < n; i++) {
+			f = feeds[i];
+			if (f->totalnew > 0)
+				fputs("<li class=\"n\"><a href=\"", fp);
+			else
+				fputs("<li><a href=\"", fp);
+			if (f->page)
+				fprintf(fp, "page-%llu.html", f->page);
+			fputs("#", fp);
+			xmlencode(f->name, fp);
+			fputs("\">", fp);
+			if (f->totalnew > 0)
+				fputs("<b><u>", fp);
+			xmlencode(f->name, fp);
+			fprintf(fp, " (%lu)", f->totalnew);
+			if (f->totalnew > 0)
+				fputs("</u></b>", fp);
+			fputs("</a></li>\n", fp);
+		}
+		fputs("\t\t</ul>\n\t</div>\n", fp);
+	}
+
+	fprintf(fp, "\t</body>\n\t<title>Newsfeed (%lu)</title>\n</html>\n",
+	        totalnew(feeds, n));
+}
+
+const struct format format_html = {
+	"html", 0, html_header, html_feed, html_feeditem, html_footer
+};
+
+/* older page of sfeed_html: without the sidebar */
+static void
+htmlpage_header(FILE *fp, int sidebar)
+{
+	html_header(fp, 0);
+}
+
+static void
+htmlpage_footer(FILE *fp, struct feed **feeds, size_t n, int sidebar)
+{
+	fputs("</pre>\n</div>\n"
+	      "\t</body>\n\t<title>Newsfeed</title>\n</html>\n", fp);
+}
+
+const struct format format_htmlpage = {
+	"htmlpage", 0, htmlpage_header, NULL, NULL, htmlpage_footer
+};
+
+/* items.html of sfeed_frames */
+static void
+frames_header(FILE *fp, int sidebar)
+{
+	fputs("<!DOCTYPE HTML>\n"
+	      "<html>\n"
+	      "\t<head>\n"
+	      "\t<meta name=\"referrer\" content=\"no-referrer\" />\n"
+	      "\t<meta http-equiv=\"Content-Type\" content=\"text/html; charset=UTF-8\" />\n"
+	      "\t<link rel=\"stylesheet\" type=\"text/css\" href=\"style.css\" />\n"
+	      "</head>\n"
+	      "<body class=\"frame\"><div id=\"items\"><pre>\n", fp);
+}
+
+static void
+frames_footer(FILE *fp, struct feed **feeds, size_t n, int sidebar)
+{
+	fputs("</pre>\n</div></body>\n</html>\n", fp); /* div items */
+}
+
+const struct format format_frames = {
+	"frames", 0, frames_header, html_feed, html_feeditem, frames_footer
+};
+
+/* menu.html of sfeed_frames: the sidebar */
+void
+frames_menu(FILE *fp, struct feed **feeds, size_t n)
+{
+	struct feed *f;
+	size_t i;
+
+	fputs("<!DOCTYPE HTML>\n"
+	      "<html>\n"
+	      "<head>\n"
+	      "\t<meta http-equiv=\"Content-Type\" content=\"text/html; charset=UTF-8\" />\n"
+	      "\t<link rel=\"stylesheet\" type=\"text/css\" href=\"style.css\" />\n"
+	      "</head>\n"
+	      "<body class=\"frame\">\n<div id=\"sidebar\">\n", fp);
+
+	for (i = 0; i < n; i++) {
+		f = feeds[i];
+		if (f->totalnew)
+			fputs("<a class=\"n\" href=\"", fp);
+		else
+			fputs("<a href=\"", fp);
+		if (f->page)
+			fprintf(fp, "items-%llu.html#", f->page);
+		else
+			fputs("items.html#", fp);
+		xmlencode(f->name, fp);
+		fputs("\" target=\"items\">", fp);
+		if (f->totalnew > 0)
+			fputs("<b><u>", fp);
+		xmlencode(f->name, fp);
+		fprintf(fp, " (%lu)", f->totalnew);
+		if (f->totalnew > 0)
+			fputs("</u></b>", fp);
+		fputs("</a><br/>\n", fp);
+	}
+	fputs("</div></body></html>\n", fp);
+}
+
+/* index.html of sfeed_frames: the frameset */
+void
+frames_index(FILE *fp, struct feed **feeds, size_t n, int sidebar)
+{
+	fputs("<!DOCTYPE html>\n<html>\n<head>\n"
+	      "\t<meta name=\"referrer\" content=\"no-referrer\" />\n"
+	      "\t<meta http-equiv=\"Content-Type\" content=\"text/html; charset=UTF-8\" />\n"
+	      "\t<title>Newsfeed (", fp);
+	fprintf(fp, "%lu", totalnew(feeds, n));
+	fputs(")</title>\n\t<link rel=\"stylesheet\" type=\"text/css\" href=\"style.css\" />\n"
+	      "</head>\n", fp);
+	if (sidebar) {
+		fputs("<frameset framespacing=\"0\" cols=\"250,*\" frameborder=\"1\">\n"
+		      "\t<frame name=\"menu\" src=\"menu.html\" target=\"menu\">\n", fp);
+	} else {
+		fputs("<frameset framespacing=\"0\" cols=\"*\" frameborder=\"1\">\n", fp);
+	}
+	fputs(
+	      "\t<frame name=\"items\" src=\"items.html\" target=\"items\">\n"
+	      "</frameset>\n"
+	      "</html>\n", fp);
+}
+
+/* item of a page, buffered until the page is complete */
+struct pageitem {
+	size_t      line;  /* offset of the line in the buffer of the page */
+	size_t      feed;
+	struct item item;  /* fields are set when the page is complete */
+};
+
+static struct pageitem *pageitems;
+static size_t npageitems, pageitemssize;
+static char *pagebuf;
+static size_t pagelen, pagesize;
+
+/* links to the newer and older page, k of npages */
+static void
+pagenav(FILE *fp, const char *prefix, unsigned long long k,
+	unsigned long long npages)
+{
+	if (k < npages)
+		fprintf(fp, "<a href=\"%s-%llu.html\">&lt; newer</a> ",
+		        prefix, k + 1);
+	fprintf(fp, "page %llu", k);
+	if (k > 1)
+		fprintf(fp, " <a href=\"%s-%llu.html\">older &gt;</a>",
+		        prefix, k - 1);
+	fputs("\n", fp);
+}
+
+static void
+pageitems_print(FILE *fp, struct feed **feeds, const char *prefix,
+	unsigned long long k, unsigned long long npages)
+{
+	struct pageitem *p;
+	size_t i;
+
+	pagenav(fp, prefix, k, npages);
+	for (i = 0; i < npageitems; i++) {
+		p = &pageitems[i];
+		html_item(fp, &p->item, feeds[p->feed], feeds[p->feed]->name[0]);
+	}
+	pagenav(fp, prefix, k, npages);
+}
+
+/* The items of the n feed files merged in time order in pages of perpage
+ * items: the pages are numbered from the oldest item, so new items only
+ * change the newest page. The pages are written to the files prefix-k.html
+ * with the format pagefmt, the newest page is also written to fpnewest.
+ * The hashes of the pages are kept in the hashfile setpath: an older page is
+ * only written again if its items or their state changed. The limits of o
+ * apply to the timeline. */
+void
+formatpages(FILE **fps, struct feed **feeds, size_t n,
+	const struct formatopts *o, unsigned long long perpage,
+	const struct format *pagefmt, const char *prefix, const char *setpath,
+	FILE *fpnewest)
+{
+	struct timeline tl;
+	struct tlinput *in;
+	struct hashfile set;
+	struct pageitem *p;
+	struct feed *f;
+	struct item item;
+	FILE *fp;
+	char path[PATH_MAX], buf[64];
+	uint64_t h, *hashes, hdr[4] = { 0 };
+	unsigned long long i, k, total = 0, npages;
+	size_t len;
+
+	/* the amount of items: the page of an item is known from it */
+	if (o->emitted)
+		hashset_clear(o->emitted);
+	if (timeline_open(&tl, fps, n) == -1)
+		err(1, "timeline_open");
+	while ((in = timeline_next(&tl))) {
+		if (o->cutoff && in->timestamp < o->cutoff)
+			break;
+		if (o->maxitems && total >= o->maxitems)
+			break;
+		if (o->emitted) {
+			parseline(in->line, item.fields);
+			if (formatisdup(o, &item))
+				continue;
+		}
+		total++;
+	}
+	timeline_close(&tl);
+	for (i = 0; i < n; i++) {
+		if (ferror(fps[i]))
+			err(1, "ferror");
+		rewind(fps[i]);
+	}
+
+	npages = total ? (total - 1) / perpage + 1 : 1;
+	if (!(hashes = calloc(npages, sizeof(*hashes))))
+		err(1, "calloc");
+	hashfile_open(&set, setpath);
+
+	if (o->emitted)
+		hashset_clear(o->emitted);
+	if (timeline_open(&tl, fps, n) == -1)
+		err(1, "timeline_open");
+	for (i = 0, k = npages; k > 0; k--) {
+		npageitems = pagelen = 0;
+		snprintf(buf, sizeof(buf), "%llu %llu %d", perpage, k,
+		         k == npages);
+		h = hashbuf(HASHINIT, buf, strlen(buf));
+		while (i < total && (total - 1 - i) / perpage + 1 == k) {
+			/* the files changed since they were counted */
+			if (!(in = timeline_next(&tl)))
+				break;
+			if (npageitems + 1 >= pageitemssize) {
+				pageitemssize = pageitemssize ? pageitemssize * 2 : 64;
+				if (!(pageitems = realloc(pageitems,
+				    pageitemssize * sizeof(*pageitems))))
+					err(1, "realloc");
+			}
+			len = strlen(in->line) + 1;
+			if (pagelen + len > pagesize) {
+				pagesize = (pagelen + len) * 2;
+				if (!(pagebuf = realloc(pagebuf, pagesize)))
+					err(1, "realloc");
+			}
+			memcpy(pagebuf + pagelen, in->line, len);
+
+			f = feeds[in->feed];
+			p = &pageitems[npageitems];
+			p->line = pagelen;
+			p->feed = in->feed;
+			p->item.timestamp = in->timestamp;
+			/* the fields are of the page buffer once it is complete */
+			parseline(in->line, p->item.fields);
+			if (o->emitted && formatisdup(o, &(p->item)))
+				continue;
+			p->item.isnew = formatisnew(o, &(p->item));
+			p->item.anchor = (f->total == 0);
+			pagelen += len;
+			npageitems++;
+			i++;
+
+			f->totalnew += p->item.isnew;
+			f->total++;
+			if (p->item.anchor && k != npages)
+				f->page = k;
+
+			h = hashbuf(h, in->line, len);
+			h = hashbuf(h, f->name, strlen(f->name) + 1);
+			buf[0] = p->item.isnew;
+			buf[1] = p->item.anchor;
+			h = hashbuf(h, buf, 2);
+		}
+		hashes[k - 1] = h;
+		for (p = pageitems; p < pageitems + npageitems; p++)
+			parseline(pagebuf + p->line, p->item.fields);
+
+		if (k == npages && fpnewest)
+			pageitems_print(fpnewest, feeds, prefix, k, npages);
+		snprintf(path, sizeof(path), "%s-%llu.html", prefix, k);
+		if (k != npages && hashfile_find(&set, h) &&
+		    access(path, F_OK) == 0)
+			continue;
+		if (!(fp = fopen(path, "wb")))
+			err(1, "fopen: %s", path);
+		pagefmt->header(fp, 0);
+		pageitems_print(fp, feeds, prefix, k, npages);
+		pagefmt->footer(fp, feeds, n, 0);
+		if (fflush(fp) || ferror(fp))
+			err(1, "write: %s", path);
+		fclose(fp);
+	}
+	timeline_close(&tl);
+
+	/* the pages which are gone after retention */
+	for (k = npages + 1; k <= set.hdr[0]; k++) {
+		snprintf(path, sizeof(path), "%s-%llu.html", prefix, k);
+		unlink(path);
+	}
+	hashfile_close(&set);
+
+	hdr[0] = npages;
+	if (hashfile_write(setpath, NULL, hashes, npages, hdr) == -1)
+		err(1, "hashfile_write: %s", setpath);
+	free(hashes);
+}
+
+/* the sender of the mails: set once for all mails */
+static void
+mbox_header(FILE *fp, int sidebar)
+{
+	struct tm tm;
+	time_t t;
+
+	if (!(user = getenv("USER")))
+		user = "you";
+	if (gethostname(host, sizeof(host)) == -1)
+		err(1, "gethostname");
+	if ((t = time(NULL)) == -1)
+		err(1, "time");
+	if (!gmtime_r(&t, &tm))
+		errx(1, "gmtime_r: can't get current time");
+	if (!strftime(mtimebuf, sizeof(mtimebuf), "%a %b %d %H:%M:%S %Y", &tm))
+		errx(1, "strftime: can't format current time");
+}
+
+/* a mail: mail header and body */
+static void
+mail_item(FILE *fp, const struct item *item, const struct feed *f)
+{
+	char *const *fields = item->fields;
+	struct tm tm;
+	char timebuf[32];
+
+	/* can't convert: default to formatted time for time_t 0. */
+	if (gmtime_r(&item->timestamp, &tm) &&
+	    strftime(timebuf, sizeof(timebuf),
+	             "%a, %d %b %Y %H:%M:%S +0000", &tm))
+		fprintf(fp, "Date: %s\n", timebuf);
+	else
+		fprintf(fp, "Date: Thu, 01 Jan 1970 00:00:00 +0000\n");
+
+	fprintf(fp, "From: %s <sfeed@>\n", fields[FieldAuthor][0] ? fields[FieldAuthor] : "unknown");
+	fprintf(fp, "To: %s <%s@%s>\n", user, user, host);
+	if (f->name[0])
+		fprintf(fp, "Subject: [%s] %s\n", f->name, fields[FieldTitle]);
+	else
+		fprintf(fp, "Subject: %s\n", fields[FieldTitle]);
+	fprintf(fp, "Message-ID: <%s%s%016llx@%s>\n",
+	       fields[FieldUnixTimestamp],
+	       fields[FieldUnixTimestamp][0] ? "." : "",
+	       (unsigned long long)item->hash, f->name);
+	fprintf(fp, "Content-Type: text/plain; charset=\"utf-8\"\n");
+	fprintf(fp, "Content-Transfer-Encoding: binary\n");
+	fprintf(fp, "X-Feedname: %s\n\n", f->name);
+
+	fprintf(fp, "%s\n", fields[FieldLink]);
+	if (fields[FieldEnclosure][0])
+		fprintf(fp, "\nEnclosure:\n%s\n", fields[FieldEnclosure]);
+	fputs("\n", fp);
+}
+
+const struct format format_mail = {
+	"mail", 1, mbox_header, NULL, mail_item, NULL
+};
+
+static void
+mbox_item(FILE *fp, const struct item *item, const struct feed *f)
+{
+	fprintf(fp, "From MAILER-DAEMON %s\n", mtimebuf);
+	mail_item(fp, item, f);
+}
+
+const struct format format_mbox = {
+	"mbox", 1, mbox_header, NULL, mbox_item, NULL
+};
+
+static void
+plain_item(FILE *fp, const struct item *item, const struct feed *f)
+{
+	struct tm *tm;
+
+	if (!(tm = localtime(&item->timestamp)))
+		err(1, "localtime");
+
+	if (item->isnew)
+		fputs("N ", fp);
+	else
+		fputs("  ", fp);
+
+	fprintf(fp, "%04d-%02d-%02d %02d:%02d  ",
+	        tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday,
+	        tm->tm_hour, tm->tm_min);
+	if (f->name[0]) {
+		printutf8pad(fp, f->name, 15, ' ');
+		fputs("  ", fp);
+	}
+	printutf8pad(fp, item->fields[FieldTitle], 70, ' ');
+	fprintf(fp, " %s\n", item->fields[FieldLink]);
+}
+
+const struct format format_plain = {
+	"plain", 0, NULL, NULL, plain_item, NULL
+};
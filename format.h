@@ -0,0 +1,55 @@
+#ifndef _FORMAT_H
+#define _FORMAT_H
+
+/* item of a feed file, parsed once for all output formats */
+struct item {
+	char          *fields[FieldLast];
+	time_t         timestamp;
+	int            isnew;
+	int            anchor; /* target of the links to the feed, see html_item */
+	uint64_t       hash;   /* of the feed name and line, for rawhash formats */
+};
+
+/* Output format: the functions are called in the order of the output with
+ * the output file of the format, a function can be NULL. sidebar is set when
+ * the feeds are named (read from files). */
+struct format {
+	const char *name;
+	int         rawhash;  /* needs the hash of the line of the items */
+	void (*header)(FILE *, int sidebar);
+	void (*feed)(FILE *, const struct feed *);
+	void (*item)(FILE *, const struct item *, const struct feed *);
+	void (*footer)(FILE *, struct feed **, size_t, int sidebar);
+};
+
+/* items to format */
+struct formatopts {
+	time_t               comparetime; /* newer items are new */
+	const struct keyset *read;        /* read items: the other items are new
+	                                     instead of by comparetime */
+	time_t               cutoff;      /* oldest time to show, 0: all items */
+	struct hashset      *emitted;     /* links of the shown items: an item
+	                                     with a shown link is not shown,
+	                                     NULL: all items */
+	unsigned long long   maxitems;    /* per feed, 0: all items */
+};
+
+extern const struct format format_atom, format_frames, format_html,
+                           format_htmlpage, format_mail, format_mbox,
+                           format_plain;
+
+void formatfeed(FILE *, struct feed *, const struct formatopts *,
+                const struct format **, FILE **, size_t);
+
+void formatdedup(struct formatopts *, char **, size_t);
+int  formatisdup(const struct formatopts *, const struct item *);
+int  formatisnew(const struct formatopts *, const struct item *);
+void formatpages(FILE **, struct feed **, size_t, const struct formatopts *,
+                 unsigned long long, const struct format *, const char *,
+                 const char *, FILE *);
+
+void frames_index(FILE *, struct feed **, size_t, int);
+void frames_menu(FILE *, struct feed **, size_t);
+void html_item(FILE *, const struct item *, const struct feed *, int);
+
+#endif
@@ -8,6 +8,7 @@
 #include <string.h>
 #include <strings.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "util.h"
 #include "xml.h"
@@ -92,6 +93,8 @@ typedef struct feedcontext {
 static long long  datetounix(long long, int, int, int, int, int);
 static enum TagId gettag(enum FeedType, const char *, size_t);
 static long long  gettzoffset(const char *);
+static void hintend(void);
+static void hintstart(const char *, size_t);
 static int  isattr(const char *, size_t, const char *, size_t);
 static int  istag(const char *, size_t, const char *, size_t);
 static int  parsetime(const char *, time_t *);
@@ -178,6 +181,16 @@ static int fieldmap[TagLast] = {
 
 static const int FieldSeparator = '\t';
 static const char *baseurl = "";
+static const char *argv0;
+
+/* update interval hints of the channel, before the first item / entry */
+enum HintTag { HintNone, HintTtl, HintUpdatePeriod, HintUpdateFrequency };
+static FILE *hintfp;
+static enum HintTag hinttag;
+static String hintdata;
+static int hintdone;
+/* hints in seconds */
+static long long hintttl, hintperiod, hintfrequency = 1;
 
 static FeedContext ctx;
 static XMLParser parser; /* XML parser state */
@@ -720,6 +733,65 @@ xmldataentity(XMLParser *p, const char *data, size_t datalen)
 		xmldata(p, data, datalen);
 }
 
+static void
+hintstart(const char *t, size_t tl)
+{
+	if (istag(t, tl, STRP("ttl")))
+		hinttag = HintTtl;
+	else if (istag(t, tl, STRP("sy:updatePeriod")))
+		hinttag = HintUpdatePeriod;
+	else if (istag(t, tl, STRP("sy:updateFrequency")))
+		hinttag = HintUpdateFrequency;
+	else
+		return;
+	ctx.field = &hintdata;
+	string_clear(ctx.field);
+}
+
+static void
+hintend(void)
+{
+	static const struct {
+		const char *name;
+		long long   seconds;
+	} periods[] = {
+		{ "hourly",  3600     },
+		{ "daily",   86400    },
+		{ "weekly",  604800   },
+		{ "monthly", 2592000  },
+		{ "yearly",  31536000 }
+	};
+	char *s = hintdata.data ? hintdata.data : "";
+	size_t i;
+	long long n;
+
+	/* trim whitespace */
+	for (; isspace((unsigned char)*s); s++)
+		;
+	s[strcspn(s, " \t\r\n")] = '\0';
+
+	switch (hinttag) {
+	case HintTtl: /* minutes */
+		if ((n = strtoll(s, NULL, 10)) > 0)
+			hintttl = n * 60;
+		break;
+	case HintUpdatePeriod:
+		for (i = 0; i < sizeof(periods) / sizeof(*periods); i++) {
+			if (!strcasecmp(s, periods[i].name))
+				hintperiod = periods[i].seconds;
+		}
+		break;
+	case HintUpdateFrequency:
+		if ((n = strtoll(s, NULL, 10)) > 0)
+			hintfrequency = n;
+		break;
+	default:
+		break;
+	}
+	hinttag = HintNone;
+	ctx.field = NULL;
+}
+
 static void
 xmltagstart(XMLParser *p, const char *t, size_t tl)
 {
@@ -740,6 +812,15 @@ xmltagstart(XMLParser *p, const char *t, size_t tl)
 			ctx.feedtype = FeedTypeAtom;
 		else if (istag(t, tl, STRP("item")))
 			ctx.feedtype = FeedTypeRSS;
+		else if (hintfp && !hintdone && !hinttag)
+			hintstart(t, tl);
+
+		/* only the hints of the channel are used */
+		if (ctx.feedtype != FeedTypeNone) {
+			hintdone = 1;
+			hinttag = HintNone;
+			ctx.field = NULL;
+		}
 		return;
 	}
 
@@ -815,8 +896,11 @@ xmltagend(XMLParser *p, const char *t, size_t tl, int isshort)
 {
 	size_t i;
 
-	if (ctx.feedtype == FeedTypeNone)
+	if (ctx.feedtype == FeedTypeNone) {
+		if (hinttag)
+			hintend();
 		return;
+	}
 
 	if (ISINCONTENT(ctx)) {
 		/* not close content field */
@@ -871,14 +955,38 @@ xmltagend(XMLParser *p, const char *t, size_t tl, int isshort)
 	ctx.field = NULL;
 }
 
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: %s [-t hintfile] [baseurl]\n", argv0);
+	exit(1);
+}
+
 int
 main(int argc, char *argv[])
 {
+	long long n = 0;
+	int ch;
+
+	argv0 = argv[0];
+	while ((ch = getopt(argc, argv, "t:")) != -1) {
+		switch (ch) {
+		case 't':
+			if (!(hintfp = fopen(optarg, "w")))
+				err(1, "fopen: %s", optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
 	if (pledge("stdio", NULL) == -1)
 		err(1, "pledge");
 
-	if (argc > 1)
-		baseurl = argv[1];
+	if (argc > 0)
+		baseurl = argv[0];
 
 	parser.xmlattr = xmlattr;
 	parser.xmlattrend = xmlattrend;
@@ -893,5 +1001,18 @@ main(int argc, char *argv[])
 	/* NOTE: getnext is defined in xml.h for inline optimization */
 	xml_parse(&parser);
 
+	/* the largest update interval of the hints, empty without hints */
+	if (hintfp) {
+		if (hintperiod)
+			n = hintperiod / hintfrequency;
+		if (hintttl > n)
+			n = hintttl;
+		if (n > 0)
+			fprintf(hintfp, "%lld\n", n);
+		if (fflush(hintfp) || ferror(hintfp))
+			err(1, "write");
+		fclose(hintfp);
+	}
+
 	return 0;
 }
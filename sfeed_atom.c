@@ -2,135 +2,120 @@
 
 #include <ctype.h>
 #include <err.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "util.h"
+#include "format.h"
 
-static char *line;
-static size_t linesize;
+static char *argv0;
+static struct formatopts opts;
+static const struct format *fmt = &format_atom;
+static char **files;
+static int jobs = 1;
 
 static void
-printcontent(const char *s)
+formatfile(FILE *fpout, size_t i)
 {
-	for (; *s; ++s) {
-		switch (*s) {
-		case '<':  fputs("&lt;",   stdout); break;
-		case '>':  fputs("&gt;",   stdout); break;
-		case '\'': fputs("&#39;",  stdout); break;
-		case '&':  fputs("&amp;",  stdout); break;
-		case '"':  fputs("&quot;", stdout); break;
-		case '\\':
-			s++;
-			switch (*s) {
-			case 'n':  putchar('\n'); break;
-			case '\\': putchar('\\'); break;
-			case 't':  putchar('\t'); break;
-			}
-			break;
-		default:  putchar(*s);
-		}
-	}
+	struct feed f;
+	FILE *fp;
+	char *name;
+
+	if (!(fp = fopen(files[i], "r")))
+		err(1, "fopen: %s", files[i]);
+	memset(&f, 0, sizeof(f));
+	f.name = ((name = strrchr(files[i], '/'))) ? name + 1 : files[i];
+	formatfeed(fp, &f, &opts, &fmt, &fpout, 1);
+	if (ferror(fp))
+		err(1, "ferror: %s", files[i]);
+	fclose(fp);
 }
 
-static void
-printfeed(FILE *fp, const char *feedname)
+static unsigned long long
+number(const char *s)
 {
-	char *fields[FieldLast];
-	struct tm *tm;
-	time_t parsedtime;
-	ssize_t linelen;
-
-	while ((linelen = getline(&line, &linesize, fp)) > 0) {
-		if (line[linelen - 1] == '\n')
-			line[--linelen] = '\0';
-		if (!parseline(line, fields))
-			break;
+	unsigned long long n;
+	char *e;
 
-		parsedtime = 0;
-		if (strtotime(fields[FieldUnixTimestamp], &parsedtime))
-			continue;
-		if (!(tm = localtime(&parsedtime)))
-			err(1, "localtime");
-
-		fputs("<entry>\n\t<title>", stdout);
-		if (feedname[0]) {
-			fputs("[", stdout);
-			xmlencode(feedname, stdout);
-			fputs("] ", stdout);
-		}
-		xmlencode(fields[FieldTitle], stdout);
-		fputs("</title>\n", stdout);
-		if (fields[FieldLink][0]) {
-			fputs("\t<link rel=\"alternate\" href=\"", stdout);
-			xmlencode(fields[FieldLink], stdout);
-			fputs("\" />\n", stdout);
-		}
-		if (fields[FieldEnclosure][0]) {
-			fputs("\t<link rel=\"enclosure\" href=\"", stdout);
-			xmlencode(fields[FieldEnclosure], stdout);
-			fputs("\" />\n", stdout);
-		}
-		fprintf(stdout, "\t<published>%04d-%02d-%02dT%02d:%02d:%02dZ</published>\n",
-		        tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday,
-		        tm->tm_hour, tm->tm_min, tm->tm_sec);
-		if (fields[FieldAuthor][0]) {
-			fputs("\t<author><name>", stdout);
-			xmlencode(fields[FieldAuthor], stdout);
-			fputs("</name></author>\n", stdout);
-		}
-		if (fields[FieldContent][0]) {
-			if (!strcmp(fields[FieldContentType], "html")) {
-				fputs("\t<content type=\"html\">", stdout);
-			} else {
-				/* NOTE: an RSS/Atom viewer may or may not format
-				   whitespace such as newlines.
-				   Workaround: type="html" and <![CDATA[<pre></pre>]]> */
-				fputs("\t<content type=\"text\">", stdout);
-			}
-			printcontent(fields[FieldContent]);
-			fputs("</content>\n", stdout);
-		}
-		fputs("</entry>\n", stdout);
-	}
+	errno = 0;
+	n = strtoull(s, &e, 10);
+	if (errno || !*s || *e || *s == '-')
+		errx(1, "invalid number: %s", s);
+
+	return n;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: %s [-u] [-j jobs] [-n maxitems] [-t seconds] "
+	        "[file...]\n", argv0);
+	exit(1);
 }
 
 int
 main(int argc, char *argv[])
 {
-	FILE *fp;
-	char *name;
-	int i;
+	struct feed f;
+	FILE *fpout = stdout;
+	int ch, unique = 0;
 
-	if (argc == 1) {
+	argv0 = argv[0];
+	while ((ch = getopt(argc, argv, "j:n:t:u")) != -1) {
+		switch (ch) {
+		case 'j':
+			if (!(jobs = number(optarg)))
+				usage();
+			break;
+		case 'n':
+			opts.maxitems = number(optarg);
+			break;
+		case 't':
+			opts.cutoff = (time_t)((long long)time(NULL) -
+			              (long long)number(optarg));
+			break;
+		case 'u':
+			unique = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	/* the shown links are kept in this process */
+	if (unique) {
+		formatdedup(&opts, argv, argc);
+		jobs = 1;
+	}
+
+	if (argc == 0) {
 		if (pledge("stdio", NULL) == -1)
 			err(1, "pledge");
 	} else {
-		if (pledge("stdio rpath", NULL) == -1)
+		if (pledge(jobs > 1 ? "stdio rpath proc" : "stdio rpath",
+		    NULL) == -1)
 			err(1, "pledge");
 	}
 
-	fputs("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
-	      "<feed xmlns=\"http://www.w3.org/2005/Atom\" xml:lang=\"en\">\n",
-	      stdout);
+	fmt->header(stdout, argc > 0);
 
-	if (argc == 1) {
-		printfeed(stdin, "");
+	if (argc == 0) {
+		memset(&f, 0, sizeof(f));
+		f.name = "";
+		formatfeed(stdin, &f, &opts, &fmt, &fpout, 1);
 	} else {
-		for (i = 1; i < argc; i++) {
-			if (!(fp = fopen(argv[i], "r")))
-				err(1, "fopen: %s", argv[i]);
-			name = ((name = strrchr(argv[i], '/'))) ? name + 1 : argv[i];
-			printfeed(fp, name);
-			if (ferror(fp))
-				err(1, "ferror: %s", argv[i]);
-			fclose(fp);
-		}
+		files = argv;
+		if (formatjobs(stdout, argc, jobs, formatfile, NULL) == -1)
+			return 1;
 	}
 
-	fputs("</feed>\n", stdout);
+	fmt->footer(stdout, NULL, 0, argc > 0);
 
 	return 0;
 }
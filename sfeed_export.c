@@ -0,0 +1,150 @@
+#include <sys/types.h>
+
+#include <err.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "util.h"
+
+static char *argv0;
+
+static long long
+number(const char *s)
+{
+	long long n;
+	char *e;
+
+	errno = 0;
+	n = strtoll(s, &e, 10);
+	if (errno || !*s || *e)
+		errx(1, "invalid number: %s", s);
+
+	return n;
+}
+
+/* append the feed data from stdin to the store */
+static void
+import(const char *dir, const char *name)
+{
+	char buf[BUFSIZ], *data = NULL;
+	size_t n, len = 0, size = 0;
+
+	while ((n = fread(buf, 1, sizeof(buf), stdin)) > 0) {
+		if (len + n > size) {
+			size = (len + n) * 2;
+			if (!(data = realloc(data, size)))
+				err(1, "realloc");
+		}
+		memcpy(data + len, buf, n);
+		len += n;
+	}
+	if (ferror(stdin))
+		err(1, "fread");
+	if (store_append(dir, name, data, len) == -1)
+		err(1, "append: %s", dir);
+	free(data);
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: %s [-f feedname] [-s start] [-e end] "
+	        "[-t seconds] storepath\n", argv0);
+	fprintf(stderr, "       %s -i feedname storepath\n", argv0);
+	fprintf(stderr, "       %s -l storepath\n", argv0);
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct store s;
+	struct storerec *recs;
+	char *feedname = NULL, *importname = NULL, *line = NULL;
+	size_t linesize = 0;
+	ssize_t i, n;
+	long long from = LLONG_MIN, to = LLONG_MAX;
+	long feed = -1;
+	int ch, list = 0;
+
+	argv0 = argv[0];
+	while ((ch = getopt(argc, argv, "e:f:i:ls:t:")) != -1) {
+		switch (ch) {
+		case 'e':
+			to = number(optarg);
+			break;
+		case 'f':
+			feedname = optarg;
+			break;
+		case 'i':
+			importname = optarg;
+			break;
+		case 'l':
+			list = 1;
+			break;
+		case 's':
+			from = number(optarg);
+			break;
+		case 't':
+			from = (long long)time(NULL) - number(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc != 1)
+		usage();
+
+	if (importname) {
+		if (pledge("stdio rpath wpath cpath flock", NULL) == -1)
+			err(1, "pledge");
+		import(argv[0], importname);
+		return 0;
+	}
+
+	if (pledge("stdio rpath", NULL) == -1)
+		err(1, "pledge");
+
+	if (store_open(&s, argv[0]) == -1)
+		err(1, "open: %s", argv[0]);
+
+	if (pledge("stdio", NULL) == -1)
+		err(1, "pledge");
+
+	if (list) {
+		for (i = 0; i < (ssize_t)s.nfeeds; i++)
+			printf("%s\n", s.feeds[i]);
+		store_close(&s);
+		return 0;
+	}
+
+	/* an unknown feed has no items */
+	if (feedname && (feed = store_findfeed(&s, feedname)) == -1) {
+		store_close(&s);
+		return 0;
+	}
+
+	if ((n = store_query(&s, feed, from, to, &recs)) == -1)
+		err(1, "query: %s", argv[0]);
+	for (i = 0; i < n; i++) {
+		if (store_readline(&s, &recs[i], &line, &linesize) == -1)
+			err(1, "read: %s", argv[0]);
+		fputs(line, stdout);
+		putchar('\n');
+	}
+	free(recs);
+	free(line);
+	store_close(&s);
+
+	if (fflush(stdout) || ferror(stdout))
+		err(1, "write");
+
+	return 0;
+}
@@ -0,0 +1,52 @@
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+#include "filter.h"
+
+static struct filter filter;
+static char *line, *copy;
+static size_t linesize, copysize;
+
+int
+main(int argc, char *argv[])
+{
+	char *fields[FieldLast];
+	ssize_t linelen;
+
+	if (pledge("stdio rpath", NULL) == -1)
+		err(1, "pledge");
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s rulesfile\n", argv[0]);
+		return 1;
+	}
+	/* the rules are compiled once for all items */
+	if (filter_load(&filter, argv[1]) == -1)
+		return 1;
+
+	if (pledge("stdio", NULL) == -1)
+		err(1, "pledge");
+
+	while ((linelen = getline(&line, &linesize, stdin)) > 0) {
+		if ((size_t)linelen + 1 > copysize) {
+			copysize = linesize;
+			if (!(copy = realloc(copy, copysize)))
+				err(1, "realloc");
+		}
+		memcpy(copy, line, linelen + 1);
+		if (copy[linelen - 1] == '\n')
+			copy[linelen - 1] = '\0';
+		parseline(copy, fields);
+		if (filter_match(&filter, fields))
+			fwrite(line, 1, linelen, stdout);
+	}
+	if (ferror(stdin))
+		err(1, "getline");
+	if (fflush(stdout) || ferror(stdout))
+		err(1, "write");
+
+	return 0;
+}
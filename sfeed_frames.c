@@ -14,88 +14,169 @@
 #include <unistd.h>
 
 #include "util.h"
+#include "format.h"
 
+static char *argv0;
 static struct feed **feeds;
-static char *line;
-static size_t linesize;
-static time_t comparetime;
-static unsigned long totalnew;
+static char **files;
+static int jobs = 1;
+static unsigned long long perpage; /* 0: no pages */
+static struct formatopts opts;
+static struct keyset readset;
+static const struct format *fmt = &format_frames;
+static unsigned long long maxage; /* -t seconds */
+static struct manifest manifest;
+static char manifesthdr[96];
+
+/* the cached output of a feed is valid if the feed file is unchanged and no
+   shown item became old or fell out of the time window since, with read
+   items the generation of the read file is in the manifest header */
+static int
+isfresh(const struct feed *f, const struct stat *st)
+{
+	return f->mtime == (long long)st->st_mtim.tv_sec * 1000000000LL +
+	       st->st_mtim.tv_nsec && f->size == (long long)st->st_size &&
+	       (opts.read || !f->totalnew ||
+	       f->timeoldestnew >= opts.comparetime) &&
+	       (!opts.cutoff || !f->total || f->timeoldest >= opts.cutoff);
+}
 
 static void
-printfeed(FILE *fpitems, FILE *fpin, struct feed *f)
+copyfile(FILE *fpout, FILE *fpin, const char *path)
 {
-	char *fields[FieldLast];
-	ssize_t linelen;
-	unsigned int isnew;
-	struct tm *tm;
-	time_t parsedtime;
-
-	/* menu if not unnamed */
-	if (f->name[0]) {
-		fputs("<h2 id=\"", fpitems);
-		xmlencode(f->name, fpitems);
-		fputs("\"><a href=\"#", fpitems);
-		xmlencode(f->name, fpitems);
-		fputs("\">", fpitems);
-		xmlencode(f->name, fpitems);
-		fputs("</a></h2>\n", fpitems);
-	}
+	char buf[BUFSIZ];
+	size_t n;
 
-	while ((linelen = getline(&line, &linesize, fpin)) > 0) {
-		if (line[linelen - 1] == '\n')
-			line[--linelen] = '\0';
-		if (!parseline(line, fields))
-			break;
+	while ((n = fread(buf, 1, sizeof(buf), fpin)) > 0)
+		fwrite(buf, 1, n, fpout);
+	if (ferror(fpin))
+		err(1, "fread: %s", path);
+}
 
-		parsedtime = 0;
-		if (strtotime(fields[FieldUnixTimestamp], &parsedtime))
-			continue;
-		if (!(tm = localtime(&parsedtime)))
-			err(1, "localtime");
-
-		isnew = (parsedtime >= comparetime) ? 1 : 0;
-		totalnew += isnew;
-		f->totalnew += isnew;
-		f->total++;
-
-		fprintf(fpitems, "%04d-%02d-%02d&nbsp;%02d:%02d ",
-		        tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday,
-		        tm->tm_hour, tm->tm_min);
-		if (isnew)
-			fputs("<b><u>", fpitems);
-		if (fields[FieldLink][0]) {
-			fputs("<a href=\"", fpitems);
-			xmlencode(fields[FieldLink], fpitems);
-			fputs("\">", fpitems);
-			xmlencode(fields[FieldTitle], fpitems);
-			fputs("</a>", fpitems);
-		} else {
-			xmlencode(fields[FieldTitle], fpitems);
-		}
-		if (isnew)
-			fputs("</u></b>", fpitems);
-		fputs("\n", fpitems);
+/* format the items of a feed to its fragment file, unless the fragment is
+   still valid, and copy the fragment */
+static void
+formatfile(FILE *fpout, size_t i)
+{
+	FILE *fp, *fpfrag;
+	struct feed *f = feeds[i];
+	const struct feed *cached;
+	struct stat st;
+	char *name = f->name, path[PATH_MAX + 1];
+
+	if (stat(files[i], &st) == -1)
+		err(1, "stat: %s", files[i]);
+
+	/* with -u the items shown depend on the feeds before: no cache */
+	snprintf(path, sizeof(path), ".%s.html", f->name);
+	if (!opts.emitted && (cached = manifest_find(&manifest, f->name)) &&
+	    isfresh(cached, &st) && (fpfrag = fopen(path, "rb"))) {
+		*f = *cached;
+		f->name = name;
+	} else {
+		if (!(fp = fopen(files[i], "r")))
+			err(1, "fopen: %s", files[i]);
+		if (!(fpfrag = fopen(path, "w+b")))
+			err(1, "fopen: %s", path);
+		formatfeed(fp, f, &opts, &fmt, &fpfrag, 1);
+		if (ferror(fp))
+			err(1, "ferror: %s", files[i]);
+		fclose(fp);
+		if (fflush(fpfrag) || ferror(fpfrag))
+			err(1, "write: %s", path);
+		rewind(fpfrag);
 	}
+	f->mtime = (long long)st.st_mtim.tv_sec * 1000000000LL +
+	           st.st_mtim.tv_nsec;
+	f->size = st.st_size;
+
+	copyfile(fpout, fpfrag, path);
+	fclose(fpfrag);
+}
+
+static unsigned long long
+number(const char *s)
+{
+	unsigned long long n;
+	char *e;
+
+	errno = 0;
+	n = strtoull(s, &e, 10);
+	if (errno || !*s || *e || *s == '-')
+		errx(1, "invalid number: %s", s);
+
+	return n;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: %s [-u] [-j jobs] [-n maxitems] [-p perpage] "
+	        "[-r readfile] [-t seconds] [file...]\n", argv0);
+	exit(1);
 }
 
 int
 main(int argc, char *argv[])
 {
-	FILE *fpindex, *fpitems, *fpmenu = NULL, *fp;
+	struct stat st;
+	FILE *fpindex, *fpitems, *fpmenu = NULL, **fps;
 	char *name;
-	int i, showsidebar = (argc > 1);
-	struct feed *f;
+	int ch, i, showsidebar, unique = 0;
 
-	if (pledge("stdio rpath wpath cpath", NULL) == -1)
+	if (pledge("stdio rpath wpath cpath proc", NULL) == -1)
 		err(1, "pledge");
 
-	if (!(feeds = calloc(argc, sizeof(struct feed *))))
+	argv0 = argv[0];
+	while ((ch = getopt(argc, argv, "j:n:p:r:t:u")) != -1) {
+		switch (ch) {
+		case 'j':
+			if (!(jobs = number(optarg)))
+				usage();
+			break;
+		case 'n':
+			opts.maxitems = number(optarg);
+			break;
+		case 'p':
+			if (!(perpage = number(optarg)))
+				usage();
+			break;
+		case 'r':
+			/* a missing file is an empty set: all items are new */
+			if (keyset_open(&readset, optarg) == -1 &&
+			    stat(optarg, &st) == 0)
+				errx(1, "invalid read file: %s", optarg);
+			opts.read = &readset;
+			break;
+		case 't':
+			maxage = number(optarg);
+			opts.cutoff = (time_t)((long long)time(NULL) -
+			              (long long)maxage);
+			break;
+		case 'u':
+			unique = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	/* the shown links are kept in this process */
+	if (unique) {
+		formatdedup(&opts, argv, argc);
+		jobs = 1;
+	}
+
+	showsidebar = (argc > 0);
+	if (!(feeds = calloc(argc ? argc : 1, sizeof(struct feed *))))
 		err(1, "calloc");
 
-	if ((comparetime = time(NULL)) == -1)
+	if ((opts.comparetime = time(NULL)) == -1)
 		err(1, "time");
 	/* 1 day is old news */
-	comparetime -= 86400;
+	opts.comparetime -= 86400;
 
 	/* write main index page */
 	if (!(fpindex = fopen("index.html", "wb")))
@@ -105,84 +186,66 @@ main(int argc, char *argv[])
 	if (showsidebar && !(fpmenu = fopen("menu.html", "wb")))
 		err(1, "fopen: menu.html");
 
-	if (pledge(argc == 1 ? "stdio" : "stdio rpath", NULL) == -1)
+	if (argc == 0 && pledge("stdio", NULL) == -1)
 		err(1, "pledge");
 
-	fputs("<!DOCTYPE HTML>\n"
-	      "<html>\n"
-	      "\t<head>\n"
-	      "\t<meta name=\"referrer\" content=\"no-referrer\" />\n"
-	      "\t<meta http-equiv=\"Content-Type\" content=\"text/html; charset=UTF-8\" />\n"
-	      "\t<link rel=\"stylesheet\" type=\"text/css\" href=\"style.css\" />\n"
-	      "</head>\n"
-	      "<body class=\"frame\"><div id=\"items\"><pre>\n", fpitems);
+	fmt->header(fpitems, showsidebar);
 
-	if (argc == 1) {
+	if (argc == 0) {
 		if (!(feeds[0] = calloc(1, sizeof(struct feed))))
 			err(1, "calloc");
 		feeds[0]->name = "";
-		printfeed(fpitems, stdin, feeds[0]);
-	} else {
-		for (i = 1; i < argc; i++) {
-			if (!(feeds[i - 1] = calloc(1, sizeof(struct feed))))
+		formatfeed(stdin, feeds[0], &opts, &fmt, &fpitems, 1);
+	} else if (perpage) {
+		/* the items of all feeds in time order, in pages */
+		if (!(fps = calloc(argc, sizeof(FILE *))))
+			err(1, "calloc");
+		for (i = 0; i < argc; i++) {
+			if (!(feeds[i] = calloc(1, sizeof(struct feed))))
 				err(1, "calloc");
 			name = ((name = strrchr(argv[i], '/'))) ? name + 1 : argv[i];
-			feeds[i - 1]->name = name;
-
-			if (!(fp = fopen(argv[i], "r")))
+			feeds[i]->name = name;
+			if (!(fps[i] = fopen(argv[i], "r")))
 				err(1, "fopen: %s", argv[i]);
-			printfeed(fpitems, fp, feeds[i - 1]);
-			if (ferror(fp))
-				err(1, "ferror: %s", argv[i]);
-			fclose(fp);
 		}
-	}
-	fputs("</pre>\n</div></body>\n</html>\n", fpitems); /* div items */
-
-	if (showsidebar) {
-		fputs("<!DOCTYPE HTML>\n"
-		      "<html>\n"
-		      "<head>\n"
-		      "\t<meta http-equiv=\"Content-Type\" content=\"text/html; charset=UTF-8\" />\n"
-		      "\t<link rel=\"stylesheet\" type=\"text/css\" href=\"style.css\" />\n"
-		      "</head>\n"
-		      "<body class=\"frame\">\n<div id=\"sidebar\">\n", fpmenu);
-
-		for (i = 1; i < argc; i++) {
-			f = feeds[i - 1];
-			if (f->totalnew)
-				fputs("<a class=\"n\" href=\"items.html#", fpmenu);
-			else
-				fputs("<a href=\"items.html#", fpmenu);
-			xmlencode(f->name, fpmenu);
-			fputs("\" target=\"items\">", fpmenu);
-			if (f->totalnew > 0)
-				fputs("<b><u>", fpmenu);
-			xmlencode(f->name, fpmenu);
-			fprintf(fpmenu, " (%lu)", f->totalnew);
-			if (f->totalnew > 0)
-				fputs("</u></b>", fpmenu);
-			fputs("</a><br/>\n", fpmenu);
+		formatpages(fps, feeds, argc, &opts, perpage, fmt, "items",
+		            ".sfeed_frames.pages", fpitems);
+		for (i = 0; i < argc; i++) {
+			if (ferror(fps[i]))
+				err(1, "ferror: %s", argv[i]);
+			fclose(fps[i]);
 		}
-		fputs("</div></body></html>\n", fpmenu);
-	}
-	fputs("<!DOCTYPE html>\n<html>\n<head>\n"
-	      "\t<meta name=\"referrer\" content=\"no-referrer\" />\n"
-	      "\t<meta http-equiv=\"Content-Type\" content=\"text/html; charset=UTF-8\" />\n"
-	      "\t<title>Newsfeed (", fpindex);
-	fprintf(fpindex, "%lu", totalnew);
-	fputs(")</title>\n\t<link rel=\"stylesheet\" type=\"text/css\" href=\"style.css\" />\n"
-	      "</head>\n", fpindex);
-	if (showsidebar) {
-		fputs("<frameset framespacing=\"0\" cols=\"250,*\" frameborder=\"1\">\n"
-		      "\t<frame name=\"menu\" src=\"menu.html\" target=\"menu\">\n", fpindex);
+		free(fps);
 	} else {
-		fputs("<frameset framespacing=\"0\" cols=\"*\" frameborder=\"1\">\n", fpindex);
+		/* the items of each feed are cached in a fragment file, feeds
+		   with a valid fragment are not read again */
+		snprintf(manifesthdr, sizeof(manifesthdr),
+		         "sfeed_frames\t%llu\t%llu\t%llu\t%d", opts.maxitems,
+		         maxage, opts.read ? (unsigned long long)readset.gen + 1 : 0,
+		         unique);
+		if (manifest_open(&manifest, ".sfeed_frames.manifest",
+		    manifesthdr) == -1)
+			err(1, "manifest_open: .sfeed_frames.manifest");
+
+		for (i = 0; i < argc; i++) {
+			if (!(feeds[i] = calloc(1, sizeof(struct feed))))
+				err(1, "calloc");
+			name = ((name = strrchr(argv[i], '/'))) ? name + 1 : argv[i];
+			feeds[i]->name = name;
+		}
+		files = argv;
+		if (formatjobs(fpitems, argc, jobs, formatfile, feeds) == -1)
+			return 1;
+
+		if (manifest_write(".sfeed_frames.manifest", manifesthdr, feeds,
+		    argc) == -1)
+			err(1, "manifest_write: .sfeed_frames.manifest");
+		manifest_close(&manifest);
 	}
-	fputs(
-	      "\t<frame name=\"items\" src=\"items.html\" target=\"items\">\n"
-	      "</frameset>\n"
-	      "</html>\n", fpindex);
+	fmt->footer(fpitems, feeds, argc ? argc : 1, showsidebar);
+	if (showsidebar)
+		frames_menu(fpmenu, feeds, argc);
+	frames_index(fpindex, feeds, argc ? argc : 1, showsidebar);
 
 	fclose(fpindex);
 	fclose(fpitems);
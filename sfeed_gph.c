@@ -15,11 +15,21 @@
 
 #include "util.h"
 
+static char *argv0;
 static struct feed **feeds;
+static char **files;
+static int jobs = 1;
 static char *prefixpath;
 static char *line;
 static size_t linesize;
 static time_t comparetime;
+static struct keyset readset;
+static int useread; /* -r: items which are not read are new */
+static time_t cutoff; /* oldest time to show, 0: all items */
+static unsigned long long maxitems; /* 0: all items */
+static unsigned long long maxage; /* -t seconds */
+static struct manifest manifest;
+static char manifesthdr[96];
 static unsigned long totalnew;
 
 /* Escape characters in links in geomyidae .gph format */
@@ -67,13 +77,26 @@ printfeed(FILE *fpitems, FILE *fpin, struct feed *f)
 		parsedtime = 0;
 		if (strtotime(fields[FieldUnixTimestamp], &parsedtime))
 			continue;
+		/* the items are sorted newest first: the rest is older */
+		if (cutoff && parsedtime < cutoff)
+			break;
 		if (!(tm = localtime(&parsedtime)))
 			err(1, "localtime");
 
-		isnew = (parsedtime >= comparetime) ? 1 : 0;
+		if (useread)
+			isnew = !keyset_find(&readset, keyset_itemkey(
+			        fields[FieldLink], fields[FieldId]));
+		else
+			isnew = (parsedtime >= comparetime) ? 1 : 0;
 		totalnew += isnew;
 		f->totalnew += isnew;
 		f->total++;
+		if (f->total == 1 || parsedtime > f->timenewest)
+			f->timenewest = parsedtime;
+		if (f->total == 1 || parsedtime < f->timeoldest)
+			f->timeoldest = parsedtime;
+		if (isnew && (f->totalnew == 1 || parsedtime < f->timeoldestnew))
+			f->timeoldestnew = parsedtime;
 
 		if (fields[FieldLink][0]) {
 			fputs("[h|", fpitems);
@@ -89,24 +112,134 @@ printfeed(FILE *fpitems, FILE *fpin, struct feed *f)
 			        tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday,
 			        tm->tm_hour, tm->tm_min, fields[FieldTitle]);
 		}
+		if (maxitems && f->total >= maxitems)
+			break;
 	}
 }
 
+/* the cached output of a feed is valid if the feed file is unchanged and no
+   shown item became old or fell out of the time window since, with read
+   items the generation of the read file is in the manifest header */
+static int
+isfresh(const struct feed *f, const struct stat *st)
+{
+	return f->mtime == (long long)st->st_mtim.tv_sec * 1000000000LL +
+	       st->st_mtim.tv_nsec && f->size == (long long)st->st_size &&
+	       (useread || !f->totalnew || f->timeoldestnew >= comparetime) &&
+	       (!cutoff || !f->total || f->timeoldest >= cutoff);
+}
+
+/* write the .gph file of a feed, unless it is still valid, and its item in
+   the index */
+static void
+formatfile(FILE *fpindex, size_t i)
+{
+	FILE *fp, *fpitems;
+	struct feed *f = feeds[i];
+	const struct feed *cached;
+	struct stat st;
+	char *name = f->name, path[PATH_MAX + 1];
+
+	if (stat(files[i], &st) == -1)
+		err(1, "stat: %s", files[i]);
+
+	snprintf(path, sizeof(path), "%s.gph", f->name);
+	if ((cached = manifest_find(&manifest, f->name)) &&
+	    isfresh(cached, &st) && access(path, F_OK) == 0) {
+		*f = *cached;
+		f->name = name;
+	} else {
+		if (!(fp = fopen(files[i], "r")))
+			err(1, "fopen: %s", files[i]);
+		if (!(fpitems = fopen(path, "wb")))
+			err(1, "fopen");
+		printfeed(fpitems, fp, f);
+		if (ferror(fp))
+			err(1, "ferror: %s", files[i]);
+		fclose(fp);
+		if (fflush(fpitems) || ferror(fpitems))
+			err(1, "write: %s", path);
+		fclose(fpitems);
+	}
+	f->mtime = (long long)st.st_mtim.tv_sec * 1000000000LL +
+	           st.st_mtim.tv_nsec;
+	f->size = st.st_size;
+
+	/* append directory item to index */
+	fprintf(fpindex, "[1|");
+	gphlink(fpindex, f->name, strlen(f->name));
+	fprintf(fpindex, " (%lu/%lu)|%s",
+	        f->totalnew, f->total, prefixpath);
+	gphlink(fpindex, path, strlen(path));
+	fputs("|server|port]\n", fpindex);
+}
+
+static unsigned long long
+number(const char *s)
+{
+	unsigned long long n;
+	char *e;
+
+	errno = 0;
+	n = strtoull(s, &e, 10);
+	if (errno || !*s || *e || *s == '-')
+		errx(1, "invalid number: %s", s);
+
+	return n;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: %s [-j jobs] [-n maxitems] [-r readfile] "
+	        "[-t seconds] [file...]\n", argv0);
+	exit(1);
+}
+
 int
 main(int argc, char *argv[])
 {
-	FILE *fpitems, *fpindex, *fp;
-	char *name, path[PATH_MAX + 1];
-	int i;
-	struct feed *f;
+	struct stat st;
+	FILE *fpindex;
+	char *name;
+	int ch, i;
 
-	if (pledge("stdio rpath wpath cpath", NULL) == -1)
+	if (pledge("stdio rpath wpath cpath proc", NULL) == -1)
 		err(1, "pledge");
 
+	argv0 = argv[0];
+	while ((ch = getopt(argc, argv, "j:n:r:t:")) != -1) {
+		switch (ch) {
+		case 'j':
+			if (!(jobs = number(optarg)))
+				usage();
+			break;
+		case 'n':
+			maxitems = number(optarg);
+			break;
+		case 'r':
+			/* a missing file is an empty set: all items are new */
+			if (keyset_open(&readset, optarg) == -1 &&
+			    stat(optarg, &st) == 0)
+				errx(1, "invalid read file: %s", optarg);
+			useread = 1;
+			break;
+		case 't':
+			maxage = number(optarg);
+			cutoff = (time_t)((long long)time(NULL) -
+			         (long long)maxage);
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
 	if (!(prefixpath = getenv("SFEED_GPH_PATH")))
 		prefixpath = "/";
 
-	if (!(feeds = calloc(argc, sizeof(struct feed *))))
+	if (!(feeds = calloc(argc ? argc : 1, sizeof(struct feed *))))
 		err(1, "calloc");
 
 	if ((comparetime = time(NULL)) == -1)
@@ -114,7 +247,7 @@ main(int argc, char *argv[])
 	/* 1 day is old news */
 	comparetime -= 86400;
 
-	if (argc == 1) {
+	if (argc == 0) {
 		if (pledge("stdio", NULL) == -1)
 			err(1, "pledge");
 		if (!(feeds[0] = calloc(1, sizeof(struct feed))))
@@ -122,39 +255,32 @@ main(int argc, char *argv[])
 		feeds[0]->name = "";
 		printfeed(stdout, stdin, feeds[0]);
 	} else {
+		/* feeds with a valid cached .gph file are not read again */
+		snprintf(manifesthdr, sizeof(manifesthdr),
+		         "sfeed_gph\t%llu\t%llu\t%llu", maxitems, maxage,
+		         useread ? (unsigned long long)readset.gen + 1 : 0);
+		if (manifest_open(&manifest, ".sfeed_gph.manifest", manifesthdr) == -1)
+			err(1, "manifest_open: .sfeed_gph.manifest");
+
 		/* write main index page */
 		if (!(fpindex = fopen("index.gph", "wb")))
 			err(1, "fopen: index.gph");
 
-		for (i = 1; i < argc; i++) {
-			if (!(feeds[i - 1] = calloc(1, sizeof(struct feed))))
+		for (i = 0; i < argc; i++) {
+			if (!(feeds[i] = calloc(1, sizeof(struct feed))))
 				err(1, "calloc");
-			f = feeds[i - 1];
 			name = ((name = strrchr(argv[i], '/'))) ? name + 1 : argv[i];
-			f->name = name;
-
-			if (!(fp = fopen(argv[i], "r")))
-				err(1, "fopen: %s", argv[i]);
-
-			snprintf(path, sizeof(path), "%s.gph", f->name);
-			if (!(fpitems = fopen(path, "wb")))
-				err(1, "fopen");
-			printfeed(fpitems, fp, f);
-			if (ferror(fp))
-				err(1, "ferror: %s", argv[i]);
-			fclose(fp);
-			fclose(fpitems);
-
-			/* append directory item to index */
-			fprintf(fpindex, "[1|");
-			gphlink(fpindex, f->name, strlen(f->name));
-			fprintf(fpindex, " (%lu/%lu)|%s",
-			        f->totalnew, f->total, prefixpath);
-			snprintf(path, sizeof(path), "%s.gph", f->name);
-			gphlink(fpindex, path, strlen(path));
-			fputs("|server|port]\n", fpindex);
+			feeds[i]->name = name;
 		}
+		files = argv;
+		if (formatjobs(fpindex, argc, jobs, formatfile, feeds) == -1)
+			return 1;
 		fclose(fpindex);
+
+		if (manifest_write(".sfeed_gph.manifest", manifesthdr, feeds,
+		    argc) == -1)
+			err(1, "manifest_write: .sfeed_gph.manifest");
+		manifest_close(&manifest);
 	}
 
 	return 0;
@@ -1,157 +1,200 @@
+#include <sys/stat.h>
 #include <sys/types.h>
 
 #include <err.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "util.h"
+#include "format.h"
 
+static char *argv0;
 static struct feed **feeds;
-static int showsidebar;
-static char *line;
-static size_t linesize;
-static unsigned long totalnew;
-static time_t comparetime;
+static struct formatopts opts;
+static struct keyset readset;
+static const struct format *fmt = &format_html;
+static char **files;
+static int jobs = 1;
+static unsigned long long perpage; /* 0: no pages */
 
 static void
-printfeed(FILE *fp, struct feed *f)
+formatfile(FILE *fpout, size_t i)
 {
-	char *fields[FieldLast];
-	struct tm *tm;
-	time_t parsedtime;
-	unsigned int isnew;
-	ssize_t linelen;
-
-	if (f->name[0]) {
-		fputs("<h2 id=\"", stdout);
-		xmlencode(f->name, stdout);
-		fputs("\"><a href=\"#", stdout);
-		xmlencode(f->name, stdout);
-		fputs("\">", stdout);
-		xmlencode(f->name, stdout);
-		fputs("</a></h2>\n", stdout);
-	}
+	FILE *fp;
 
-	while ((linelen = getline(&line, &linesize, fp)) > 0) {
-		if (line[linelen - 1] == '\n')
-			line[--linelen] = '\0';
-		if (!parseline(line, fields))
-			break;
+	if (!(fp = fopen(files[i], "r")))
+		err(1, "fopen: %s", files[i]);
+	formatfeed(fp, feeds[i], &opts, &fmt, &fpout, 1);
+	if (ferror(fp))
+		err(1, "ferror: %s", files[i]);
+	fclose(fp);
+}
 
-		parsedtime = 0;
-		if (strtotime(fields[FieldUnixTimestamp], &parsedtime))
+/* print the items of all feeds merged in time order, newest first */
+static void
+printtimeline(FILE **fps, size_t n)
+{
+	struct timeline tl;
+	struct tlinput *in;
+	struct feed *f;
+	struct item item;
+	unsigned long long total = 0;
+
+	if (timeline_open(&tl, fps, n) == -1)
+		err(1, "timeline_open");
+	/* the limits apply to the timeline: the files are read up to their
+	   first item which is not shown */
+	while ((in = timeline_next(&tl))) {
+		if (opts.cutoff && in->timestamp < opts.cutoff)
+			break;
+		parseline(in->line, item.fields);
+		if (opts.emitted && formatisdup(&opts, &item))
 			continue;
-		if (!(tm = localtime(&parsedtime)))
-			err(1, "localtime");
-
-		isnew = (parsedtime >= comparetime) ? 1 : 0;
-		totalnew += isnew;
-		f->totalnew += isnew;
+		item.timestamp = in->timestamp;
+		item.isnew = formatisnew(&opts, &item);
+		f = feeds[in->feed];
+		f->totalnew += item.isnew;
 		f->total++;
-
-		fprintf(stdout, "%04d-%02d-%02d&nbsp;%02d:%02d ",
-		        tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday,
-		        tm->tm_hour, tm->tm_min);
-		if (isnew)
-			fputs("<b><u>", stdout);
-		if (fields[FieldLink][0]) {
-			fputs("<a href=\"", stdout);
-			xmlencode(fields[FieldLink], stdout);
-			fputs("\">", stdout);
-			xmlencode(fields[FieldTitle], stdout);
-			fputs("</a>", stdout);
-		} else {
-			xmlencode(fields[FieldTitle], stdout);
-		}
-		if (isnew)
-			fputs("</u></b>", stdout);
-		fputs("\n", stdout);
+		item.anchor = (f->total == 1);
+		html_item(stdout, &item, f, f->name[0]);
+		if (opts.maxitems && ++total >= opts.maxitems)
+			break;
 	}
+	timeline_close(&tl);
+}
+
+static unsigned long long
+number(const char *s)
+{
+	unsigned long long n;
+	char *e;
+
+	errno = 0;
+	n = strtoull(s, &e, 10);
+	if (errno || !*s || *e || *s == '-')
+		errx(1, "invalid number: %s", s);
+
+	return n;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: %s [-mu] [-j jobs] [-n maxitems] [-p perpage] "
+	        "[-r readfile] [-t seconds] [file...]\n", argv0);
+	exit(1);
 }
 
 int
 main(int argc, char *argv[])
 {
-	struct feed *f;
+	struct stat st;
 	char *name;
-	FILE *fp;
-	int i;
+	FILE **fps, *fpout = stdout;
+	int ch, i, timeline = 0, unique = 0;
+
+	argv0 = argv[0];
+	while ((ch = getopt(argc, argv, "j:mn:p:r:t:u")) != -1) {
+		switch (ch) {
+		case 'j':
+			if (!(jobs = number(optarg)))
+				usage();
+			break;
+		case 'm':
+			timeline = 1;
+			break;
+		case 'n':
+			opts.maxitems = number(optarg);
+			break;
+		case 'p':
+			if (!(perpage = number(optarg)))
+				usage();
+			break;
+		case 'r':
+			/* a missing file is an empty set: all items are new */
+			if (keyset_open(&readset, optarg) == -1 &&
+			    stat(optarg, &st) == 0)
+				errx(1, "invalid read file: %s", optarg);
+			opts.read = &readset;
+			break;
+		case 't':
+			opts.cutoff = (time_t)((long long)time(NULL) -
+			              (long long)number(optarg));
+			break;
+		case 'u':
+			unique = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
 
-	if (pledge(argc == 1 ? "stdio" : "stdio rpath", NULL) == -1)
+	/* the shown links are kept in this process */
+	if (unique) {
+		formatdedup(&opts, argv, argc);
+		jobs = 1;
+	}
+
+	if (pledge(argc == 0 ? "stdio" : perpage ? "stdio rpath wpath cpath" :
+	    jobs > 1 ? "stdio rpath proc" : "stdio rpath", NULL) == -1)
 		err(1, "pledge");
 
-	if (!(feeds = calloc(argc, sizeof(struct feed *))))
+	if (!(feeds = calloc(argc ? argc : 1, sizeof(struct feed *))) ||
+	    !(fps = calloc(argc ? argc : 1, sizeof(FILE *))))
 		err(1, "calloc");
-	if ((comparetime = time(NULL)) == -1)
+	if ((opts.comparetime = time(NULL)) == -1)
 		err(1, "time");
 	/* 1 day old is old news */
-	comparetime -= 86400;
-
-	fputs("<!DOCTYPE HTML>\n"
-	      "<html>\n"
-	      "\t<head>\n"
-	      "\t<meta name=\"referrer\" content=\"no-referrer\" />\n"
-	      "\t\t<meta http-equiv=\"Content-Type\" content=\"text/html; charset=UTF-8\" />\n"
-	      "\t\t<link rel=\"stylesheet\" type=\"text/css\" href=\"style.css\" />\n"
-	      "\t</head>\n"
-	      "\t<body class=\"noframe\">\n", stdout);
-
-	showsidebar = (argc > 1);
-	if (showsidebar)
-		fputs("\t\t<div id=\"items\">\n", stdout);
-	else
-		fputs("\t\t<div id=\"items\" class=\"nosidebar\">\n", stdout);
-	fputs("<pre>\n", stdout);
-
-	if (argc == 1) {
+	opts.comparetime -= 86400;
+
+	fmt->header(stdout, argc > 0);
+
+	if (argc == 0) {
 		if (!(feeds[0] = calloc(1, sizeof(struct feed))))
 			err(1, "calloc");
 		feeds[0]->name = "";
-		printfeed(stdin, feeds[0]);
+		formatfeed(stdin, feeds[0], &opts, &fmt, &fpout, 1);
 		if (ferror(stdin))
 			err(1, "ferror: <stdin>:");
-	} else {
-		for (i = 1; i < argc; i++) {
-			if (!(feeds[i - 1] = calloc(1, sizeof(struct feed))))
+	} else if (timeline || perpage) {
+		/* all files are open at the same time */
+		for (i = 0; i < argc; i++) {
+			if (!(feeds[i] = calloc(1, sizeof(struct feed))))
 				err(1, "calloc");
 			name = ((name = strrchr(argv[i], '/'))) ? name + 1 : argv[i];
-			feeds[i - 1]->name = name;
-			if (!(fp = fopen(argv[i], "r")))
+			feeds[i]->name = name;
+			if (!(fps[i] = fopen(argv[i], "r")))
 				err(1, "fopen: %s", argv[i]);
-			printfeed(fp, feeds[i - 1]);
-			if (ferror(fp))
+		}
+		if (perpage)
+			formatpages(fps, feeds, argc, &opts, perpage,
+			            &format_htmlpage, "page", ".sfeed_html.pages",
+			            stdout);
+		else
+			printtimeline(fps, argc);
+		for (i = 0; i < argc; i++) {
+			if (ferror(fps[i]))
 				err(1, "ferror: %s", argv[i]);
-			fclose(fp);
+			fclose(fps[i]);
 		}
-	}
-	fputs("</pre>\n</div>\n", stdout); /* div items */
-
-	if (showsidebar) {
-		fputs("\t<div id=\"sidebar\">\n\t\t<ul>\n", stdout);
-
-		for (i = 1; i < argc; i++) {
-			f = feeds[i - 1];
-			if (f->totalnew > 0)
-				fputs("<li class=\"n\"><a href=\"#", stdout);
-			else
-				fputs("<li><a href=\"#", stdout);
-			xmlencode(f->name, stdout);
-			fputs("\">", stdout);
-			if (f->totalnew > 0)
-				fputs("<b><u>", stdout);
-			xmlencode(f->name, stdout);
-			fprintf(stdout, " (%lu)", f->totalnew);
-			if (f->totalnew > 0)
-				fputs("</u></b>", stdout);
-			fputs("</a></li>\n", stdout);
+	} else {
+		for (i = 0; i < argc; i++) {
+			if (!(feeds[i] = calloc(1, sizeof(struct feed))))
+				err(1, "calloc");
+			name = ((name = strrchr(argv[i], '/'))) ? name + 1 : argv[i];
+			feeds[i]->name = name;
 		}
-		fputs("\t\t</ul>\n\t</div>\n", stdout);
+		files = argv;
+		if (formatjobs(stdout, argc, jobs, formatfile, feeds) == -1)
+			return 1;
 	}
-
-	fprintf(stdout, "\t</body>\n\t<title>Newsfeed (%lu)</title>\n</html>\n",
-	        totalnew);
+	fmt->footer(stdout, feeds, argc ? argc : 1, argc > 0);
 
 	return 0;
 }
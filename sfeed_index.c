@@ -0,0 +1,40 @@
+#include <sys/types.h>
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "util.h"
+#include "textidx.h"
+
+static char *argv0;
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: %s storepath\n", argv0);
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int ch;
+
+	if (pledge("stdio rpath wpath cpath flock", NULL) == -1)
+		err(1, "pledge");
+
+	argv0 = argv[0];
+	while ((ch = getopt(argc, argv, "")) != -1)
+		usage();
+	argc -= optind;
+	argv += optind;
+	if (argc != 1)
+		usage();
+
+	if (textidx_update(argv[0]) == -1)
+		err(1, "index: %s", argv[0]);
+
+	return 0;
+}
@@ -0,0 +1,96 @@
+#include <sys/types.h>
+
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "util.h"
+
+static char *argv0;
+static uint64_t *keys;
+static size_t nkeys, keyssize;
+
+/* the keys of the items of a feed file, a line without a TAB is a link */
+static void
+readkeys(FILE *fp)
+{
+	char *line = NULL, *fields[FieldLast];
+	size_t linesize = 0;
+	ssize_t linelen;
+
+	while ((linelen = getline(&line, &linesize, fp)) > 0) {
+		if (line[linelen - 1] == '\n')
+			line[--linelen] = '\0';
+		if (!linelen)
+			continue;
+		if (nkeys + 1 >= keyssize) {
+			keyssize = keyssize ? keyssize * 2 : 1024;
+			if (!(keys = realloc(keys, keyssize * sizeof(*keys))))
+				err(1, "realloc");
+		}
+		if (strchr(line, '\t')) {
+			parseline(line, fields);
+			keys[nkeys++] = keyset_itemkey(fields[FieldLink],
+			                               fields[FieldId]);
+		} else {
+			keys[nkeys++] = keyset_itemkey(line, "");
+		}
+	}
+	free(line);
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: %s [-u] readfile [file...]\n", argv0);
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	FILE *fp;
+	int ch, i, unread = 0;
+
+	if (pledge("stdio rpath wpath cpath flock", NULL) == -1)
+		err(1, "pledge");
+
+	argv0 = argv[0];
+	while ((ch = getopt(argc, argv, "u")) != -1) {
+		switch (ch) {
+		case 'u':
+			unread = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc < 1)
+		usage();
+
+	if (argc == 1) {
+		readkeys(stdin);
+		if (ferror(stdin))
+			err(1, "ferror: <stdin>");
+	}
+	for (i = 1; i < argc; i++) {
+		if (!(fp = fopen(argv[i], "r")))
+			err(1, "fopen: %s", argv[i]);
+		readkeys(fp);
+		if (ferror(fp))
+			err(1, "ferror: %s", argv[i]);
+		fclose(fp);
+	}
+
+	if ((unread ? keyset_update(argv[0], NULL, 0, keys, nkeys) :
+	    keyset_update(argv[0], keys, nkeys, NULL, 0)) == -1)
+		err(1, "update: %s", argv[0]);
+	free(keys);
+
+	return 0;
+}
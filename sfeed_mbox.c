@@ -1,4 +1,9 @@
+#include <sys/stat.h>
+#include <sys/types.h>
+
 #include <err.h>
+#include <errno.h>
+#include <limits.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -7,106 +12,212 @@
 #include <unistd.h>
 
 #include "util.h"
+#include "format.h"
+
+static char *argv0;
+static struct formatopts opts;
+static const struct format *fmt = &format_mbox;
+static char **files;
+static int jobs = 1;
 
-static char *line;
-static size_t linesize;
-static char host[256], *user, mtimebuf[32];
+/* incremental: the hashes of the items written in previous runs */
+static char *seenpath;
+static struct hashfile seen;
+static uint64_t *added;
+static size_t nadded, addedsize;
 
-static unsigned long
-djb2(unsigned char *s, unsigned long hash)
+static char *maildir;
+static char host[256];
+static time_t now;
+
+/* write the mail to a new file in the Maildir: it is written to tmp and moved
+   to new when it is complete */
+static void
+deliver(const struct item *item, const struct feed *f)
 {
-	int c;
+	FILE *fp;
+	char name[512], tmppath[PATH_MAX], newpath[PATH_MAX];
+
+	/* the hash is unique for the feed name and item */
+	snprintf(name, sizeof(name), "%lld.%016llx.%s", (long long)now,
+	         (unsigned long long)item->hash, host);
+	snprintf(tmppath, sizeof(tmppath), "%s/tmp/%s", maildir, name);
+	snprintf(newpath, sizeof(newpath), "%s/new/%s", maildir, name);
 
-	while ((c = *s++))
-		hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
-	return hash;
+	if (!(fp = fopen(tmppath, "wb")))
+		err(1, "fopen: %s", tmppath);
+	format_mail.item(fp, item, f);
+	if (fflush(fp) || ferror(fp) || fsync(fileno(fp)) == -1)
+		err(1, "write: %s", tmppath);
+	fclose(fp);
+	if (rename(tmppath, newpath) == -1)
+		err(1, "rename: %s", newpath);
 }
 
+/* item of the incremental mode: only unseen items are written */
 static void
-printfeed(FILE *fp, const char *feedname)
+unseen_item(FILE *fp, const struct item *item, const struct feed *f)
 {
-	struct tm tm;
-	char *fields[FieldLast], timebuf[32];
-	time_t parsedtime;
-	unsigned long hash;
-	ssize_t linelen;
-
-	while ((linelen = getline(&line, &linesize, fp)) > 0) {
-		if (line[linelen - 1] == '\n')
-			line[--linelen] = '\0';
-		hash = djb2((unsigned char *)line, 5381UL);
-		if (!parseline(line, fields))
-			break;
-		parsedtime = 0;
-		if (strtotime(fields[FieldUnixTimestamp], &parsedtime))
-			continue;
-
-		/* mbox + mail header */
-		printf("From MAILER-DAEMON %s\n", mtimebuf);
-		/* can't convert: default to formatted time for time_t 0. */
-		if (gmtime_r(&parsedtime, &tm) &&
-		    strftime(timebuf, sizeof(timebuf),
-		             "%a, %d %b %Y %H:%M:%S +0000", &tm))
-			printf("Date: %s\n", timebuf);
-		else
-			printf("Date: Thu, 01 Jan 1970 00:00:00 +0000\n");
-
-		printf("From: %s <sfeed@>\n", fields[FieldAuthor][0] ? fields[FieldAuthor] : "unknown");
-		printf("To: %s <%s@%s>\n", user, user, host);
-		if (feedname[0])
-			printf("Subject: [%s] %s\n", feedname, fields[FieldTitle]);
-		else
-			printf("Subject: %s\n", fields[FieldTitle]);
-		printf("Message-ID: <%s%s%lu@%s>\n",
-		       fields[FieldUnixTimestamp],
-		       fields[FieldUnixTimestamp][0] ? "." : "",
-		       hash, feedname);
-		printf("Content-Type: text/plain; charset=\"utf-8\"\n");
-		printf("Content-Transfer-Encoding: binary\n");
-		printf("X-Feedname: %s\n\n", feedname);
-
-		printf("%s\n", fields[FieldLink]);
-		if (fields[FieldEnclosure][0])
-			printf("\nEnclosure:\n%s\n", fields[FieldEnclosure]);
-		fputs("\n", stdout);
+	if (hashfile_find(&seen, item->hash))
+		return;
+	if (nadded + 1 >= addedsize) {
+		addedsize = addedsize ? addedsize * 2 : 1024;
+		if (!(added = realloc(added, addedsize * sizeof(*added))))
+			err(1, "realloc");
 	}
+	added[nadded++] = item->hash;
+
+	if (maildir)
+		deliver(item, f);
+	else
+		format_mbox.item(fp, item, f);
 }
 
-int
-main(int argc, char *argv[])
+static const struct format format_unseen = {
+	"mbox", 1, NULL, NULL, unseen_item, NULL
+};
+
+static void
+formatfile(FILE *fpout, size_t i)
 {
-	struct tm tm;
-	time_t t;
+	struct feed f;
 	FILE *fp;
 	char *name;
-	int i;
-
-	if (pledge(argc == 1 ? "stdio" : "stdio rpath", NULL) == -1)
-		err(1, "pledge");
-
-	if (!(user = getenv("USER")))
-		user = "you";
-	if (gethostname(host, sizeof(host)) == -1)
-		err(1, "gethostname");
-	if ((t = time(NULL)) == -1)
-		err(1, "time");
-	if (!gmtime_r(&t, &tm))
-		errx(1, "gmtime_r: can't get current time");
-	if (!strftime(mtimebuf, sizeof(mtimebuf), "%a %b %d %H:%M:%S %Y", &tm))
-		errx(1, "strftime: can't format current time");
-
-	if (argc == 1) {
-		printfeed(stdin, "");
+
+	if (!(fp = fopen(files[i], "r")))
+		err(1, "fopen: %s", files[i]);
+	memset(&f, 0, sizeof(f));
+	f.name = ((name = strrchr(files[i], '/'))) ? name + 1 : files[i];
+	formatfeed(fp, &f, &opts, &fmt, &fpout, 1);
+	if (ferror(fp))
+		err(1, "ferror: %s", files[i]);
+	fclose(fp);
+}
+
+static void
+mkmaildir(const char *dir)
+{
+	static const char *subdirs[] = { "cur", "new", "tmp" };
+	char path[PATH_MAX];
+	size_t i;
+
+	if (mkdir(dir, 0700) == -1 && errno != EEXIST)
+		err(1, "mkdir: %s", dir);
+	for (i = 0; i < sizeof(subdirs) / sizeof(*subdirs); i++) {
+		snprintf(path, sizeof(path), "%s/%s", dir, subdirs[i]);
+		if (mkdir(path, 0700) == -1 && errno != EEXIST)
+			err(1, "mkdir: %s", path);
+	}
+}
+
+static unsigned long long
+number(const char *s)
+{
+	unsigned long long n;
+	char *e;
+
+	errno = 0;
+	n = strtoull(s, &e, 10);
+	if (errno || !*s || *e || *s == '-')
+		errx(1, "invalid number: %s", s);
+
+	return n;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: %s [-u] [-j jobs] [-d maildir] [-s seenfile] "
+	        "[file...]\n", argv0);
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct feed f;
+	struct stat st;
+	FILE *fpout = stdout;
+	uint64_t hdr[4] = { 0 };
+	int ch, unique = 0;
+
+	argv0 = argv[0];
+	while ((ch = getopt(argc, argv, "d:j:s:u")) != -1) {
+		switch (ch) {
+		case 'd':
+			maildir = optarg;
+			break;
+		case 'j':
+			if (!(jobs = number(optarg)))
+				usage();
+			break;
+		case 's':
+			seenpath = optarg;
+			break;
+		case 'u':
+			unique = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	/* the shown links are kept in this process */
+	if (unique) {
+		formatdedup(&opts, argv, argc);
+		jobs = 1;
+	}
+
+	if (seenpath || maildir) {
+		if (pledge("stdio rpath wpath cpath", NULL) == -1)
+			err(1, "pledge");
 	} else {
-		for (i = 1; i < argc; i++) {
-			if (!(fp = fopen(argv[i], "r")))
-				err(1, "fopen: %s", argv[i]);
-			name = ((name = strrchr(argv[i], '/'))) ? name + 1 : argv[i];
-			printfeed(fp, name);
-			if (ferror(fp))
-				err(1, "ferror: %s", argv[i]);
-			fclose(fp);
+		if (pledge(argc == 0 ? "stdio" : jobs > 1 ? "stdio rpath proc" :
+		    "stdio rpath", NULL) == -1)
+			err(1, "pledge");
+	}
+
+	fmt->header(stdout, argc > 0);
+
+	if (seenpath || maildir) {
+		/* a missing file is an empty set, an invalid file would
+		   write all items again */
+		if (seenpath && hashfile_open(&seen, seenpath) == -1 &&
+		    stat(seenpath, &st) == 0)
+			errx(1, "invalid seen file: %s", seenpath);
+		if (maildir) {
+			mkmaildir(maildir);
+			if (gethostname(host, sizeof(host)) == -1)
+				err(1, "gethostname");
+			if ((now = time(NULL)) == -1)
+				err(1, "time");
 		}
+		/* the new hashes are kept in this process */
+		fmt = &format_unseen;
+		jobs = 1;
+	}
+
+	if (argc == 0) {
+		memset(&f, 0, sizeof(f));
+		f.name = "";
+		formatfeed(stdin, &f, &opts, &fmt, &fpout, 1);
+		if (ferror(stdin))
+			err(1, "ferror: <stdin>");
+	} else {
+		files = argv;
+		if (formatjobs(stdout, argc, jobs, formatfile, NULL) == -1)
+			return 1;
 	}
+
+	/* the items are only seen when they are written */
+	if (fflush(stdout) || ferror(stdout))
+		err(1, "write");
+	if (seenpath && nadded &&
+	    hashfile_write(seenpath, &seen, added, nadded, hdr) == -1)
+		err(1, "hashfile_write: %s", seenpath);
+	hashfile_close(&seen);
+
 	return 0;
 }
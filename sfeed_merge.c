@@ -0,0 +1,618 @@
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <err.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "util.h"
+
+/* new item */
+struct item {
+	char      *line;
+	long long  timestamp;
+	uint64_t   hash;    /* hash of the key fields: id, title, link */
+	int        known;   /* duplicate of an old or earlier new item */
+	int        replace; /* upsert: replaces an old version of the item */
+	int        written; /* written to the output, not evicted */
+};
+
+static struct item *items;
+static size_t nitems, itemssize;
+/* open addressing hash table: index + 1 into items, 0 is empty */
+static size_t *table;
+static size_t tablesize;
+static char *line;
+static size_t linesize;
+static char *argv0;
+
+/* hashes for the index */
+static uint64_t *hashes;
+static size_t nhashes, hashessize;
+/* first line of the old data and written output data */
+static uint64_t oldfirsthash, outsize, outfirsthash;
+static long long oldnewest, outnewest;
+
+/* retention: items older than cutoff, after maxitems or after maxbytes are
+   evicted, 0 is unlimited */
+static long long cutoff;
+static unsigned long long maxitems, maxbytes, outitems, evicted;
+static int retention, evicting;
+static FILE *evictfp; /* opened on the first evicted item */
+static char *evictpath;
+
+/* upsert: the key is the id (or link), a new version of an item replaces the
+   old version. With rebuild the index is rebuilt from the written lines. */
+static int upsert, rebuild;
+
+/* time index of the output: the timestamp and offset per written line */
+static struct feedidxent *ents;
+static size_t nents, entssize;
+static char *idxpath;
+static uint64_t *replaced;
+static size_t nreplaced;
+
+/* get field `n` of a TAB-separated line and its length in `len` */
+static const char *
+getfield(const char *s, int n, size_t *len)
+{
+	for (; n > 0; n--) {
+		if (!(s = strchr(s, '\t'))) {
+			*len = 0;
+			return "";
+		}
+		s++;
+	}
+	*len = strcspn(s, "\t");
+
+	return s;
+}
+
+/* key of a line in upsert mode: the id, the link when the id is empty or else
+   the whole line */
+static const char *
+upsertkey(const char *s, size_t *len)
+{
+	const char *f;
+
+	f = getfield(s, FieldId, len);
+	if (!*len)
+		f = getfield(s, FieldLink, len);
+	if (!*len) {
+		f = s;
+		*len = strlen(s);
+	}
+	return f;
+}
+
+/* hash of the whole line in upsert mode: an unchanged version of an item */
+static uint64_t
+linehash(const char *s)
+{
+	return hashbuf(hashbuf(HASHINIT, "l", 1), s, strlen(s));
+}
+
+/* hash of the unique key of a line: id, title, link. In upsert mode the
+   upsert key, it has a different prefix than the line hash. */
+static uint64_t
+keyhash(const char *s)
+{
+	static const int keyfields[] = { FieldId, FieldTitle, FieldLink };
+	uint64_t h = HASHINIT;
+	const char *f;
+	size_t i, len;
+
+	if (upsert) {
+		f = upsertkey(s, &len);
+		return hashbuf(hashbuf(HASHINIT, "k", 1), f, len);
+	}
+	for (i = 0; i < sizeof(keyfields) / sizeof(*keyfields); i++) {
+		f = getfield(s, keyfields[i], &len);
+		h = hashbuf(h, f, len);
+		h = hashbuf(h, "\t", 1);
+	}
+	return h;
+}
+
+static int
+keyequal(const char *s1, const char *s2)
+{
+	static const int keyfields[] = { FieldId, FieldTitle, FieldLink };
+	const char *f1, *f2;
+	size_t i, len1, len2;
+
+	if (upsert) {
+		f1 = upsertkey(s1, &len1);
+		f2 = upsertkey(s2, &len2);
+		return len1 == len2 && !memcmp(f1, f2, len1);
+	}
+	for (i = 0; i < sizeof(keyfields) / sizeof(*keyfields); i++) {
+		f1 = getfield(s1, keyfields[i], &len1);
+		f2 = getfield(s2, keyfields[i], &len2);
+		if (len1 != len2 || memcmp(f1, f2, len1))
+			return 0;
+	}
+	return 1;
+}
+
+/* find the item with the same key as `s`, returns its table slot */
+static size_t
+lookup(const char *s, uint64_t h)
+{
+	size_t i, j;
+
+	for (i = h & (tablesize - 1); (j = table[i]); i = (i + 1) & (tablesize - 1)) {
+		if (items[j - 1].hash == h && keyequal(items[j - 1].line, s))
+			break;
+	}
+	return i;
+}
+
+/* order by timestamp (descending), then by line (ascending) like:
+ * sort -t '	' -k1rn,1 */
+static int
+linecmp(long long t1, const char *s1, long long t2, const char *s2)
+{
+	if (t1 != t2)
+		return t1 > t2 ? -1 : 1;
+	return strcmp(s1, s2);
+}
+
+static int
+itemcmp(const void *v1, const void *v2)
+{
+	const struct item *i1 = v1, *i2 = v2;
+
+	return linecmp(i1->timestamp, i1->line, i2->timestamp, i2->line);
+}
+
+static void
+readnew(FILE *fp)
+{
+	ssize_t linelen;
+
+	while ((linelen = getline(&line, &linesize, fp)) > 0) {
+		if (line[linelen - 1] == '\n')
+			line[--linelen] = '\0';
+		if (nitems + 1 >= itemssize) {
+			itemssize = itemssize ? itemssize * 2 : 64;
+			if (!(items = realloc(items, itemssize * sizeof(*items))))
+				err(1, "realloc");
+		}
+		/* take ownership of the line buffer */
+		items[nitems].line = line;
+		items[nitems].timestamp = strtoll(line, NULL, 10);
+		items[nitems].hash = keyhash(line);
+		items[nitems].known = 0;
+		items[nitems].replace = 0;
+		items[nitems].written = 0;
+		nitems++;
+		line = NULL;
+		linesize = 0;
+	}
+}
+
+static int
+hashcmp(const void *v1, const void *v2)
+{
+	uint64_t h1 = *(const uint64_t *)v1, h2 = *(const uint64_t *)v2;
+
+	return h1 < h2 ? -1 : h1 > h2;
+}
+
+/* upsert: an old line is the old version of a replaced item */
+static int
+isreplaced(const char *s)
+{
+	uint64_t h;
+
+	if (!nreplaced)
+		return 0;
+	h = keyhash(s);
+	return bsearch(&h, replaced, nreplaced, sizeof(*replaced), hashcmp) != NULL;
+}
+
+static void
+addhash(uint64_t h)
+{
+	if (nhashes + 1 >= hashessize) {
+		hashessize = hashessize ? hashessize * 2 : 1024;
+		if (!(hashes = realloc(hashes, hashessize * sizeof(*hashes))))
+			err(1, "realloc");
+	}
+	hashes[nhashes++] = h;
+}
+
+/* write a line and keep track of the written data for the index. The output
+   is ordered newest first: after the first evicted line all lines are
+   evicted. A new line which is evicted was never in the feed file: it is
+   dropped. returns 1 if the line is written. */
+static int
+writeline(const char *s, int isnew)
+{
+	size_t len = strlen(s);
+
+	if (retention && !evicting &&
+	    ((maxitems && outitems >= maxitems) ||
+	    (maxbytes && outsize + len + 1 > maxbytes) ||
+	    (cutoff && strtoll(s, NULL, 10) < cutoff)))
+		evicting = 1;
+	if (evicting) {
+		if (isnew)
+			return 0;
+		evicted++;
+		if (evictpath) {
+			if (!evictfp && !(evictfp = fopen(evictpath, "a")))
+				err(1, "fopen: %s", evictpath);
+			fwrite(s, 1, len, evictfp);
+			putc('\n', evictfp);
+		}
+		return 0;
+	}
+
+	if (!outsize) {
+		outfirsthash = hashbuf(HASHINIT, s, len);
+		outnewest = strtoll(s, NULL, 10);
+	}
+	if (idxpath) {
+		if (nents + 1 >= entssize) {
+			entssize = entssize ? entssize * 2 : 1024;
+			if (!(ents = realloc(ents, entssize * sizeof(*ents))))
+				err(1, "realloc");
+		}
+		ents[nents].timestamp = strtoll(s, NULL, 10);
+		ents[nents].offset = outsize;
+		nents++;
+	}
+	/* the index is rebuilt from the output */
+	if (rebuild) {
+		addhash(keyhash(s));
+		if (upsert)
+			addhash(linehash(s));
+	}
+	fwrite(s, 1, len, stdout);
+	putchar('\n');
+	outsize += len + 1;
+	outitems++;
+
+	return 1;
+}
+
+static void
+copyrest(FILE *fp)
+{
+	char buf[BUFSIZ];
+	ssize_t linelen;
+	size_t n;
+	int last = '\n';
+
+	/* with retention, replaced items, a rebuilt index or a time index the
+	   lines are checked, the evicted lines are only read when they are
+	   written to the evict file. */
+	if (retention || rebuild || nreplaced || idxpath) {
+		while ((!evicting || evictpath) &&
+		       (linelen = getline(&line, &linesize, fp)) > 0) {
+			if (line[linelen - 1] == '\n')
+				line[--linelen] = '\0';
+			if (!isreplaced(line))
+				writeline(line, 0);
+		}
+		return;
+	}
+
+	while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+		fwrite(buf, 1, n, stdout);
+		outsize += n;
+		last = buf[n - 1];
+	}
+	if (last != '\n') {
+		putchar('\n');
+		outsize++;
+	}
+}
+
+/* read the first line (newest item) of the old file: the index is only valid
+   for a file with the same size and first line. */
+static void
+readfirstline(FILE *fp, const char *path)
+{
+	ssize_t linelen;
+
+	if ((linelen = getline(&line, &linesize, fp)) > 0) {
+		if (line[linelen - 1] == '\n')
+			line[--linelen] = '\0';
+		oldfirsthash = hashbuf(HASHINIT, line, linelen);
+		oldnewest = strtoll(line, NULL, 10);
+	} else {
+		oldfirsthash = hashbuf(HASHINIT, "", 0);
+	}
+	if (ferror(fp))
+		err(1, "ferror: %s", path);
+	if (fseek(fp, 0, SEEK_SET) == -1)
+		err(1, "fseek: %s", path);
+}
+
+static unsigned long long
+number(const char *s)
+{
+	unsigned long long n;
+	char *e;
+
+	errno = 0;
+	n = strtoull(s, &e, 10);
+	if (errno || !*s || *e || *s == '-')
+		errx(1, "invalid number: %s", s);
+
+	return n;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: %s [-u] [-a maxage] [-c countfile] [-e evictfile] "
+	        "[-i indexfile] [-n maxitems] [-o addedfile] [-s maxbytes] "
+	        "[-x idxfile] oldfile newfile\n", argv0);
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct hashfile idx;
+	struct stat st;
+	FILE *fpold, *fpnew;
+	ssize_t linelen;
+	uint64_t h, hdr[4];
+	size_t i, n, w, nnew, slot, pending;
+	long long t;
+	char *indexpath = NULL, *addedpath = NULL, *countpath = NULL;
+	FILE *addedfp = NULL, *countfp;
+	int ch, validindex = 0, collect;
+
+	argv0 = argv[0];
+	while ((ch = getopt(argc, argv, "a:c:e:i:n:o:s:ux:")) != -1) {
+		switch (ch) {
+		case 'a':
+			cutoff = (long long)time(NULL) - (long long)number(optarg);
+			retention = 1;
+			break;
+		case 'c':
+			countpath = optarg;
+			break;
+		case 'e':
+			evictpath = optarg;
+			break;
+		case 'i':
+			indexpath = optarg;
+			break;
+		case 'n':
+			maxitems = number(optarg);
+			retention = 1;
+			break;
+		case 'o':
+			addedpath = optarg;
+			break;
+		case 's':
+			maxbytes = number(optarg);
+			retention = 1;
+			break;
+		case 'u':
+			upsert = 1;
+			break;
+		case 'x':
+			idxpath = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc != 2)
+		usage();
+
+	if (pledge(indexpath || evictpath || addedpath || idxpath ||
+	    countpath ? "stdio rpath wpath cpath" : "stdio rpath", NULL) == -1)
+		err(1, "pledge");
+
+	if (!(fpold = fopen(argv[0], "r")))
+		err(1, "fopen: %s", argv[0]);
+	if (!strcmp(argv[1], "-"))
+		fpnew = stdin;
+	else if (!(fpnew = fopen(argv[1], "r")))
+		err(1, "fopen: %s", argv[1]);
+
+	if (!indexpath && !evictpath && !addedpath && !idxpath &&
+	    !countpath && pledge("stdio", NULL) == -1)
+		err(1, "pledge");
+
+	readnew(fpnew);
+	if (ferror(fpnew))
+		err(1, "ferror: %s", argv[1]);
+	if (fpnew != stdin)
+		fclose(fpnew);
+
+	if (indexpath) {
+		if (fstat(fileno(fpold), &st) == -1)
+			err(1, "fstat: %s", argv[0]);
+		readfirstline(fpold, argv[0]);
+		/* the index of the other mode has other hashes */
+		validindex = hashfile_open(&idx, indexpath) != -1 &&
+		             idx.hdr[0] == (uint64_t)st.st_size &&
+		             idx.hdr[1] == oldfirsthash &&
+		             idx.hdr[3] == (uint64_t)upsert;
+		if (!validindex)
+			hashfile_close(&idx);
+	}
+
+	/* unique new items, the first one is kept */
+	for (tablesize = 64; tablesize < nitems * 2; tablesize *= 2)
+		;
+	if (!(table = calloc(tablesize, sizeof(*table))))
+		err(1, "calloc");
+	for (i = 0, pending = 0; i < nitems; i++) {
+		slot = lookup(items[i].line, items[i].hash);
+		if (table[slot]) {
+			items[i].known = 1;
+		} else if (validindex && upsert &&
+		           hashfile_find(&idx, linehash(items[i].line))) {
+			/* the same version is in the old file */
+			items[i].known = 1;
+			table[slot] = i + 1;
+		} else if (validindex && hashfile_find(&idx, items[i].hash)) {
+			/* already in the old file, in upsert mode another
+			   version which is replaced */
+			if (upsert)
+				items[i].replace = 1;
+			else
+				items[i].known = 1;
+			table[slot] = i + 1;
+		} else {
+			table[slot] = i + 1;
+			pending++;
+		}
+	}
+
+	/* first pass: items already in the old file are kept from the old
+	   file, stop early when all new items are known. This is not needed
+	   with a valid index, when the index is missing or stale the hashes
+	   of all old items are collected to rebuild it. In upsert mode an old
+	   item with another version is replaced and the index is rebuilt from
+	   the output. The index has the hashes of the lines in the output
+	   only: with retention it is rebuilt from the output, so an evicted
+	   item which is still in the new data is added again and evicted in
+	   the same pass. */
+	rebuild = indexpath && ((upsert && !validindex) || retention);
+	collect = indexpath && !upsert && !validindex && !rebuild;
+	while (!validindex && (pending || collect) &&
+	       (linelen = getline(&line, &linesize, fpold)) > 0) {
+		if (line[linelen - 1] == '\n')
+			line[--linelen] = '\0';
+		h = keyhash(line);
+		slot = lookup(line, h);
+		if (table[slot] && !items[table[slot] - 1].known) {
+			if (!upsert || !strcmp(items[table[slot] - 1].line, line)) {
+				items[table[slot] - 1].known = 1;
+				items[table[slot] - 1].replace = 0;
+				pending--;
+			} else if (!items[table[slot] - 1].replace) {
+				items[table[slot] - 1].replace = 1;
+				pending--;
+			}
+		}
+		if (collect)
+			addhash(h);
+	}
+	if (ferror(fpold))
+		err(1, "ferror: %s", argv[0]);
+
+	/* remove known items and order the new items */
+	for (i = 0, n = 0; i < nitems; i++) {
+		if (items[i].known)
+			continue;
+		if (items[i].replace) {
+			if (!(replaced = realloc(replaced, (nreplaced + 1) *
+			    sizeof(*replaced))))
+				err(1, "realloc");
+			replaced[nreplaced++] = items[i].hash;
+		}
+		items[n++] = items[i];
+	}
+	qsort(items, n, sizeof(*items), itemcmp);
+	qsort(replaced, nreplaced, sizeof(*replaced), hashcmp);
+	/* the hashes of the replaced versions are removed from the index */
+	if (nreplaced && indexpath)
+		rebuild = 1;
+
+	/* second pass: interleave the new items with the ordered old items,
+	   after the last new item the old data is copied as-is. */
+	if (fseek(fpold, 0, SEEK_SET) == -1)
+		err(1, "fseek: %s", argv[0]);
+	for (i = 0; i < n && (linelen = getline(&line, &linesize, fpold)) > 0; ) {
+		if (line[linelen - 1] == '\n')
+			line[--linelen] = '\0';
+		if (isreplaced(line))
+			continue;
+		t = strtoll(line, NULL, 10);
+		for (; i < n && linecmp(items[i].timestamp, items[i].line, t, line) < 0; i++)
+			items[i].written = writeline(items[i].line, !items[i].replace);
+		writeline(line, 0);
+	}
+	copyrest(fpold);
+	if (ferror(fpold))
+		err(1, "ferror: %s", argv[0]);
+	fclose(fpold);
+
+	for (; i < n; i++)
+		items[i].written = writeline(items[i].line, !items[i].replace);
+
+	/* only the written items are added, the evicted new items are
+	   dropped */
+	for (i = 0, w = 0, nnew = 0; i < n; i++) {
+		if (!items[i].written)
+			continue;
+		if (!items[i].replace)
+			nnew++;
+		items[w++] = items[i];
+	}
+	n = w;
+
+	if (fflush(stdout) || ferror(stdout))
+		err(1, "write");
+	if (evictfp && (fflush(evictfp) || ferror(evictfp)))
+		err(1, "write: %s", evictpath);
+
+	if (idxpath && feedidx_write(idxpath, ents, nents, outsize) == -1)
+		err(1, "write: %s", idxpath);
+
+	/* the added items are appended */
+	if (addedpath && n && !(addedfp = fopen(addedpath, "a")))
+		err(1, "fopen: %s", addedpath);
+	for (i = 0; addedfp && i < n; i++) {
+		fputs(items[i].line, addedfp);
+		putc('\n', addedfp);
+	}
+	if (addedfp && (fflush(addedfp) || ferror(addedfp)))
+		err(1, "write: %s", addedpath);
+
+	/* the amount of new items, the new versions of items are not new */
+	if (countpath) {
+		if (!(countfp = fopen(countpath, "w")))
+			err(1, "fopen: %s", countpath);
+		fprintf(countfp, "%zu\n", nnew);
+		if (fflush(countfp) || ferror(countfp))
+			err(1, "write: %s", countpath);
+		fclose(countfp);
+	}
+
+	/* update the index for the output data: with a valid index and no new
+	   or evicted items it is still valid. Without new items the output is
+	   the same as the old data, except for the evicted items. With
+	   retention the index is rebuilt: the hashes of the evicted items are
+	   removed. */
+	if (indexpath && (!validindex || n || evicted)) {
+		if (!outsize)
+			outfirsthash = hashbuf(HASHINIT, "", 0);
+		hdr[0] = outsize;
+		hdr[1] = n || evicted || rebuild ? outfirsthash : oldfirsthash;
+		hdr[2] = (uint64_t)(n || evicted || rebuild ? outnewest : oldnewest);
+		hdr[3] = upsert;
+		/* add the hashes of the new items, a rebuilt index has the
+		   hashes of all written items */
+		for (i = 0; i < n && !rebuild; i++) {
+			addhash(items[i].hash);
+			if (upsert)
+				addhash(linehash(items[i].line));
+		}
+		if (hashfile_write(indexpath, validindex && !rebuild ? &idx : NULL,
+		                   hashes, nhashes, hdr) == -1)
+			warn("write index: %s", indexpath);
+	}
+
+	return 0;
+}
@@ -1,88 +1,180 @@
+#include <sys/stat.h>
 #include <sys/types.h>
 
 #include <ctype.h>
 #include <err.h>
-#include <locale.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "util.h"
+#include "format.h"
 
-static time_t comparetime;
-static char *line;
-static size_t linesize;
+static char *argv0;
+static struct formatopts opts;
+static struct keyset readset;
+static const struct format *fmt = &format_plain;
+static char **files;
+static int jobs = 1;
 
 static void
-printfeed(FILE *fp, const char *feedname)
+formatfile(FILE *fpout, size_t i)
 {
-	char *fields[FieldLast];
-	struct tm *tm;
-	time_t parsedtime;
-	ssize_t linelen;
-
-	while ((linelen = getline(&line, &linesize, fp)) > 0) {
-		if (line[linelen - 1] == '\n')
-			line[--linelen] = '\0';
-		if (!parseline(line, fields))
-			break;
+	struct feed f;
+	FILE *fp;
+	char *name;
+
+	if (!(fp = fopen(files[i], "r")))
+		err(1, "fopen: %s", files[i]);
+	memset(&f, 0, sizeof(f));
+	f.name = ((name = strrchr(files[i], '/'))) ? name + 1 : files[i];
+	formatfeed(fp, &f, &opts, &fmt, &fpout, 1);
+	if (ferror(fp))
+		err(1, "ferror: %s", files[i]);
+	fclose(fp);
+}
 
-		parsedtime = 0;
-		if (strtotime(fields[FieldUnixTimestamp], &parsedtime))
+/* print the items of all files merged in time order, newest first */
+static void
+printtimeline(FILE **fps, struct feed *feeds, size_t nfiles)
+{
+	struct timeline tl;
+	struct tlinput *in;
+	struct item item;
+	unsigned long long n = 0;
+
+	if (timeline_open(&tl, fps, nfiles) == -1)
+		err(1, "timeline_open");
+	/* the limits apply to the timeline: only the current line of each file
+	   is read, so the files are read up to their first item which is not
+	   shown */
+	while ((in = timeline_next(&tl))) {
+		if (opts.cutoff && in->timestamp < opts.cutoff)
+			break;
+		parseline(in->line, item.fields);
+		if (opts.emitted && formatisdup(&opts, &item))
 			continue;
-		if (!(tm = localtime(&parsedtime)))
-			err(1, "localtime");
-
-		if (parsedtime >= comparetime)
-			fputs("N ", stdout);
-		else
-			fputs("  ", stdout);
-
-		fprintf(stdout, "%04d-%02d-%02d %02d:%02d  ",
-		        tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday,
-		        tm->tm_hour, tm->tm_min);
-		if (feedname[0]) {
-			printutf8pad(stdout, feedname, 15, ' ');
-			fputs("  ", stdout);
-		}
-		printutf8pad(stdout, fields[FieldTitle], 70, ' ');
-		printf(" %s\n", fields[FieldLink]);
+		item.timestamp = in->timestamp;
+		item.isnew = formatisnew(&opts, &item);
+		fmt->item(stdout, &item, &feeds[in->feed]);
+		if (opts.maxitems && ++n >= opts.maxitems)
+			break;
 	}
+	timeline_close(&tl);
+}
+
+static unsigned long long
+number(const char *s)
+{
+	unsigned long long n;
+	char *e;
+
+	errno = 0;
+	n = strtoull(s, &e, 10);
+	if (errno || !*s || *e || *s == '-')
+		errx(1, "invalid number: %s", s);
+
+	return n;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: %s [-mu] [-j jobs] [-n maxitems] [-r readfile] "
+	        "[-t seconds] [file...]\n", argv0);
+	exit(1);
 }
 
 int
 main(int argc, char *argv[])
 {
-	FILE *fp;
+	struct feed f, *feeds;
+	struct stat st;
+	FILE **fps, *fpout = stdout;
 	char *name;
-	int i;
+	int ch, i, timeline = 0, unique = 0;
 
-	if (pledge("stdio rpath", NULL) == -1)
-		err(1, "pledge");
+	argv0 = argv[0];
+	while ((ch = getopt(argc, argv, "j:mn:r:t:u")) != -1) {
+		switch (ch) {
+		case 'j':
+			if (!(jobs = number(optarg)))
+				usage();
+			break;
+		case 'm':
+			timeline = 1;
+			break;
+		case 'n':
+			opts.maxitems = number(optarg);
+			break;
+		case 'r':
+			/* a missing file is an empty set: all items are new */
+			if (keyset_open(&readset, optarg) == -1 &&
+			    stat(optarg, &st) == 0)
+				errx(1, "invalid read file: %s", optarg);
+			opts.read = &readset;
+			break;
+		case 't':
+			opts.cutoff = (time_t)((long long)time(NULL) -
+			              (long long)number(optarg));
+			break;
+		case 'u':
+			unique = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
 
-	setlocale(LC_CTYPE, "");
+	/* the shown links are kept in this process */
+	if (unique) {
+		formatdedup(&opts, argv, argc);
+		jobs = 1;
+	}
 
-	if (pledge(argc == 1 ? "stdio" : "stdio rpath", NULL) == -1)
+	if (pledge(argc == 0 ? "stdio" : jobs > 1 ? "stdio rpath proc" :
+	    "stdio rpath", NULL) == -1)
 		err(1, "pledge");
 
-	if ((comparetime = time(NULL)) == -1)
+	if ((opts.comparetime = time(NULL)) == -1)
 		err(1, "time");
 	/* 1 day is old news */
-	comparetime -= 86400;
+	opts.comparetime -= 86400;
 
-	if (argc == 1) {
-		printfeed(stdin, "");
-	} else {
-		for (i = 1; i < argc; i++) {
-			if (!(fp = fopen(argv[i], "r")))
+	if (argc == 0) {
+		memset(&f, 0, sizeof(f));
+		f.name = "";
+		formatfeed(stdin, &f, &opts, &fmt, &fpout, 1);
+		if (ferror(stdin))
+			err(1, "ferror: <stdin>");
+	} else if (timeline) {
+		/* all files are open at the same time */
+		if (!(fps = calloc(argc, sizeof(*fps))) ||
+		    !(feeds = calloc(argc, sizeof(*feeds))))
+			err(1, "calloc");
+		for (i = 0; i < argc; i++) {
+			if (!(fps[i] = fopen(argv[i], "r")))
 				err(1, "fopen: %s", argv[i]);
 			name = ((name = strrchr(argv[i], '/'))) ? name + 1 : argv[i];
-			printfeed(fp, name);
-			if (ferror(fp))
+			feeds[i].name = name;
+		}
+		printtimeline(fps, feeds, argc);
+		for (i = 0; i < argc; i++) {
+			if (ferror(fps[i]))
 				err(1, "ferror: %s", argv[i]);
-			fclose(fp);
+			fclose(fps[i]);
 		}
+		free(fps);
+		free(feeds);
+	} else {
+		files = argv;
+		if (formatjobs(stdout, argc, jobs, formatfile, NULL) == -1)
+			return 1;
 	}
 	return 0;
 }
@@ -0,0 +1,214 @@
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <err.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "util.h"
+#include "format.h"
+
+/* atom, frames, html, mbox and plain */
+#define MAXFORMATS 5
+
+static char *argv0;
+static struct formatopts opts;
+static struct keyset readset;
+static const struct format *fmts[MAXFORMATS];
+static FILE *fps[MAXFORMATS];
+static char *paths[MAXFORMATS];
+static size_t nfmts;
+
+static FILE *
+openfile(const char *path)
+{
+	FILE *fp;
+
+	if (!strcmp(path, "-"))
+		return stdout;
+	if (!(fp = fopen(path, "wb")))
+		err(1, "fopen: %s", path);
+	return fp;
+}
+
+static void
+closefile(FILE *fp, const char *path)
+{
+	if (fflush(fp) || ferror(fp))
+		err(1, "write: %s", path);
+	if (fp != stdout)
+		fclose(fp);
+}
+
+static void
+addformat(const struct format *fmt, char *path)
+{
+	size_t i;
+
+	/* the last path of a format is used */
+	for (i = 0; i < nfmts && fmts[i] != fmt; i++)
+		;
+	fmts[i] = fmt;
+	paths[i] = path;
+	if (i == nfmts)
+		nfmts++;
+}
+
+static unsigned long long
+number(const char *s)
+{
+	unsigned long long n;
+	char *e;
+
+	errno = 0;
+	n = strtoull(s, &e, 10);
+	if (errno || !*s || *e || *s == '-')
+		errx(1, "invalid number: %s", s);
+
+	return n;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: %s [-a atomfile] [-f framesdir] [-h htmlfile] "
+	        "[-m mboxfile] [-p plainfile] [-n maxitems] [-r readfile] "
+	        "[-t seconds] [-u] [file...]\n", argv0);
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct feed **feeds;
+	struct stat st;
+	FILE *fp, *fpindex = NULL, *fpmenu = NULL;
+	char *framesdir = NULL, *name, pindex[PATH_MAX], pitems[PATH_MAX],
+	     pmenu[PATH_MAX];
+	size_t i, nfeeds;
+	int ch, showsidebar, unique = 0;
+
+	if (pledge("stdio rpath wpath cpath", NULL) == -1)
+		err(1, "pledge");
+
+	argv0 = argv[0];
+	while ((ch = getopt(argc, argv, "a:f:h:m:n:p:r:t:u")) != -1) {
+		switch (ch) {
+		case 'a':
+			addformat(&format_atom, optarg);
+			break;
+		case 'f':
+			framesdir = optarg;
+			addformat(&format_frames, pitems);
+			break;
+		case 'h':
+			addformat(&format_html, optarg);
+			break;
+		case 'm':
+			addformat(&format_mbox, optarg);
+			break;
+		case 'n':
+			opts.maxitems = number(optarg);
+			break;
+		case 'p':
+			addformat(&format_plain, optarg);
+			break;
+		case 'r':
+			/* a missing file is an empty set: all items are new */
+			if (keyset_open(&readset, optarg) == -1 &&
+			    stat(optarg, &st) == 0)
+				errx(1, "invalid read file: %s", optarg);
+			opts.read = &readset;
+			break;
+		case 't':
+			opts.cutoff = (time_t)((long long)time(NULL) -
+			              (long long)number(optarg));
+			break;
+		case 'u':
+			unique = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (!nfmts)
+		usage();
+	if (unique)
+		formatdedup(&opts, argv, argc);
+
+	showsidebar = (argc > 0);
+	nfeeds = argc ? argc : 1;
+	if (!(feeds = calloc(nfeeds, sizeof(struct feed *))))
+		err(1, "calloc");
+	for (i = 0; i < nfeeds; i++) {
+		if (!(feeds[i] = calloc(1, sizeof(struct feed))))
+			err(1, "calloc");
+		if (argc)
+			name = ((name = strrchr(argv[i], '/'))) ? name + 1 : argv[i];
+		else
+			name = "";
+		feeds[i]->name = name;
+	}
+
+	if ((opts.comparetime = time(NULL)) == -1)
+		err(1, "time");
+	/* 1 day is old news */
+	opts.comparetime -= 86400;
+
+	if (framesdir) {
+		snprintf(pindex, sizeof(pindex), "%s/index.html", framesdir);
+		snprintf(pitems, sizeof(pitems), "%s/items.html", framesdir);
+		snprintf(pmenu, sizeof(pmenu), "%s/menu.html", framesdir);
+		fpindex = openfile(pindex);
+		if (showsidebar)
+			fpmenu = openfile(pmenu);
+	}
+	for (i = 0; i < nfmts; i++)
+		fps[i] = openfile(paths[i]);
+
+	if (pledge(argc ? "stdio rpath" : "stdio", NULL) == -1)
+		err(1, "pledge");
+
+	for (i = 0; i < nfmts; i++) {
+		if (fmts[i]->header)
+			fmts[i]->header(fps[i], showsidebar);
+	}
+
+	/* each feed file is read and parsed once for all formats */
+	if (argc == 0) {
+		formatfeed(stdin, feeds[0], &opts, fmts, fps, nfmts);
+		if (ferror(stdin))
+			err(1, "ferror: <stdin>");
+	}
+	for (i = 0; i < (size_t)argc; i++) {
+		if (!(fp = fopen(argv[i], "r")))
+			err(1, "fopen: %s", argv[i]);
+		formatfeed(fp, feeds[i], &opts, fmts, fps, nfmts);
+		if (ferror(fp))
+			err(1, "ferror: %s", argv[i]);
+		fclose(fp);
+	}
+
+	for (i = 0; i < nfmts; i++) {
+		if (fmts[i]->footer)
+			fmts[i]->footer(fps[i], feeds, nfeeds, showsidebar);
+		closefile(fps[i], paths[i]);
+	}
+	if (fpmenu) {
+		frames_menu(fpmenu, feeds, nfeeds);
+		closefile(fpmenu, pmenu);
+	}
+	if (fpindex) {
+		frames_index(fpindex, feeds, nfeeds, showsidebar);
+		closefile(fpindex, pindex);
+	}
+
+	return 0;
+}
@@ -0,0 +1,2396 @@
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <ctype.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef USE_TLS
+#include <arpa/inet.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+#endif
+
+#include "util.h"
+#include "filter.h"
+
+/* hooks of sfeedrc which can be overridden */
+enum {
+	HookFetch = 1, HookConvertEncoding = 2, HookFilter = 4, HookMerge = 8,
+	HookOrder = 16
+};
+
+static const struct {
+	const char *name;
+	int         hook;
+} hooks[] = {
+	{ "convertencoding", HookConvertEncoding },
+	{ "fetch",           HookFetch           },
+	{ "filter",          HookFilter          },
+	{ "merge",           HookMerge           },
+	{ "order",           HookOrder           }
+};
+
+enum { JobPending, JobRunning, JobDone };
+
+/* feed(name, feedurl, [basesiteurl], [encoding]) */
+struct feedjob {
+	char      *name;
+	char      *feedurl;
+	char      *basesiteurl;
+	char      *encoding;
+	char      *maxage;   /* retention of sfeed_merge, empty is unlimited */
+	char      *maxitems;
+	char      *maxbytes;
+	int        upsert;   /* merge by id: edited items replace old versions */
+	size_t     host;     /* index in hosts */
+	long long  expected; /* expected duration in milliseconds */
+	long long  size;     /* size of the last fetched data */
+	long long  took;     /* duration of the stages in this run */
+	int        state;
+};
+
+/* host of the feed urls, to limit the jobs per host */
+struct host {
+	char   name[256];
+	size_t running;
+};
+
+/* per feed cache of the last fetched data: validators of the HTTP response
+   and the hash of the data, and the schedule of the next update */
+struct cache {
+	char      etag[256];
+	char      lastmodified[64];
+	uint64_t  hash;
+	long long hint;      /* update interval hinted by the feed */
+	long long gap;       /* observed time between items */
+	long long interval;  /* current update interval */
+	long long next;      /* UNIX timestamp when the feed is due */
+	long long fetchtime; /* average duration of the fetch in milliseconds */
+	long long parsetime; /* average duration of the other stages */
+	long long size;      /* size of the last fetched data */
+};
+
+/* growing memory buffer */
+struct buf {
+	char   *data;
+	size_t  len;
+	size_t  size;
+};
+
+/* keep-alive connection of the native HTTP client */
+struct http {
+	int    fd;
+#ifdef USE_TLS
+	SSL   *ssl;       /* TLS of an https connection or NULL */
+#endif
+	char   host[256]; /* host, port and protocol of the connection */
+	char   port[8];
+	int    tls;
+	time_t deadline;
+	char   buf[16384];
+	size_t off;
+	size_t len;
+};
+
+/* a program of a pipeline */
+struct stage {
+	char      *argv[16];
+	int        quiet;    /* write stderr to /dev/null */
+	pid_t      pid;
+	/* statistics */
+	long long  start;    /* milliseconds */
+	long long  end;      /* end of the output */
+	size_t     inbytes;
+	size_t     outbytes;
+	size_t     lines;
+};
+
+#define MAXSTAGES 3
+/* consecutive workers which exit before they get a feed, then stop */
+#define MAXFAILURES 5
+
+/* worker process: processes feeds sent by the main process one at a time,
+   the connection to the host of the last feed is kept. */
+struct worker {
+	pid_t       pid;
+	int         cmd;  /* write: index of the feed to process */
+	int         res;  /* read: statistics and index of the processed feed */
+	long        job;  /* index of the current feed or -1 when idle */
+	long        host; /* host of the last feed or -1 */
+	struct buf  rbuf; /* data read from res */
+};
+
+/* statistics of the stages of all feeds of the run */
+static const char *statstages[] = {
+	"fetch", "xmlenc", "convertencoding", "sfeed", "filter",
+	"rules", "merge", "order", "move", "archive", "store"
+};
+#define NSTAGES (sizeof(statstages) / sizeof(*statstages))
+
+static struct {
+	long long           ms;
+	unsigned long long  bytes;
+	long                n;      /* number of runs */
+	long long           maxms;  /* slowest run */
+	long                maxjob; /* feed of the slowest run */
+} stages[NSTAGES];
+
+/* load the config in sh(1): write the settings, overridden hooks and feeds
+   as TAB-separated lines. */
+static const char *loadscript =
+	"sfeedpath=\"$HOME/.sfeed/feeds\"\n"
+	"maxjobs=8\n"
+	"maxhostjobs=2\n"
+	"mininterval=900\n"
+	"maxinterval=86400\n"
+	"filterfile=\"\"\n"
+	"archive=\"\"\n"
+	"storepath=\"\"\n"
+	"timeindex=\"\"\n"
+	". \"$1\" || exit 1\n"
+	"feed() {\n"
+	"	printf 'feed\\t%s\\t%s\\t%s\\t%s\\t%s\\t%s\\t%s\\t%s\\n' \"$1\" \"$2\" \"$3\" \"$4\" \\\n"
+	"		\"${maxage}\" \"${maxitems}\" \"${maxbytes}\" \"${upsert}\"\n"
+	"}\n"
+	"printf 'sfeedpath\\t%s\\n' \"${sfeedpath}\"\n"
+	"printf 'maxjobs\\t%s\\n' \"${maxjobs}\"\n"
+	"printf 'maxhostjobs\\t%s\\n' \"${maxhostjobs}\"\n"
+	"printf 'mininterval\\t%s\\n' \"${mininterval}\"\n"
+	"printf 'maxinterval\\t%s\\n' \"${maxinterval}\"\n"
+	"printf 'filterfile\\t%s\\n' \"${filterfile}\"\n"
+	"printf 'archive\\t%s\\n' \"${archive}\"\n"
+	"printf 'storepath\\t%s\\n' \"${storepath}\"\n"
+	"printf 'timeindex\\t%s\\n' \"${timeindex}\"\n"
+	"for f in convertencoding fetch filter merge order; do\n"
+	"	case \"$(type \"$f\" 2>/dev/null)\" in\n"
+	"	*function*) printf 'hook\\t%s\\n' \"$f\";;\n"
+	"	esac\n"
+	"done\n"
+	"feeds\n";
+
+/* run an overridden hook: the config is loaded again in sh(1). */
+static const char *hookscript =
+	"log() {\n"
+	"	printf '[%s] %-50.50s %s\\n' \"$(date +'%H:%M:%S')\" \"$1\" \"$2\" >&2\n"
+	"}\n"
+	". \"$0\"\n"
+	"\"$@\"\n";
+
+static struct feedjob *jobs;
+static size_t njobs, *order; /* order of the feeds, heaviest first */
+static char config[PATH_MAX], sfeedpath[PATH_MAX], *argv0;
+static char filterfile[PATH_MAX], storepath[PATH_MAX];
+static struct filter rules; /* compiled rules of filterfile */
+static struct host *hosts;
+static size_t nhosts;
+static struct worker *workers;
+static struct buf statsbuf; /* statistics of the feed of a worker */
+static long long mininterval = 900, maxinterval = 86400;
+static int maxjobs = 8, maxhostjobs = 2, overridden, nativehttp, archive;
+static int nativehttps;
+static struct http conn = { .fd = -1 }; /* connection of a worker */
+static int timeindex;
+static volatile sig_atomic_t signo;
+
+static void
+sighandler(int sig)
+{
+	if (!signo)
+		signo = sig;
+}
+
+/* log(name, s) */
+static void
+logfeed(const char *name, const char *s)
+{
+	char timebuf[16];
+	struct tm *tm;
+	time_t t;
+
+	t = time(NULL);
+	if (!(tm = localtime(&t)) ||
+	    !strftime(timebuf, sizeof(timebuf), "%H:%M:%S", tm))
+		timebuf[0] = '\0';
+	fprintf(stderr, "[%s] %-50.50s %s\n", timebuf, name, s);
+}
+
+/* mkdir -p */
+static int
+mkdirp(const char *path)
+{
+	char tmp[PATH_MAX], *p;
+
+	if (strlcpy(tmp, path, sizeof(tmp)) >= sizeof(tmp)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	for (p = tmp + (tmp[0] == '/'); *p; p++) {
+		if (*p != '/')
+			continue;
+		*p = '\0';
+		if (mkdir(tmp, 0777) == -1 && errno != EEXIST)
+			return -1;
+		*p = '/';
+	}
+	if (mkdir(tmp, 0777) == -1 && errno != EEXIST)
+		return -1;
+	return 0;
+}
+
+/* format a path of PATH_MAX size, returns -1 on truncation */
+static int
+mkpath(char *buf, const char *fmt, ...)
+{
+	va_list ap;
+	int r;
+
+	va_start(ap, fmt);
+	r = vsnprintf(buf, PATH_MAX, fmt, ap);
+	va_end(ap);
+
+	return (r < 0 || r >= PATH_MAX) ? -1 : 0;
+}
+
+/* monotonic time in milliseconds */
+static long long
+msnow(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* average of the history and the new value */
+static long long
+average(long long old, long long v)
+{
+	return old ? (old + v) / 2 : v;
+}
+
+static void
+bufappend(struct buf *b, const char *s, size_t len)
+{
+	if (b->size - b->len < len) {
+		while (b->size - b->len < len)
+			b->size = b->size ? b->size * 2 : 65536;
+		if (!(b->data = realloc(b->data, b->size)))
+			err(1, "realloc");
+	}
+	memcpy(b->data + b->len, s, len);
+	b->len += len;
+}
+
+/* start a program with stdin and stdout connected to the file descriptors
+   `in` and `out`, if `quiet` is set stderr is written to /dev/null. */
+static pid_t
+spawn(char *argv[], int in, int out, int quiet)
+{
+	pid_t pid;
+	int fd;
+
+	if ((pid = fork()) != 0)
+		return pid;
+
+	signal(SIGPIPE, SIG_DFL);
+	if (dup2(in, 0) == -1 || dup2(out, 1) == -1)
+		_exit(1);
+	if (quiet) {
+		if ((fd = open("/dev/null", O_WRONLY)) == -1 ||
+		    dup2(fd, 2) == -1)
+			_exit(1);
+		close(fd);
+	}
+	execvp(argv[0], argv);
+	_exit(127);
+}
+
+/* pipe(2) with both ends closed on exec: only the dup2()'d descriptors are
+   inherited, else a reader would not see the end of its input. On failure
+   both ends are -1 and the programs using it fail. */
+static void
+xpipe(int fd[2])
+{
+	if (pipe(fd) == -1) {
+		fd[0] = fd[1] = -1;
+		return;
+	}
+	fcntl(fd[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fd[1], F_SETFD, FD_CLOEXEC);
+}
+
+static void
+setstage(struct stage *s, char *argv[], int quiet)
+{
+	size_t i;
+
+	for (i = 0; argv[i] && i < sizeof(s->argv) / sizeof(*s->argv) - 1; i++)
+		s->argv[i] = argv[i];
+	s->argv[i] = NULL;
+	s->quiet = quiet;
+}
+
+/* run a hook function from the config, `args` is NULL-terminated */
+static void
+sethook(struct stage *s, const char *hook, char *args[])
+{
+	size_t i;
+
+	s->argv[0] = "sh";
+	s->argv[1] = "-c";
+	s->argv[2] = (char *)hookscript;
+	s->argv[3] = config;
+	s->argv[4] = (char *)hook;
+	for (i = 0; args[i] && i < 4; i++)
+		s->argv[5 + i] = args[i];
+	s->argv[5 + i] = NULL;
+	s->quiet = 0;
+}
+
+/* count the lines and append the data to `b` or write it to `fd` */
+static int
+output(struct stage *s, struct buf *b, int fd, const char *data, size_t len)
+{
+	const char *p, *e = data + len;
+	ssize_t r;
+
+	for (p = data; (p = memchr(p, '\n', e - p)); p++)
+		s->lines++;
+	s->outbytes += len;
+	if (b) {
+		bufappend(b, data, len);
+		return 0;
+	}
+	for (; len; data += r, len -= r) {
+		if ((r = write(fd, data, len)) == -1) {
+			if (errno == EINTR) {
+				r = 0;
+				continue;
+			}
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* Run the programs `st` like a shell pipeline. The data between the programs
+ * is passed by the main process in memory, so the amount of bytes and lines
+ * and the time of each program is known. The data `in` of `inlen` bytes is
+ * written to the first program (NULL: /dev/null), the output of the last
+ * program is written to the file descriptor `outfd` or if it is -1 appended
+ * to the buffer `out`.
+ * returns the index of the first program which failed or -1 if all programs
+ * exited successfully. */
+static int
+pipeline(struct stage *st, size_t n, const char *in, size_t inlen,
+	int outfd, struct buf *out)
+{
+	struct pollfd pfd[MAXSTAGES * 2];
+	struct buf mid[MAXSTAGES] = { { 0 } };
+	const char *data;
+	char buf[BUFSIZ];
+	size_t i, len, nopen;
+	ssize_t r;
+	int p[2], q[2], fdin[MAXSTAGES], fdout[MAXSTAGES], failed = -1;
+	int writefailed = 0, status;
+
+	for (i = 0; i < n; i++) {
+		if (i == 0 && !in) {
+			p[0] = open("/dev/null", O_RDONLY);
+			p[1] = -1;
+		} else {
+			xpipe(p);
+			if (p[1] != -1)
+				fcntl(p[1], F_SETFL, O_NONBLOCK);
+		}
+		xpipe(q);
+		fdin[i] = p[1];
+		fdout[i] = q[0];
+		st[i].inbytes = st[i].outbytes = st[i].lines = 0;
+		st[i].start = st[i].end = msnow();
+		st[i].pid = spawn(st[i].argv, p[0], q[1], st[i].quiet);
+		if (p[0] != -1)
+			close(p[0]);
+		if (q[1] != -1)
+			close(q[1]);
+	}
+
+	while (1) {
+		for (i = 0, nopen = 0; i < n; i++) {
+			/* input: the data or the output of the previous program */
+			data = i ? mid[i - 1].data : in;
+			len = i ? mid[i - 1].len : inlen;
+			if (fdin[i] != -1 && st[i].inbytes == len &&
+			    (i == 0 || fdout[i - 1] == -1)) {
+				close(fdin[i]);
+				fdin[i] = -1;
+			}
+			pfd[i * 2].fd = st[i].inbytes < len ? fdin[i] : -1;
+			pfd[i * 2].events = POLLOUT;
+			pfd[i * 2 + 1].fd = fdout[i];
+			pfd[i * 2 + 1].events = POLLIN;
+			nopen += (fdin[i] != -1) + (fdout[i] != -1);
+		}
+		if (!nopen)
+			break;
+		if (poll(pfd, n * 2, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		for (i = 0; i < n; i++) {
+			data = i ? mid[i - 1].data : in;
+			len = i ? mid[i - 1].len : inlen;
+			if (pfd[i * 2].fd != -1 && pfd[i * 2].revents) {
+				if ((r = write(fdin[i], data + st[i].inbytes,
+				     len - st[i].inbytes)) > 0) {
+					st[i].inbytes += r;
+				} else if (errno != EAGAIN && errno != EINTR) {
+					/* EPIPE: the program does not read
+					   all data */
+					close(fdin[i]);
+					fdin[i] = -1;
+				}
+			}
+			if (pfd[i * 2 + 1].fd != -1 && pfd[i * 2 + 1].revents) {
+				if ((r = read(fdout[i], buf, sizeof(buf))) > 0) {
+					if (output(&st[i], i + 1 < n ? &mid[i] :
+					    (outfd == -1 ? out : NULL), outfd,
+					    buf, r) == -1)
+						writefailed = 1;
+				} else if (r == 0 || errno != EINTR) {
+					close(fdout[i]);
+					fdout[i] = -1;
+					st[i].end = msnow();
+				}
+			}
+		}
+	}
+	for (i = 0; i < n; i++) {
+		if (fdin[i] != -1)
+			close(fdin[i]);
+		if (fdout[i] != -1)
+			close(fdout[i]);
+		free(mid[i].data);
+	}
+
+	for (i = 0; i < n; i++) {
+		status = -1;
+		while (st[i].pid > 0 && waitpid(st[i].pid, &status, 0) == -1) {
+			if (errno != EINTR) {
+				status = -1;
+				break;
+			}
+		}
+		if (failed == -1 && (status == -1 || !WIFEXITED(status) ||
+		    WEXITSTATUS(status)))
+			failed = i;
+	}
+	if (failed == -1 && writefailed)
+		failed = n - 1;
+
+	return failed;
+}
+
+static void
+readcache(const char *path, struct cache *c)
+{
+	FILE *fp;
+	char *line = NULL, *v;
+	size_t linesize = 0;
+	ssize_t linelen;
+
+	memset(c, 0, sizeof(*c));
+	if (!(fp = fopen(path, "r")))
+		return;
+	while ((linelen = getline(&line, &linesize, fp)) > 0) {
+		if (line[linelen - 1] == '\n')
+			line[--linelen] = '\0';
+		if (!(v = strchr(line, '\t')))
+			continue;
+		*v++ = '\0';
+		if (!strcmp(line, "etag"))
+			strlcpy(c->etag, v, sizeof(c->etag));
+		else if (!strcmp(line, "lastmodified"))
+			strlcpy(c->lastmodified, v, sizeof(c->lastmodified));
+		else if (!strcmp(line, "hash"))
+			c->hash = strtoull(v, NULL, 16);
+		else if (!strcmp(line, "hint"))
+			c->hint = strtoll(v, NULL, 10);
+		else if (!strcmp(line, "gap"))
+			c->gap = strtoll(v, NULL, 10);
+		else if (!strcmp(line, "interval"))
+			c->interval = strtoll(v, NULL, 10);
+		else if (!strcmp(line, "next"))
+			c->next = strtoll(v, NULL, 10);
+		else if (!strcmp(line, "fetchtime"))
+			c->fetchtime = strtoll(v, NULL, 10);
+		else if (!strcmp(line, "parsetime"))
+			c->parsetime = strtoll(v, NULL, 10);
+		else if (!strcmp(line, "size"))
+			c->size = strtoll(v, NULL, 10);
+	}
+	free(line);
+	fclose(fp);
+}
+
+/* the number of the first line of a file, -1 on error */
+static long long
+readcount(const char *path)
+{
+	FILE *fp;
+	char buf[32];
+	long long n = -1;
+
+	if (!(fp = fopen(path, "r")))
+		return -1;
+	if (fgets(buf, sizeof(buf), fp))
+		n = strtoll(buf, NULL, 10);
+	fclose(fp);
+
+	return n;
+}
+
+/* write the cache to a temporary file and rename it, errors are ignored:
+   the cache is only used to skip work. */
+static void
+writecache(const char *path, const struct cache *c)
+{
+	char tmp[PATH_MAX];
+	FILE *fp;
+
+	if (mkpath(tmp, "%s.new", path) == -1 || !(fp = fopen(tmp, "w")))
+		return;
+	if (c->etag[0])
+		fprintf(fp, "etag\t%s\n", c->etag);
+	if (c->lastmodified[0])
+		fprintf(fp, "lastmodified\t%s\n", c->lastmodified);
+	fprintf(fp, "hash\t%016llx\n", (unsigned long long)c->hash);
+	fprintf(fp, "hint\t%lld\n", c->hint);
+	fprintf(fp, "gap\t%lld\n", c->gap);
+	fprintf(fp, "interval\t%lld\n", c->interval);
+	fprintf(fp, "next\t%lld\n", c->next);
+	fprintf(fp, "fetchtime\t%lld\n", c->fetchtime);
+	fprintf(fp, "parsetime\t%lld\n", c->parsetime);
+	fprintf(fp, "size\t%lld\n", c->size);
+	if (fflush(fp) || ferror(fp) || fclose(fp) || rename(tmp, path) == -1)
+		unlink(tmp);
+}
+
+/* estimate the time between items from the timestamps of the newest items,
+   a feed without recent items is updated less often. */
+static long long
+itemsgap(const char *s, size_t len, time_t now)
+{
+	long long newest[10], t;
+	const char *e, *end = s + len;
+	size_t i, n = 0;
+
+	for (; s < end; s = e + 1) {
+		if (!(e = memchr(s, '\n', end - s)))
+			e = end;
+		for (t = 0; s < e && *s >= '0' && *s <= '9'; s++)
+			t = t * 10 + (*s - '0');
+		if (t <= 0)
+			continue;
+		/* keep the newest timestamps, ordered newest first */
+		if (n < 10)
+			n++;
+		else if (t <= newest[9])
+			continue;
+		for (i = n - 1; i > 0 && newest[i - 1] < t; i--)
+			newest[i] = newest[i - 1];
+		newest[i] = t;
+	}
+	if (n < 2)
+		return 0;
+
+	t = (newest[0] - newest[n - 1]) / (long long)(n - 1);
+	if (now - newest[0] > t)
+		t = now - newest[0];
+
+	return t;
+}
+
+/* Compute the next time the feed is due: about twice per observed time
+ * between items, with backoff when no new items were found. The interval is
+ * at least the hint of the feed and within mininterval and maxinterval, a
+ * jitter of 10% spreads the updates of feeds with the same interval. */
+static void
+schedule(struct cache *c, int changed, time_t now)
+{
+	long long t;
+
+	t = c->gap / 2;
+	if (!changed && c->interval + c->interval / 2 > t)
+		t = c->interval + c->interval / 2;
+	if (t < c->hint)
+		t = c->hint;
+	if (t < mininterval)
+		t = mininterval;
+	if (t > maxinterval)
+		t = maxinterval;
+	c->interval = t;
+
+	if (t >= 10)
+		t += random() % (t / 5 + 1) - t / 10;
+	c->next = now + t;
+}
+
+/* copy a header value without leading and trailing whitespace, control
+   characters are replaced by a space. */
+static void
+copyvalue(char *buf, size_t bufsiz, const char *s, size_t len)
+{
+	size_t i;
+
+	for (; len && (*s == ' ' || *s == '\t'); s++, len--)
+		;
+	for (; len && isspace((unsigned char)s[len - 1]); len--)
+		;
+	for (i = 0; i < len && i + 1 < bufsiz; i++)
+		buf[i] = iscntrl((unsigned char)s[i]) ? ' ' : s[i];
+	buf[i] = '\0';
+}
+
+/* Parse the response headers in the data written by curl -i, the validators
+ * are stored in `c`. The offset of the body is stored in `off`.
+ * returns the HTTP status code of the last response or -1 on error. */
+static int
+parseheaders(const char *data, size_t len, size_t *off, struct cache *c)
+{
+	const char *s, *e;
+	size_t i = 0, n;
+	int status = -1;
+
+	/* informational responses (1xx) and responses of a proxy precede the
+	   final response. */
+	while (len - i >= 5 && !memcmp(data + i, "HTTP/", 5)) {
+		c->etag[0] = c->lastmodified[0] = '\0';
+		for (; i < len && data[i] != ' '; i++)
+			;
+		status = (int)strtol(data + i, NULL, 10);
+		for (; i < len && data[i] != '\n'; i++)
+			;
+		if (i++ == len)
+			return -1;
+		/* headers until an empty line */
+		while (i < len) {
+			s = data + i;
+			if (!(e = memchr(s, '\n', len - i)))
+				e = data + len;
+			i = e - data + (e < data + len);
+			if ((n = e - s) && s[n - 1] == '\r')
+				n--;
+			if (!n)
+				break;
+			if (n >= 5 && !strncasecmp(s, "etag:", 5))
+				copyvalue(c->etag, sizeof(c->etag), s + 5, n - 5);
+			else if (n >= 14 && !strncasecmp(s, "last-modified:", 14))
+				copyvalue(c->lastmodified, sizeof(c->lastmodified),
+				          s + 14, n - 14);
+		}
+	}
+	*off = i;
+
+	return status;
+}
+
+/* wait until the socket of the connection is ready for `events`, returns -1
+   on error or timeout. */
+static int
+httpwait(struct http *h, short events)
+{
+	struct pollfd pfd;
+	time_t now;
+	int r;
+
+	while (1) {
+		if ((now = time(NULL)) >= h->deadline)
+			return -1;
+		pfd.fd = h->fd;
+		pfd.events = events;
+		if ((r = poll(&pfd, 1, (int)(h->deadline - now) * 1000)) == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		return r ? 0 : -1;
+	}
+}
+
+#ifdef USE_TLS
+/* wait for the socket when the TLS call with the result `r` would block,
+   returns 0 to retry the call or -1 on error or timeout. */
+static int
+tlswait(struct http *h, int r)
+{
+	switch (SSL_get_error(h->ssl, r)) {
+	case SSL_ERROR_WANT_READ:
+		return httpwait(h, POLLIN);
+	case SSL_ERROR_WANT_WRITE:
+		return httpwait(h, POLLOUT);
+	default:
+		return -1;
+	}
+}
+#endif
+
+/* Read more data in the read buffer of the connection, returns the amount of
+ * bytes read, 0 on EOF or -1 on error or timeout. */
+static ssize_t
+httpfill(struct http *h)
+{
+	ssize_t r;
+
+	/* only called when all data in the buffer is read */
+	h->off = h->len = 0;
+	while (1) {
+#ifdef USE_TLS
+		if (h->ssl) {
+			if ((r = SSL_read(h->ssl, h->buf, sizeof(h->buf))) > 0)
+				break;
+			if (SSL_get_error(h->ssl, r) == SSL_ERROR_ZERO_RETURN)
+				return 0;
+			if (tlswait(h, r) == -1)
+				return -1;
+			continue;
+		}
+#endif
+		if ((r = read(h->fd, h->buf, sizeof(h->buf))) >= 0)
+			break;
+		if (errno == EINTR)
+			continue;
+		if (errno != EAGAIN || httpwait(h, POLLIN) == -1)
+			return -1;
+	}
+	h->len = r;
+
+	return r;
+}
+
+/* read a line without "\r\n" in `s`, a longer line is truncated. The line is
+   also appended to `out` like the output of curl -i. */
+static int
+httpline(struct http *h, char *s, size_t size, struct buf *out)
+{
+	size_t n = 0;
+	char c;
+
+	while (1) {
+		if (h->off == h->len && httpfill(h) <= 0)
+			return -1;
+		c = h->buf[h->off++];
+		if (c == '\n')
+			break;
+		if (n + 1 < size)
+			s[n++] = c;
+	}
+	if (n && s[n - 1] == '\r')
+		n--;
+	s[n] = '\0';
+	if (out) {
+		bufappend(out, s, n);
+		bufappend(out, "\r\n", 2);
+	}
+	return 0;
+}
+
+/* read `n` bytes or until EOF if `n` is -1, the data is appended to `out` */
+static int
+httpbody(struct http *h, struct buf *out, long long n)
+{
+	size_t len;
+	ssize_t r;
+
+	while (n) {
+		if (h->off == h->len) {
+			if ((r = httpfill(h)) == 0 && n == -1)
+				break;
+			if (r <= 0)
+				return -1;
+		}
+		len = h->len - h->off;
+		if (n != -1 && (long long)len > n)
+			len = n;
+		bufappend(out, h->buf + h->off, len);
+		h->off += len;
+		if (n != -1)
+			n -= len;
+	}
+	return 0;
+}
+
+/* connect to the host with a timeout, returns the socket or -1 */
+static int
+httpconnect(const char *host, const char *port, time_t deadline)
+{
+	struct addrinfo hints, *res, *ai;
+	struct pollfd pfd;
+	socklen_t len;
+	time_t now;
+	int fd = -1, e;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(host, port, &hints, &res))
+		return -1;
+
+	for (ai = res; ai; ai = ai->ai_next) {
+		if ((fd = socket(ai->ai_family, ai->ai_socktype,
+		     ai->ai_protocol)) == -1)
+			continue;
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+		fcntl(fd, F_SETFL, O_NONBLOCK);
+		if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+			break;
+		if (errno == EINPROGRESS) {
+			pfd.fd = fd;
+			pfd.events = POLLOUT;
+			e = -1;
+			len = sizeof(e);
+			while ((now = time(NULL)) < deadline &&
+			       poll(&pfd, 1, (int)(deadline - now) * 1000) == -1 &&
+			       errno == EINTR)
+				;
+			if (pfd.revents &&
+			    getsockopt(fd, SOL_SOCKET, SO_ERROR, &e, &len) == 0 &&
+			    e == 0)
+				break;
+		}
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
+
+	return fd;
+}
+
+#ifdef USE_TLS
+/* TLS handshake on the connected socket, the certificate of the host is
+ * verified. Errors are written to stderr. returns 0 or -1 */
+static int
+tlsconnect(struct http *h, const char *host)
+{
+	static SSL_CTX *ctx;
+	struct in6_addr addr;
+	unsigned long e;
+	long v;
+	int r;
+
+	if (!ctx) {
+		if (!(ctx = SSL_CTX_new(TLS_client_method())) ||
+		    !SSL_CTX_set_default_verify_paths(ctx) ||
+		    !SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION)) {
+			SSL_CTX_free(ctx);
+			ctx = NULL;
+			goto fail;
+		}
+		SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+		/* a body without a length ends when the connection is closed */
+		SSL_CTX_set_options(ctx, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+	}
+	if (!(h->ssl = SSL_new(ctx)) || !SSL_set_fd(h->ssl, h->fd))
+		goto fail;
+	if (inet_pton(AF_INET, host, &addr) == 1 ||
+	    inet_pton(AF_INET6, host, &addr) == 1) {
+		if (!X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(h->ssl), host))
+			goto fail;
+	} else if (!SSL_set_tlsext_host_name(h->ssl, host) ||
+	           !SSL_set1_host(h->ssl, host)) {
+		goto fail;
+	}
+	while ((r = SSL_connect(h->ssl)) != 1) {
+		if (tlswait(h, r) == -1)
+			goto fail;
+	}
+	return 0;
+
+fail:
+	if (h->ssl && (v = SSL_get_verify_result(h->ssl)) != X509_V_OK)
+		warnx("%s: TLS: %s", host, X509_verify_cert_error_string(v));
+	else if ((e = ERR_peek_last_error()))
+		warnx("%s: TLS: %s", host, ERR_reason_error_string(e));
+	else
+		warnx("%s: TLS: handshake failed or timed out", host);
+	ERR_clear_error();
+
+	return -1;
+}
+#endif
+
+static void
+httpclose(struct http *h)
+{
+#ifdef USE_TLS
+	SSL_free(h->ssl);
+	h->ssl = NULL;
+#endif
+	if (h->fd != -1)
+		close(h->fd);
+	h->fd = -1;
+}
+
+static int
+httpsend(struct http *h, const char *s, size_t len)
+{
+	ssize_t r;
+
+	while (len) {
+#ifdef USE_TLS
+		if (h->ssl) {
+			/* a TLS write is retried with the same arguments */
+			if ((r = SSL_write(h->ssl, s, len)) <= 0) {
+				if (tlswait(h, r) == -1)
+					return -1;
+				continue;
+			}
+			s += r;
+			len -= r;
+			continue;
+		}
+#endif
+		if ((r = write(h->fd, s, len)) == -1) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN || httpwait(h, POLLOUT) == -1)
+				return -1;
+			continue;
+		}
+		s += r;
+		len -= r;
+	}
+	return 0;
+}
+
+/* Send a request and read the response, the output is like curl -i: the
+ * response headers followed by the decoded body. `reused` is set when no data
+ * was received: the server closed an idle connection. Sets `keepalive` if
+ * the connection can be used for another request.
+ * returns the HTTP status code or -1 on error. */
+static int
+httprequest(struct http *h, const char *req, struct buf *out, int *reused,
+	int *keepalive)
+{
+	char line[8192], *p;
+	long long length;
+	size_t n;
+	int status, chunked, version;
+
+	if (httpsend(h, req, strlen(req)) == -1)
+		return -1;
+	h->off = h->len = 0;
+	if (httpfill(h) <= 0)
+		return -1;
+	*reused = 0;
+
+	do {
+		/* status line, informational (1xx) responses are skipped */
+		if (httpline(h, line, sizeof(line), out) == -1 ||
+		    strncmp(line, "HTTP/1.", 7) || !(p = strchr(line, ' ')))
+			return -1;
+		version = line[7] - '0';
+		status = atoi(p + 1);
+		*keepalive = version >= 1;
+		chunked = 0;
+		length = -1;
+		while (1) {
+			if (httpline(h, line, sizeof(line), out) == -1)
+				return -1;
+			if (!line[0])
+				break;
+			if (!(p = strchr(line, ':')))
+				continue;
+			*p++ = '\0';
+			p += strspn(p, " \t");
+			if (!strcasecmp(line, "content-length"))
+				length = strtoll(p, NULL, 10);
+			else if (!strcasecmp(line, "transfer-encoding"))
+				chunked = (n = strlen(p)) >= 7 &&
+				          !strcasecmp(p + n - 7, "chunked");
+			else if (!strcasecmp(line, "connection"))
+				*keepalive = !strcasecmp(p, "keep-alive") ||
+				             (version >= 1 && strcasecmp(p, "close"));
+		}
+	} while (status >= 100 && status < 200);
+
+	if (status == 204 || status == 304) {
+		/* no body */
+	} else if (chunked) {
+		while (1) {
+			if (httpline(h, line, sizeof(line), NULL) == -1)
+				return -1;
+			if (!(length = strtoll(line, NULL, 16)))
+				break;
+			if (length < 0 || httpbody(h, out, length) == -1 ||
+			    httpline(h, line, sizeof(line), NULL) == -1)
+				return -1;
+		}
+		/* trailer */
+		do {
+			if (httpline(h, line, sizeof(line), NULL) == -1)
+				return -1;
+		} while (line[0]);
+	} else if (length >= 0) {
+		if (httpbody(h, out, length) == -1)
+			return -1;
+	} else {
+		*keepalive = 0;
+		if (httpbody(h, out, -1) == -1)
+			return -1;
+	}
+
+	return status;
+}
+
+/* Fetch a http:// or https:// url like the default fetch with curl, an idle
+ * connection to the same host is reused. returns 0 on success or -1 on
+ * error. */
+static int
+httpfetch(const char *url, const char *ifnonematch, const char *ifmodifiedsince,
+	struct buf *out)
+{
+	struct http *h = &conn;
+	struct uri u;
+	char req[4096], host[256], *port;
+	int status, reused, keepalive, tls, r;
+
+	if (parseuri(url, &u, 0) == -1)
+		return -1;
+	if (!strcmp(u.proto, "http"))
+		tls = 0;
+#ifdef USE_TLS
+	else if (!strcmp(u.proto, "https"))
+		tls = 1;
+#endif
+	else
+		return -1;
+	u.path[strcspn(u.path, "#")] = '\0';
+	port = u.port[0] ? u.port : tls ? "443" : "80";
+	/* IPv6 address without brackets */
+	strlcpy(host, u.host[0] == '[' ? u.host + 1 : u.host, sizeof(host));
+	host[strcspn(host, "]")] = '\0';
+
+	r = snprintf(req, sizeof(req),
+	             "GET %s HTTP/1.1\r\n"
+	             "Host: %s%s%s\r\n"
+	             "Accept: */*\r\n"
+	             "%s%s%s"
+	             "%s%s%s"
+	             "\r\n",
+	             u.path, u.host, u.port[0] ? ":" : "", u.port,
+	             ifnonematch[0] ? "If-None-Match: " : "", ifnonematch,
+	             ifnonematch[0] ? "\r\n" : "",
+	             ifmodifiedsince[0] ? "If-Modified-Since: " : "", ifmodifiedsince,
+	             ifmodifiedsince[0] ? "\r\n" : "");
+	if (r < 0 || (size_t)r >= sizeof(req))
+		return -1;
+
+	/* timeout is 15 seconds */
+	h->deadline = time(NULL) + 15;
+	if (h->fd != -1 && (strcmp(h->host, host) || strcmp(h->port, port) ||
+	    h->tls != tls))
+		httpclose(h);
+	reused = h->fd != -1;
+	while (1) {
+		if (h->fd == -1) {
+			if ((h->fd = httpconnect(host, port, h->deadline)) == -1)
+				return -1;
+#ifdef USE_TLS
+			if (tls && tlsconnect(h, host) == -1) {
+				httpclose(h);
+				return -1;
+			}
+#endif
+			strlcpy(h->host, host, sizeof(h->host));
+			strlcpy(h->port, port, sizeof(h->port));
+			h->tls = tls;
+		}
+		keepalive = 0;
+		out->len = 0;
+		status = httprequest(h, req, out, &reused, &keepalive);
+		if (status == -1 || !keepalive)
+			httpclose(h);
+		/* an idle connection can be closed by the server: retry once
+		   with a new connection. */
+		if (status == -1 && reused) {
+			reused = 0;
+			continue;
+		}
+		break;
+	}
+
+	/* fail on errors and redirects like curl -f --max-redirs 0 */
+	if (status == -1 || (status >= 300 && status != 304))
+		return -1;
+
+	return 0;
+}
+
+/* add a statistics record of a stage of a feed */
+static void
+addstat(const char *name, const char *stage, int ok, long long ms,
+	size_t inbytes, size_t outbytes, size_t lines)
+{
+	char buf[PATH_MAX + 256];
+	int n;
+
+	n = snprintf(buf, sizeof(buf), "stat\t%s\t%s\t%s\t%lld\t%zu\t%zu\t%zu\n",
+	             name, stage, ok ? "OK" : "FAIL", ms, inbytes, outbytes, lines);
+	if (n > 0 && (size_t)n < sizeof(buf))
+		bufappend(&statsbuf, buf, n);
+}
+
+/* add the statistics of the programs of a pipeline, `failed` is the index
+   of the program which failed or -1 */
+static void
+addstats(const char *name, struct stage *st, const char **names, size_t n,
+	int failed)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		addstat(name, names[i], (int)i != failed, st[i].end - st[i].start,
+		        st[i].inbytes, st[i].outbytes, st[i].lines);
+}
+
+/* filter the items with the rules of filterfile in-place, returns the amount
+   of items which are kept */
+static size_t
+applyrules(struct buf *b)
+{
+	static char *line;
+	static size_t linesize;
+	char *fields[FieldLast], *s, *e;
+	size_t len, off = 0, kept = 0;
+
+	for (s = b->data; s && s < b->data + b->len; s = e) {
+		if ((e = memchr(s, '\n', b->data + b->len - s)))
+			e++;
+		else
+			e = b->data + b->len;
+		len = e - s;
+		if (len + 1 > linesize) {
+			linesize = len + 1;
+			if (!(line = realloc(line, linesize)))
+				err(1, "realloc");
+		}
+		memcpy(line, s, len);
+		line[len] = '\0';
+		if (len && line[len - 1] == '\n')
+			line[len - 1] = '\0';
+		parseline(line, fields);
+		if (filter_match(&rules, fields)) {
+			memmove(b->data + off, s, len);
+			off += len;
+			kept++;
+		}
+	}
+	b->len = off;
+
+	return kept;
+}
+
+/* append the evicted items to the archive as a new gzip(1) member: the
+   archive can be read with gzip -dc. On failure the evicted items are kept
+   for the next time. */
+static void
+archivefeed(const char *name, const char *evictfile, const char *archivefile)
+{
+	char *argv[] = { "gzip", "-c", NULL };
+	struct stat sb;
+	long long t;
+	off_t size, oldsize;
+	pid_t pid;
+	int in, out, status = -1;
+
+	if (stat(evictfile, &sb) == -1 || !sb.st_size)
+		return;
+	size = sb.st_size;
+	oldsize = stat(archivefile, &sb) == -1 ? 0 : sb.st_size;
+	t = msnow();
+	if ((in = open(evictfile, O_RDONLY)) == -1)
+		return;
+	if ((out = open(archivefile, O_WRONLY | O_APPEND | O_CREAT, 0666)) == -1) {
+		close(in);
+		return;
+	}
+	fcntl(in, F_SETFD, FD_CLOEXEC);
+	fcntl(out, F_SETFD, FD_CLOEXEC);
+	if ((pid = spawn(argv, in, out, 1)) > 0) {
+		while (waitpid(pid, &status, 0) == -1 && errno == EINTR)
+			;
+	}
+	close(in);
+	if (close(out) == -1)
+		status = -1;
+	if (status != -1 && WIFEXITED(status) && !WEXITSTATUS(status))
+		unlink(evictfile);
+	else
+		status = -1;
+	addstat(name, "archive", status != -1, msnow() - t, size,
+	        stat(archivefile, &sb) == -1 ? 0 : sb.st_size - oldsize, 0);
+}
+
+/* append the added items to the store. On failure the added items are kept
+   for the next time. */
+static void
+storefeed(const char *name, const char *addedfile)
+{
+	struct buf b = { 0 };
+	char buf[BUFSIZ];
+	long long t;
+	ssize_t n;
+	int fd, ok = 0;
+
+	t = msnow();
+	if ((fd = open(addedfile, O_RDONLY)) == -1)
+		return;
+	while ((n = read(fd, buf, sizeof(buf))) != 0) {
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		bufappend(&b, buf, n);
+	}
+	close(fd);
+	/* no added items */
+	if (n == 0 && !b.len) {
+		unlink(addedfile);
+		return;
+	}
+	if (n == 0 && store_append(storepath, name, b.data, b.len) == 0) {
+		unlink(addedfile);
+		ok = 1;
+	}
+	addstat(name, "store", ok, msnow() - t, b.len, ok ? b.len : 0, 0);
+	free(b.data);
+}
+
+/* file name of a feed: the name with '/' replaced by '_' */
+static void
+feedfilename(char *buf, const char *name)
+{
+	char *p;
+
+	strlcpy(buf, name, PATH_MAX);
+	for (p = buf; *p; p++)
+		if (*p == '/')
+			*p = '_';
+}
+
+static void
+readfeedcache(struct feedjob *f, struct cache *c)
+{
+	char filename[PATH_MAX], path[PATH_MAX];
+
+	feedfilename(filename, f->name);
+	if (mkpath(path, "%s/.%s.cache", sfeedpath, filename) == -1)
+		memset(c, 0, sizeof(*c));
+	else
+		readcache(path, c);
+}
+
+/* copy the first line of the buffer to `s` and empty the buffer */
+static void
+firstline(struct buf *b, char *s, size_t size)
+{
+	size_t n;
+
+	for (n = 0; n < b->len && n + 1 < size && b->data[n] != '\n'; n++)
+		s[n] = b->data[n];
+	s[n] = '\0';
+	b->len = 0;
+}
+
+/* process one feed: fetch, convert encoding, parse, filter, merge, order and
+   move, returns 0 on success and -1 on failure. The data is passed between
+   the programs in memory and by pipes: only the merged result is written to
+   a temporary file in the feed directory. */
+static int
+feed(struct feedjob *f)
+{
+	struct stage st[MAXSTAGES];
+	struct buf data = { 0 }, items = { 0 }, out = { 0 };
+	struct cache oldcache, cache;
+	struct stat sb;
+	const char *stagenames[MAXSTAGES], *statnames[MAXSTAGES], *body;
+	char filename[PATH_MAX], sfeedfile[PATH_MAX], newfile[PATH_MAX];
+	char indexfile[PATH_MAX], oldfile[PATH_MAX], cachefile[PATH_MAX];
+	char evictfile[PATH_MAX], archivefile[PATH_MAX], addedfile[PATH_MAX];
+	char idxfile[PATH_MAX], newidxfile[PATH_MAX], countfile[PATH_MAX];
+	char hintfile[PATH_MAX];
+	char ifnonematch[sizeof(cache.etag) + 16];
+	char ifmodifiedsince[sizeof(cache.lastmodified) + 32];
+	char encoding[256];
+	const char *status = "OK";
+	char *args[8];
+	size_t n, bodylen;
+	off_t oldsize;
+	time_t now = time(NULL);
+	long long start = msnow(), fetched = 0, end, t;
+	long long added;
+	int fd, i, j, r = -1;
+
+	feedfilename(filename, f->name);
+
+	/* the result is written in the feed directory: rename is atomic */
+	if (mkpath(sfeedfile, "%s/%s", sfeedpath, filename) == -1 ||
+	    mkpath(newfile, "%s/.%s.new", sfeedpath, filename) == -1 ||
+	    mkpath(indexfile, "%s/.%s.ids", sfeedpath, filename) == -1 ||
+	    mkpath(cachefile, "%s/.%s.cache", sfeedpath, filename) == -1 ||
+	    mkpath(evictfile, "%s/.%s.evicted", sfeedpath, filename) == -1 ||
+	    mkpath(archivefile, "%s/.%s.archive.gz", sfeedpath, filename) == -1 ||
+	    mkpath(addedfile, "%s/.%s.added", sfeedpath, filename) == -1 ||
+	    mkpath(idxfile, "%s/.%s.idx", sfeedpath, filename) == -1 ||
+	    mkpath(newidxfile, "%s/.%s.idx.new", sfeedpath, filename) == -1 ||
+	    mkpath(countfile, "%s/.%s.count", sfeedpath, filename) == -1 ||
+	    mkpath(hintfile, "%s/.%s.hint", sfeedpath, filename) == -1) {
+		logfeed(f->name, "FAIL (PATH)");
+		return -1;
+	}
+
+	/* the cached data is only used when the feed file exists: it is not
+	   recreated when the data did not change. */
+	readcache(cachefile, &oldcache);
+	if (access(sfeedfile, F_OK) == -1) {
+		oldcache.etag[0] = oldcache.lastmodified[0] = '\0';
+		oldcache.hash = 0;
+	}
+	memset(&cache, 0, sizeof(cache));
+	cache.hint = oldcache.hint;
+	cache.gap = oldcache.gap;
+	cache.interval = oldcache.interval;
+	cache.size = oldcache.size;
+
+	/* variables of sfeed_update which are visible to hooks */
+	setenv("name", f->name, 1);
+	setenv("filename", filename, 1);
+	setenv("feedurl", f->feedurl, 1);
+	setenv("basesiteurl", f->basesiteurl, 1);
+	setenv("encoding", f->encoding, 1);
+	setenv("sfeedpath", sfeedpath, 1);
+	setenv("sfeedfile", sfeedfile, 1);
+
+	/* fetch(name, url, feedfile) */
+	if (overridden & HookFetch) {
+		args[0] = f->name;
+		args[1] = f->feedurl;
+		args[2] = sfeedfile;
+		args[3] = NULL;
+		sethook(&st[0], "fetch", args);
+		r = pipeline(st, 1, NULL, 0, -1, &data) == -1 ? 0 : -1;
+	} else if ((nativehttp && !strncmp(f->feedurl, "http://", 7)) ||
+	           (nativehttps && !strncmp(f->feedurl, "https://", 8))) {
+		/* the connection is kept for the next feed of the host */
+		r = httpfetch(f->feedurl, oldcache.etag, oldcache.lastmodified,
+		              &data);
+	} else {
+		/* fail on redirects, hide User-Agent, timeout is 15 seconds.
+		   The response headers are included in the output for the
+		   validators, the request is conditional when they are known. */
+		char *argv[16] = { "curl", "-L", "--max-redirs", "0", "-H",
+			"User-Agent:", "-f", "-s", "-m", "15", "-i" };
+		n = 11;
+		if (oldcache.etag[0]) {
+			snprintf(ifnonematch, sizeof(ifnonematch),
+			         "If-None-Match: %s", oldcache.etag);
+			argv[n++] = "-H";
+			argv[n++] = ifnonematch;
+		}
+		if (oldcache.lastmodified[0]) {
+			snprintf(ifmodifiedsince, sizeof(ifmodifiedsince),
+			         "If-Modified-Since: %s", oldcache.lastmodified);
+			argv[n++] = "-H";
+			argv[n++] = ifmodifiedsince;
+		}
+		argv[n++] = f->feedurl;
+		argv[n] = NULL;
+		setstage(&st[0], argv, 1);
+		r = pipeline(st, 1, NULL, 0, -1, &data) == -1 ? 0 : -1;
+	}
+	fetched = msnow();
+	addstat(f->name, "fetch", r != -1, fetched - start, 0, data.len, 0);
+	if (r == -1) {
+		logfeed(f->name, "FAIL (FETCH)");
+		fetched = 0;
+		goto cleanup;
+	}
+	r = -1;
+
+	body = data.data ? data.data : "";
+	bodylen = data.len;
+	if (!(overridden & HookFetch)) {
+		switch (parseheaders(body, bodylen, &n, &cache)) {
+		case -1:
+			logfeed(f->name, "FAIL (FETCH)");
+			goto cleanup;
+		case 304:
+			if (!cache.etag[0])
+				strlcpy(cache.etag, oldcache.etag, sizeof(cache.etag));
+			if (!cache.lastmodified[0])
+				strlcpy(cache.lastmodified, oldcache.lastmodified,
+				        sizeof(cache.lastmodified));
+			cache.hash = oldcache.hash;
+			status = "OK (NOT MODIFIED)";
+			goto nodata;
+		}
+		body += n;
+		bodylen -= n;
+	}
+
+	/* the same data as the last time: no need for below stages. */
+	cache.hash = hashbuf(HASHINIT, body, bodylen);
+	cache.size = bodylen;
+	if (oldcache.hash && oldcache.hash == cache.hash) {
+		status = "OK (UNCHANGED)";
+		goto nodata;
+	}
+
+	/* try to detect encoding (if not specified). if detecting the
+	   encoding fails assume utf-8. */
+	strlcpy(encoding, f->encoding, sizeof(encoding));
+	if (!encoding[0]) {
+		char *argv[] = { "sfeed_xmlenc", NULL };
+		setstage(&st[0], argv, 0);
+		statnames[0] = "xmlenc";
+		i = pipeline(st, 1, body, bodylen, -1, &out);
+		addstats(f->name, st, statnames, 1, i);
+		if (i == -1)
+			firstline(&out, encoding, sizeof(encoding));
+	}
+
+	/* convertencoding(from, to) | sfeed | filter(name) */
+	n = 0;
+	if (overridden & HookConvertEncoding) {
+		args[0] = encoding;
+		args[1] = "utf-8";
+		args[2] = NULL;
+		sethook(&st[n], "convertencoding", args);
+		statnames[n] = "convertencoding";
+		stagenames[n++] = "FAIL (ENCODING)";
+	} else if (encoding[0] && (strcmp(encoding, "utf-8") ||
+	           !utf8valid(body, bodylen))) {
+		/* like sfeed_update the invalid sequences of UTF-8 data are
+		   dropped, valid UTF-8 data is passed as-is */
+		char *argv[] = { "iconv", "-cs", "-f", encoding, "-t", "utf-8",
+			NULL };
+		setstage(&st[n], argv, 1);
+		statnames[n] = "convertencoding";
+		stagenames[n++] = "FAIL (ENCODING)";
+	}
+	{
+		/* sfeed writes the update interval hinted by the feed */
+		char *argv[] = { "sfeed", "-t", hintfile, f->basesiteurl, NULL };
+		setstage(&st[n], argv, 0);
+		statnames[n] = "sfeed";
+		stagenames[n++] = "FAIL (CONVERT)";
+	}
+	if (overridden & HookFilter) {
+		args[0] = f->name;
+		args[1] = NULL;
+		sethook(&st[n], "filter", args);
+		statnames[n] = "filter";
+		stagenames[n++] = "FAIL (FILTER)";
+	}
+	i = pipeline(st, n, body, bodylen, -1, &items);
+	addstats(f->name, st, statnames, n, i);
+	if ((cache.hint = readcount(hintfile)) < 0)
+		cache.hint = 0;
+	unlink(hintfile);
+	if (i != -1) {
+		logfeed(f->name, stagenames[i]);
+		goto cleanup;
+	}
+	free(data.data);
+	data.data = NULL;
+
+	if (filterfile[0]) {
+		t = msnow();
+		n = items.len;
+		i = applyrules(&items);
+		addstat(f->name, "rules", 1, msnow() - t, n, items.len, i);
+	}
+
+	if ((cache.gap = itemsgap(items.data, items.len, now)) == 0)
+		cache.gap = oldcache.gap;
+
+nodata:
+	/* new feed data is empty: no need for below stages, except for the
+	   retention of the old items by sfeed_merge. */
+	if (!items.len && ((overridden & HookMerge) ||
+	    (!f->maxage[0] && !f->maxitems[0] && !f->maxbytes[0]) ||
+	    access(sfeedfile, F_OK) == -1)) {
+		schedule(&cache, 0, now);
+		logfeed(f->name, status);
+		r = 0;
+		goto cleanup;
+	}
+
+	/* if file does not exist yet "merge" with /dev/null. */
+	if (stat(sfeedfile, &sb) == 0) {
+		strlcpy(oldfile, sfeedfile, sizeof(oldfile));
+		oldsize = sb.st_size;
+	} else {
+		strlcpy(oldfile, "/dev/null", sizeof(oldfile));
+		oldsize = 0;
+	}
+
+	/* merge(name, oldfile, newfile) | order(name): the new items are
+	   read from stdin. */
+	n = 0;
+	if (overridden & HookMerge) {
+		args[0] = f->name;
+		args[1] = oldfile;
+		args[2] = "/dev/stdin";
+		args[3] = NULL;
+		sethook(&st[n], "merge", args);
+	} else {
+		/* the retention of the feed, the evicted items are archived */
+		char *argv[24] = { "sfeed_merge", "-i", indexfile };
+		j = 3;
+		if (f->upsert)
+			argv[j++] = "-u";
+		if (f->maxage[0]) {
+			argv[j++] = "-a";
+			argv[j++] = f->maxage;
+		}
+		if (f->maxitems[0]) {
+			argv[j++] = "-n";
+			argv[j++] = f->maxitems;
+		}
+		if (f->maxbytes[0]) {
+			argv[j++] = "-s";
+			argv[j++] = f->maxbytes;
+		}
+		if (archive) {
+			argv[j++] = "-e";
+			argv[j++] = evictfile;
+		}
+		if (storepath[0]) {
+			argv[j++] = "-o";
+			argv[j++] = addedfile;
+		}
+		/* the offsets are only valid for the output of merge */
+		if (timeindex && !(overridden & HookOrder)) {
+			argv[j++] = "-x";
+			argv[j++] = newidxfile;
+		}
+		/* the new items for the schedule */
+		argv[j++] = "-c";
+		argv[j++] = countfile;
+		argv[j++] = oldfile;
+		argv[j++] = "-";
+		argv[j] = NULL;
+		setstage(&st[n], argv, 1);
+	}
+	statnames[n] = "merge";
+	stagenames[n++] = "FAIL (MERGE)";
+	if (overridden & HookOrder) {
+		args[0] = f->name;
+		args[1] = NULL;
+		sethook(&st[n], "order", args);
+		statnames[n] = "order";
+		stagenames[n++] = "FAIL (ORDER)";
+	} else if (overridden & HookMerge) {
+		/* the default order(): only the data of sfeed_merge is
+		   already ordered */
+		char *argv[] = { "env", "LC_ALL=C", "sort", "-t", "\t",
+			"-k1rn,1", NULL };
+		setstage(&st[n], argv, 0);
+		statnames[n] = "order";
+		stagenames[n++] = "FAIL (ORDER)";
+	}
+	if ((fd = open(newfile, O_WRONLY | O_CREAT | O_TRUNC, 0666)) == -1) {
+		logfeed(f->name, "FAIL (MERGE)");
+		goto cleanup;
+	}
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	i = pipeline(st, n, items.data, items.len, fd, NULL);
+	/* the amount of new items is written by sfeed_merge, an overridden
+	   merge() has new items when the size of the data changed. */
+	if (overridden & HookMerge) {
+		added = fstat(fd, &sb) == -1 || sb.st_size != oldsize;
+	} else {
+		added = readcount(countfile);
+		unlink(countfile);
+	}
+	schedule(&cache, added != 0, now);
+	if (close(fd) == -1 && i == -1)
+		i = 0;
+	addstats(f->name, st, statnames, n, i);
+	if (i != -1) {
+		logfeed(f->name, stagenames[i]);
+		unlink(newfile);
+		goto cleanup;
+	}
+
+	/* atomic move. */
+	t = msnow();
+	i = rename(newfile, sfeedfile);
+	addstat(f->name, "move", i != -1, msnow() - t, 0,
+	        stat(sfeedfile, &sb) == -1 ? 0 : (size_t)sb.st_size, 0);
+	/* the time index is written after the feed file: it is stale when the
+	   feed file is modified after it. */
+	if (i != -1 && access(newidxfile, F_OK) == 0 &&
+	    (rename(newidxfile, idxfile) == -1 ||
+	    utimensat(AT_FDCWD, idxfile, NULL, 0) == -1))
+		unlink(idxfile);
+	if (i == -1) {
+		logfeed(f->name, "FAIL (MOVE)");
+		unlink(newfile);
+		goto cleanup;
+	}
+
+	if (archive)
+		archivefeed(f->name, evictfile, archivefile);
+	if (storepath[0])
+		storefeed(f->name, addedfile);
+
+	logfeed(f->name, status);
+	r = 0;
+
+cleanup:
+	/* on failure the state of the last update is kept: the feed is due
+	   on the next run. The timings are always updated. */
+	if (r == -1)
+		cache = oldcache;
+	end = msnow();
+	if (fetched) {
+		cache.fetchtime = average(oldcache.fetchtime, fetched - start);
+		cache.parsetime = average(oldcache.parsetime, end - fetched);
+	} else {
+		cache.fetchtime = average(oldcache.fetchtime, end - start);
+	}
+	writecache(cachefile, &cache);
+
+	free(data.data);
+	free(items.data);
+	free(out.data);
+
+	return r;
+}
+
+/* evaluate the config and read the settings and feeds */
+static void
+loadconfig(const char *path)
+{
+	struct feedjob *f;
+	FILE *fp;
+	char *line = NULL, *fields[9], *p;
+	size_t linesize = 0, i, jobssize = 0;
+	ssize_t linelen;
+	pid_t pid;
+	int fd[2], status;
+
+	if (!realpath(path, config) || access(config, R_OK) == -1) {
+		fprintf(stderr, "Configuration file \"%s\" does not exist or is not readable.\n", path);
+		fprintf(stderr, "See sfeedrc.example for an example.\n");
+		exit(1);
+	}
+
+	if (pipe(fd) == -1)
+		err(1, "pipe");
+	switch ((pid = fork())) {
+	case -1:
+		err(1, "fork");
+	case 0:
+		close(fd[0]);
+		if (dup2(fd[1], 1) == -1)
+			_exit(1);
+		close(fd[1]);
+		execlp("sh", "sh", "-c", loadscript, "sh", config, (char *)NULL);
+		_exit(127);
+	}
+	close(fd[1]);
+	if (!(fp = fdopen(fd[0], "r")))
+		err(1, "fdopen");
+
+	while ((linelen = getline(&line, &linesize, fp)) > 0) {
+		if (line[linelen - 1] == '\n')
+			line[--linelen] = '\0';
+		for (i = 0, p = line; i < 9; i++) {
+			fields[i] = p;
+			if ((p = strchr(p, '\t')))
+				*p++ = '\0';
+			else
+				p = "";
+		}
+		if (!strcmp(fields[0], "sfeedpath")) {
+			if (strlcpy(sfeedpath, fields[1], sizeof(sfeedpath)) >=
+			    sizeof(sfeedpath))
+				errx(1, "sfeedpath too long");
+		} else if (!strcmp(fields[0], "maxjobs")) {
+			if ((maxjobs = atoi(fields[1])) <= 0)
+				maxjobs = 1;
+		} else if (!strcmp(fields[0], "maxhostjobs")) {
+			if ((maxhostjobs = atoi(fields[1])) <= 0)
+				maxhostjobs = 1;
+		} else if (!strcmp(fields[0], "mininterval")) {
+			if ((mininterval = atoll(fields[1])) < 0)
+				mininterval = 0;
+		} else if (!strcmp(fields[0], "maxinterval")) {
+			if ((maxinterval = atoll(fields[1])) < 0)
+				maxinterval = 0;
+		} else if (!strcmp(fields[0], "filterfile")) {
+			if (strlcpy(filterfile, fields[1], sizeof(filterfile)) >=
+			    sizeof(filterfile))
+				errx(1, "filterfile too long");
+		} else if (!strcmp(fields[0], "storepath")) {
+			if (strlcpy(storepath, fields[1], sizeof(storepath)) >=
+			    sizeof(storepath))
+				errx(1, "storepath too long");
+		} else if (!strcmp(fields[0], "timeindex")) {
+			timeindex = fields[1][0] != '\0';
+		} else if (!strcmp(fields[0], "archive")) {
+			archive = fields[1][0] != '\0';
+		} else if (!strcmp(fields[0], "hook")) {
+			for (i = 0; i < sizeof(hooks) / sizeof(*hooks); i++) {
+				if (!strcmp(fields[1], hooks[i].name))
+					overridden |= hooks[i].hook;
+			}
+		} else if (!strcmp(fields[0], "feed")) {
+			if (njobs + 1 >= jobssize) {
+				jobssize = jobssize ? jobssize * 2 : 64;
+				if (!(jobs = realloc(jobs, jobssize * sizeof(*jobs))))
+					err(1, "realloc");
+			}
+			f = &jobs[njobs++];
+			if (!(f->name = strdup(fields[1])) ||
+			    !(f->feedurl = strdup(fields[2])) ||
+			    !(f->basesiteurl = strdup(fields[3])) ||
+			    !(f->encoding = strdup(fields[4])) ||
+			    !(f->maxage = strdup(fields[5])) ||
+			    !(f->maxitems = strdup(fields[6])) ||
+			    !(f->maxbytes = strdup(fields[7])))
+				err(1, "strdup");
+			f->upsert = fields[8][0] != '\0';
+			f->state = JobPending;
+		}
+	}
+	if (ferror(fp))
+		err(1, "getline");
+	fclose(fp);
+	free(line);
+
+	while (waitpid(pid, &status, 0) == -1) {
+		if (errno != EINTR)
+			err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+		fprintf(stderr, "Configuration file \"%s\" is invalid or does not contain a \"feeds\" function.\n", config);
+		fprintf(stderr, "See sfeedrc.example for an example.\n");
+		exit(1);
+	}
+}
+
+/* group the feeds by the host of their url, also with an overridden fetch()
+   which usually fetches the url too. A feed url without a host is not
+   limited. */
+static void
+sethosts(void)
+{
+	struct uri u;
+	size_t i, j, hostssize = 0;
+
+	for (i = 0; i < njobs; i++) {
+		if (parseuri(jobs[i].feedurl, &u, 0) == -1)
+			u.host[0] = '\0';
+		for (j = 0; u.host[j]; j++)
+			u.host[j] = tolower((unsigned char)u.host[j]);
+		for (j = 0; j < nhosts && strcmp(hosts[j].name, u.host); j++)
+			;
+		if (j == nhosts) {
+			if (nhosts + 1 >= hostssize) {
+				hostssize = hostssize ? hostssize * 2 : 64;
+				if (!(hosts = realloc(hosts, hostssize * sizeof(*hosts))))
+					err(1, "realloc");
+			}
+			strlcpy(hosts[j].name, u.host, sizeof(hosts[j].name));
+			hosts[j].running = 0;
+			nhosts++;
+		}
+		jobs[i].host = j;
+	}
+}
+
+static int
+hostfull(size_t host)
+{
+	return hosts[host].name[0] &&
+	       hosts[host].running >= (size_t)maxhostjobs;
+}
+
+/* the next pending feed of which the host is not at its limit, a feed of the
+   host `prefer` is preferred to reuse its connection. */
+static long
+nextjob(long prefer)
+{
+	size_t i;
+	long first = -1;
+
+	for (i = 0; i < njobs; i++) {
+		if (jobs[order[i]].state != JobPending ||
+		    hostfull(jobs[order[i]].host))
+			continue;
+		if (prefer == -1 || jobs[order[i]].host == (size_t)prefer)
+			return order[i];
+		if (first == -1)
+			first = order[i];
+	}
+	return first;
+}
+
+static int
+jobcmp(const void *v1, const void *v2)
+{
+	const struct feedjob *j1 = &jobs[*(const size_t *)v1];
+	const struct feedjob *j2 = &jobs[*(const size_t *)v2];
+
+	if (j1->expected != j2->expected)
+		return j1->expected > j2->expected ? -1 : 1;
+	if (j1->size != j2->size)
+		return j1->size > j2->size ? -1 : 1;
+	/* stable: keep the order of the config */
+	return j1 < j2 ? -1 : j1 > j2;
+}
+
+/* Longest job first: the heaviest and slowest feeds of the previous runs are
+ * started first, so they do not finish last while the other workers are idle.
+ * Feeds without history are expected to take the average time. */
+static void
+orderjobs(void)
+{
+	long long total = 0;
+	size_t i, n = 0;
+
+	for (i = 0; i < njobs; i++) {
+		if (jobs[i].expected > 0) {
+			total += jobs[i].expected;
+			n++;
+		}
+	}
+	for (i = 0; i < njobs; i++) {
+		if (jobs[i].expected <= 0)
+			jobs[i].expected = n ? total / (long long)n : 0;
+	}
+
+	if (!(order = calloc(njobs ? njobs : 1, sizeof(*order))))
+		err(1, "calloc");
+	for (i = 0; i < njobs; i++)
+		order[i] = i;
+	qsort(order, njobs, sizeof(*order), jobcmp);
+}
+
+/* expected makespan of the pending feeds in the order `ord`: each feed is
+   started on the worker which is idle first. */
+static long long
+makespan(const size_t *ord)
+{
+	long long *load, max = 0;
+	size_t i, j, min;
+
+	if (!(load = calloc(maxjobs, sizeof(*load))))
+		err(1, "calloc");
+	for (i = 0; i < njobs; i++) {
+		if (jobs[ord[i]].state != JobPending)
+			continue;
+		for (j = 1, min = 0; j < (size_t)maxjobs; j++) {
+			if (load[j] < load[min])
+				min = j;
+		}
+		load[min] += jobs[ord[i]].expected;
+	}
+	for (j = 0; j < (size_t)maxjobs; j++) {
+		if (load[j] > max)
+			max = load[j];
+	}
+	free(load);
+
+	return max;
+}
+
+/* process the feeds sent by the main process until the pipe is closed */
+static void
+work(int cmd, int res)
+{
+	char buf[32];
+	FILE *fp;
+	size_t i, off;
+	ssize_t r;
+	int n;
+
+	if (!(fp = fdopen(cmd, "r")))
+		_exit(1);
+	while (fgets(buf, sizeof(buf), fp)) {
+		i = strtoul(buf, NULL, 10);
+		statsbuf.len = 0;
+		feed(&jobs[i]);
+		/* the statistics of the feed, then the index when it is done */
+		n = snprintf(buf, sizeof(buf), "done\t%zu\n", i);
+		bufappend(&statsbuf, buf, n);
+		for (off = 0; off < statsbuf.len; off += r) {
+			if ((r = write(res, statsbuf.data + off,
+			     statsbuf.len - off)) == -1) {
+				if (errno == EINTR) {
+					r = 0;
+					continue;
+				}
+				_exit(1);
+			}
+		}
+	}
+	httpclose(&conn);
+	_exit(0);
+}
+
+/* start a worker in its own process group, so it can be terminated with all
+   its child processes. */
+static void
+startworker(struct worker *w)
+{
+	struct sigaction sa;
+	int cmd[2], res[2];
+	size_t i;
+
+	if (pipe(cmd) == -1 || pipe(res) == -1)
+		err(1, "pipe");
+	switch ((w->pid = fork())) {
+	case -1:
+		err(1, "fork");
+	case 0:
+		setpgid(0, 0);
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = SIG_DFL;
+		sigaction(SIGINT, &sa, NULL);
+		sigaction(SIGTERM, &sa, NULL);
+		/* a program which does not read all its input is not an error:
+		   write(2) fails with EPIPE. */
+		sa.sa_handler = SIG_IGN;
+		sigaction(SIGPIPE, &sa, NULL);
+		/* jitter of the schedule */
+		srandom((unsigned int)time(NULL) ^ (unsigned int)getpid());
+		/* the pipes of other workers: else they do not see EOF */
+		for (i = 0; i < (size_t)maxjobs; i++) {
+			if (&workers[i] != w && workers[i].pid > 0) {
+				close(workers[i].cmd);
+				close(workers[i].res);
+			}
+		}
+		close(cmd[1]);
+		close(res[0]);
+		fcntl(cmd[0], F_SETFD, FD_CLOEXEC);
+		fcntl(res[1], F_SETFD, FD_CLOEXEC);
+		work(cmd[0], res[1]);
+	}
+	/* also set in the parent to avoid a race with killjobs() */
+	setpgid(w->pid, w->pid);
+	close(cmd[0]);
+	close(res[1]);
+	fcntl(cmd[1], F_SETFD, FD_CLOEXEC);
+	fcntl(res[0], F_SETFD, FD_CLOEXEC);
+	w->cmd = cmd[1];
+	w->res = res[0];
+	w->job = -1;
+	w->host = -1;
+}
+
+static void
+stopworker(struct worker *w)
+{
+	int status;
+
+	close(w->cmd);
+	close(w->res);
+	while (waitpid(w->pid, &status, 0) == -1 && errno == EINTR)
+		;
+	w->pid = 0;
+	w->rbuf.len = 0;
+}
+
+/* send a feed to a worker, returns -1 if the worker is gone: it is stopped
+   and the feed stays pending for another worker. */
+static int
+dispatch(struct worker *w, long job)
+{
+	char buf[32];
+	ssize_t r;
+	int n;
+
+	n = snprintf(buf, sizeof(buf), "%ld\n", job);
+	while ((r = write(w->cmd, buf, n)) == -1 && errno == EINTR)
+		;
+	if (r != n) {
+		warnx("worker %ld exited", (long)w->pid);
+		stopworker(w);
+		return -1;
+	}
+	jobs[job].state = JobRunning;
+	hosts[jobs[job].host].running++;
+	w->job = job;
+	w->host = jobs[job].host;
+
+	return 0;
+}
+
+static void
+jobdone(struct worker *w)
+{
+	jobs[w->job].state = JobDone;
+	hosts[jobs[w->job].host].running--;
+	w->job = -1;
+}
+
+/* the complete lines read from a worker: a statistics record of a stage
+   is written to `fp` and added to the totals, "done" when the feed is
+   processed. */
+static void
+results(struct worker *w, FILE *fp)
+{
+	char *line, *nl, *fields[7];
+	size_t i, off;
+	long long ms;
+
+	for (off = 0; off < w->rbuf.len &&
+	     (nl = memchr(w->rbuf.data + off, '\n', w->rbuf.len - off));
+	     off = nl - w->rbuf.data + 1) {
+		*nl = '\0';
+		line = w->rbuf.data + off;
+		if (!strncmp(line, "done\t", 5)) {
+			if (w->job != -1)
+				jobdone(w);
+			continue;
+		}
+		if (strncmp(line, "stat\t", 5) || w->job == -1)
+			continue;
+		line += 5;
+		if (fp)
+			fprintf(fp, "%s\n", line);
+
+		/* fields: name, stage, status, ms, inbytes, outbytes, lines */
+		fields[0] = line;
+		for (i = 1; i < 7; i++) {
+			if (!(fields[i] = strchr(fields[i - 1], '\t')))
+				break;
+			*fields[i]++ = '\0';
+		}
+		if (i < 7)
+			continue;
+		ms = strtoll(fields[3], NULL, 10);
+		jobs[w->job].took += ms;
+		for (i = 0; i < NSTAGES; i++) {
+			if (strcmp(statstages[i], fields[1]))
+				continue;
+			stages[i].ms += ms;
+			stages[i].bytes += strtoull(fields[5], NULL, 10);
+			if (!stages[i].n++ || ms > stages[i].maxms) {
+				stages[i].maxms = ms;
+				stages[i].maxjob = w->job;
+			}
+			break;
+		}
+	}
+	if (off) {
+		memmove(w->rbuf.data, w->rbuf.data + off, w->rbuf.len - off);
+		w->rbuf.len -= off;
+	}
+}
+
+/* order by the duration of the stages in this run (descending) */
+static int
+tookcmp(const void *v1, const void *v2)
+{
+	const struct feedjob *j1 = &jobs[*(const size_t *)v1];
+	const struct feedjob *j2 = &jobs[*(const size_t *)v2];
+
+	if (j1->took != j2->took)
+		return j1->took > j2->took ? -1 : 1;
+	return j1 < j2 ? -1 : j1 > j2;
+}
+
+/* print the slowest feeds and the totals of the stages */
+static void
+printstats(void)
+{
+	size_t *ord, i, n;
+
+	if (!(ord = calloc(njobs ? njobs : 1, sizeof(*ord))))
+		err(1, "calloc");
+	for (i = 0, n = 0; i < njobs; i++) {
+		if (jobs[i].took)
+			ord[n++] = i;
+	}
+	qsort(ord, n, sizeof(*ord), tookcmp);
+	if (n)
+		fprintf(stderr, "slowest feeds:\n");
+	for (i = 0; i < n && i < 10; i++)
+		fprintf(stderr, "%8.2fs %s\n", jobs[ord[i]].took / 1000.0,
+		        jobs[ord[i]].name);
+	free(ord);
+
+	for (i = 0; i < NSTAGES; i++) {
+		if (!stages[i].n)
+			continue;
+		fprintf(stderr, "%-15s %5ld runs %8.2fs %10llu bytes, "
+		        "slowest: %.2fs %s\n", statstages[i], stages[i].n,
+		        stages[i].ms / 1000.0, stages[i].bytes,
+		        stages[i].maxms / 1000.0, jobs[stages[i].maxjob].name);
+	}
+}
+
+static void
+killjobs(void)
+{
+	size_t i;
+
+	for (i = 0; i < (size_t)maxjobs; i++) {
+		if (workers[i].pid > 0)
+			kill(-workers[i].pid, SIGTERM);
+	}
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: %s [-as] [sfeedrc]\n", argv0);
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct sigaction sa;
+	struct worker *w;
+	struct pollfd *pfd;
+	const char *home;
+	char buf[BUFSIZ], statsfile[PATH_MAX], statsnew[PATH_MAX];
+	FILE *statsfp;
+	size_t i, pending, ndue;
+	ssize_t r;
+	time_t now;
+	long job;
+	struct cache c;
+	long long started, expected = 0, configorder = 0;
+	size_t *ord;
+	int running, killed = 0, all = 0, stats = 0, ch;
+	int failures = 0, aborted = 0;
+
+	if (pledge("stdio rpath wpath cpath proc exec", NULL) == -1)
+		err(1, "pledge");
+
+	argv0 = argv[0];
+	while ((ch = getopt(argc, argv, "as")) != -1) {
+		switch (ch) {
+		case 'a':
+			all = 1;
+			break;
+		case 's':
+			stats = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc > 1)
+		usage();
+
+	if (argc == 1) {
+		loadconfig(argv[0]);
+	} else {
+		if (!(home = getenv("HOME")))
+			errx(1, "HOME not set");
+		if (mkpath(config, "%s/.sfeed/sfeedrc", home) == -1)
+			errx(1, "path too long");
+		loadconfig(config);
+	}
+	/* the rules are compiled once for all feeds */
+	if (filterfile[0] && filter_load(&rules, filterfile) == -1)
+		exit(1);
+	if (!njobs) {
+		fprintf(stderr, "Configuration file \"%s\" is invalid or does not contain a \"feeds\" function.\n", config);
+		fprintf(stderr, "See sfeedrc.example for an example.\n");
+	}
+
+	/* make sure path exists. */
+	if (mkdirp(sfeedpath) == -1)
+		err(1, "mkdir: %s", sfeedpath);
+
+	/* statistics of the stages of the feeds of this run */
+	statsfp = NULL;
+	if (mkpath(statsfile, "%s/.stats", sfeedpath) == -1 ||
+	    mkpath(statsnew, "%s/.stats.new", sfeedpath) == -1 ||
+	    !(statsfp = fopen(statsnew, "w")))
+		warn("statistics: %s/.stats", sfeedpath);
+	else
+		fcntl(fileno(statsfp), F_SETFD, FD_CLOEXEC);
+
+	/* SIGINT: signal to interrupt parent, SIGTERM: signal to terminate
+	   parent, waitpid() is interrupted. */
+	memset(&sa, 0, sizeof(sa));
+	sigemptyset(&sa.sa_mask);
+	sa.sa_handler = sighandler;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	/* a worker which exited is noticed when its pipe is written */
+	sa.sa_handler = SIG_IGN;
+	sigaction(SIGPIPE, &sa, NULL);
+
+	/* feeds which are not due yet are skipped. */
+	now = time(NULL);
+	for (i = 0, pending = 0; i < njobs; i++) {
+		readfeedcache(&jobs[i], &c);
+		jobs[i].expected = c.fetchtime + c.parsetime;
+		jobs[i].size = c.size;
+		if (!all && c.next > now)
+			jobs[i].state = JobDone;
+		else
+			pending++;
+	}
+	sethosts();
+	orderjobs();
+	if (stats) {
+		expected = makespan(order);
+		if (!(ord = calloc(njobs ? njobs : 1, sizeof(*ord))))
+			err(1, "calloc");
+		for (i = 0; i < njobs; i++)
+			ord[i] = i;
+		configorder = makespan(ord);
+		free(ord);
+	}
+	ndue = pending;
+	started = msnow();
+	/* the native HTTP client does not support proxies, https needs to be
+	   built with TLS */
+	nativehttp = !getenv("http_proxy") && !getenv("all_proxy") &&
+	             !getenv("ALL_PROXY");
+#ifdef USE_TLS
+	nativehttps = nativehttp && !getenv("https_proxy") &&
+	              !getenv("HTTPS_PROXY");
+#endif
+
+	if (!(workers = calloc(maxjobs, sizeof(*workers))))
+		err(1, "calloc");
+	if (!(pfd = calloc(maxjobs, sizeof(*pfd))))
+		err(1, "calloc");
+
+	/* process feeds concurrently: an idle worker gets the next feed of the
+	   same host, else of another host which is not at its limit. */
+	while (1) {
+		for (i = 0; !signo && !aborted && pending && i < (size_t)maxjobs; i++) {
+			w = &workers[i];
+			if (w->pid > 0 && w->job != -1)
+				continue;
+			if ((job = nextjob(w->pid > 0 ? w->host : -1)) == -1)
+				continue;
+			if (w->pid <= 0)
+				startworker(w);
+			if (dispatch(w, job) == -1) {
+				/* workers which keep exiting: the running
+				   feeds are finished, the others are not
+				   started. */
+				if (++failures >= MAXFAILURES) {
+					warnx("%d workers exited, stopping",
+					      failures);
+					aborted = 1;
+				}
+				continue;
+			}
+			failures = 0;
+			pending--;
+		}
+		/* stop the idle workers when there are no feeds left */
+		for (i = 0, running = 0; i < (size_t)maxjobs; i++) {
+			w = &workers[i];
+			if (w->pid > 0 && w->job == -1 &&
+			    (!pending || signo || aborted))
+				stopworker(w);
+			if (w->pid > 0 && w->job != -1)
+				running++;
+		}
+		if (!running && (!pending || signo || aborted))
+			break;
+		/* the feeds of the workers which are gone are sent again */
+		if (!running)
+			continue;
+		if (signo && !killed) {
+			/* kill all running childs >:D */
+			killjobs();
+			killed = 1;
+		}
+
+		for (i = 0; i < (size_t)maxjobs; i++) {
+			pfd[i].fd = (workers[i].pid > 0 && workers[i].job != -1) ?
+			            workers[i].res : -1;
+			pfd[i].events = POLLIN;
+		}
+		if (poll(pfd, maxjobs, -1) == -1) {
+			if (errno != EINTR)
+				err(1, "poll");
+			continue;
+		}
+		for (i = 0; i < (size_t)maxjobs; i++) {
+			if (pfd[i].fd == -1 || !pfd[i].revents)
+				continue;
+			w = &workers[i];
+			/* the worker writes the statistics and the index of
+			   the feed when it is done, on EOF it was terminated. */
+			if ((r = read(w->res, buf, sizeof(buf))) == -1 &&
+			    errno == EINTR)
+				continue;
+			if (r > 0) {
+				bufappend(&w->rbuf, buf, r);
+				results(w, statsfp);
+				continue;
+			}
+			if (w->job != -1)
+				jobdone(w);
+			stopworker(w);
+		}
+	}
+
+	if (statsfp) {
+		if (fclose(statsfp) == EOF || rename(statsnew, statsfile) == -1) {
+			warn("statistics: %s", statsfile);
+			unlink(statsnew);
+		}
+	}
+
+	if (stats) {
+		fprintf(stderr, "feeds: %zu of %zu, workers: %d\n",
+		        ndue, njobs, maxjobs);
+		fprintf(stderr, "expected makespan: %.2fs (config order: %.2fs)\n",
+		        expected / 1000.0, configorder / 1000.0);
+		fprintf(stderr, "actual makespan: %.2fs\n",
+		        (msnow() - started) / 1000.0);
+		printstats();
+	}
+
+	/* on signal SIGINT and SIGTERM exit with signal number + 128. */
+	if (signo)
+		return signo + 128;
+
+	return aborted;
+}
@@ -0,0 +1,284 @@
+#include <sys/types.h>
+
+#include <err.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "util.h"
+#include "textidx.h"
+
+/* items ordered by their offset in the data file */
+struct postlist {
+	struct textpost *posts;
+	size_t           n;
+};
+
+/* line of a found item */
+struct found {
+	char     *line;
+	long long timestamp;
+	uint64_t  offset;
+};
+
+/* words of a query term */
+struct words {
+	char  **words;
+	size_t *lens;
+	size_t  n;
+};
+
+static char *argv0;
+static struct textidx idx;
+
+static void
+addword(const char *s, size_t len, void *arg)
+{
+	struct words *w = arg;
+
+	if (!(w->words = realloc(w->words, (w->n + 1) * sizeof(*w->words))) ||
+	    !(w->lens = realloc(w->lens, (w->n + 1) * sizeof(*w->lens))) ||
+	    !(w->words[w->n] = malloc(len)))
+		err(1, "realloc");
+	memcpy(w->words[w->n], s, len);
+	w->lens[w->n++] = len;
+}
+
+/* the items of `a` which are also in `b` */
+static void
+intersect(struct postlist *a, const struct postlist *b)
+{
+	size_t i, j = 0, n = 0;
+
+	for (i = 0; i < a->n; i++) {
+		for (; j < b->n && b->posts[j].offset < a->posts[i].offset; j++)
+			;
+		if (j < b->n && b->posts[j].offset == a->posts[i].offset)
+			a->posts[n++] = a->posts[i];
+	}
+	a->n = n;
+}
+
+/* the items of `a` which are not in `b` */
+static void
+subtract(struct postlist *a, const struct postlist *b)
+{
+	size_t i, j = 0, n = 0;
+
+	for (i = 0; i < a->n; i++) {
+		for (; j < b->n && b->posts[j].offset < a->posts[i].offset; j++)
+			;
+		if (j == b->n || b->posts[j].offset != a->posts[i].offset)
+			a->posts[n++] = a->posts[i];
+	}
+	a->n = n;
+}
+
+/* the items of `a` and of `b` in `a` */
+static void
+unite(struct postlist *a, const struct postlist *b)
+{
+	struct textpost *p;
+	size_t i = 0, j = 0, n = 0;
+
+	if (!(p = calloc(a->n + b->n + 1, sizeof(*p))))
+		err(1, "calloc");
+	while (i < a->n || j < b->n) {
+		if (j == b->n || (i < a->n &&
+		    a->posts[i].offset <= b->posts[j].offset)) {
+			if (j < b->n && a->posts[i].offset == b->posts[j].offset)
+				j++;
+			p[n++] = a->posts[i++];
+		} else {
+			p[n++] = b->posts[j++];
+		}
+	}
+	free(a->posts);
+	a->posts = p;
+	a->n = n;
+}
+
+/* the items of an alternative of a query term: all its words, a trailing
+   '*' makes the last word a prefix */
+static void
+findwords(struct postlist *l, char *s)
+{
+	struct postlist w;
+	struct words words;
+	size_t i, len;
+	ssize_t n;
+	int prefix;
+
+	len = strlen(s);
+	if ((prefix = (len && s[len - 1] == '*')))
+		s[len - 1] = '\0';
+	memset(&words, 0, sizeof(words));
+	textidx_tokens(s, addword, &words);
+	if (!words.n)
+		errx(1, "no words to search: %s", s);
+
+	for (i = 0; i < words.n; i++) {
+		if ((n = textidx_find(&idx, words.words[i], words.lens[i],
+		    prefix && i == words.n - 1, &(w.posts))) == -1)
+			err(1, "find");
+		w.n = n;
+		if (i == 0) {
+			*l = w;
+		} else {
+			intersect(l, &w);
+			free(w.posts);
+		}
+		free(words.words[i]);
+	}
+	free(words.words);
+	free(words.lens);
+}
+
+/* the items of a query term: the alternatives are separated by '|' */
+static void
+findterm(struct postlist *l, char *s)
+{
+	struct postlist alt;
+	char *e;
+	int first = 1;
+
+	for (; s; s = e) {
+		if ((e = strchr(s, '|')))
+			*e++ = '\0';
+		if (first) {
+			findwords(l, s);
+			first = 0;
+		} else {
+			findwords(&alt, s);
+			unite(l, &alt);
+			free(alt.posts);
+		}
+	}
+}
+
+/* newest first, equal timestamps the most recently appended first */
+static int
+itemcmp(const void *v1, const void *v2)
+{
+	const struct found *i1 = v1, *i2 = v2;
+
+	if (i1->timestamp != i2->timestamp)
+		return i1->timestamp < i2->timestamp ? 1 : -1;
+	return i1->offset < i2->offset ? 1 : i1->offset > i2->offset ? -1 : 0;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: %s [-f feedname] storepath query...\n", argv0);
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct store s;
+	struct postlist result, l;
+	struct found *items;
+	char *feedname = NULL, *line, path[PATH_MAX];
+	size_t i, linesize, nitems = 0;
+	ssize_t n;
+	long feed = -1;
+	int ch, first = 1;
+	FILE *fp;
+
+	if (pledge("stdio rpath", NULL) == -1)
+		err(1, "pledge");
+
+	argv0 = argv[0];
+	while ((ch = getopt(argc, argv, "f:")) != -1) {
+		switch (ch) {
+		case 'f':
+			feedname = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc < 2)
+		usage();
+
+	if (store_open(&s, argv[0]) == -1)
+		err(1, "open: %s", argv[0]);
+	if (textidx_open(&idx, argv[0]) == -1)
+		errx(1, "invalid index: %s", argv[0]);
+	if (snprintf(path, sizeof(path), "%s/data", argv[0]) >= (int)sizeof(path) ||
+	    !(fp = fopen(path, "r")))
+		err(1, "fopen: %s/data", argv[0]);
+
+	if (pledge("stdio", NULL) == -1)
+		err(1, "pledge");
+
+	/* an unknown feed has no items */
+	if (feedname && (feed = store_findfeed(&s, feedname)) == -1)
+		return 0;
+
+	/* the items which contain all terms and none of the "!" terms */
+	memset(&result, 0, sizeof(result));
+	for (i = 1; i < (size_t)argc; i++) {
+		if (argv[i][0] == '!')
+			continue;
+		findterm(&l, argv[i]);
+		if (first) {
+			result = l;
+			first = 0;
+		} else {
+			intersect(&result, &l);
+			free(l.posts);
+		}
+	}
+	if (first)
+		usage();
+	for (i = 1; i < (size_t)argc; i++) {
+		if (argv[i][0] != '!')
+			continue;
+		findterm(&l, argv[i] + 1);
+		subtract(&result, &l);
+		free(l.posts);
+	}
+
+	/* the lines of the items, newest first */
+	if (!(items = calloc(result.n + 1, sizeof(*items))))
+		err(1, "calloc");
+	for (i = 0; i < result.n; i++) {
+		if (feed != -1 && result.posts[i].feed != (uint32_t)feed)
+			continue;
+		line = NULL;
+		linesize = 0;
+		if (fseeko(fp, (off_t)result.posts[i].offset, SEEK_SET) == -1 ||
+		    (n = getline(&line, &linesize, fp)) <= 0)
+			err(1, "read: %s/data", argv[0]);
+		if (line[n - 1] == '\n')
+			line[n - 1] = '\0';
+		items[nitems].line = line;
+		items[nitems].offset = result.posts[i].offset;
+		items[nitems].timestamp = strtoll(line, NULL, 10);
+		nitems++;
+	}
+	qsort(items, nitems, sizeof(*items), itemcmp);
+	for (i = 0; i < nitems; i++) {
+		fputs(items[i].line, stdout);
+		putchar('\n');
+		free(items[i].line);
+	}
+	free(items);
+	free(result.posts);
+	fclose(fp);
+	textidx_close(&idx);
+	store_close(&s);
+
+	if (fflush(stdout) || ferror(stdout))
+		err(1, "write");
+
+	return 0;
+}
@@ -1,24 +1,29 @@
 #include <ctype.h>
 #include <err.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "util.h"
 
+static char *argv0;
+static char **files;
+static int jobs = 1;
 static char *line;
 static size_t linesize;
 
 static void
-printfeed(FILE *fp, const char *feedname)
+printfeed(FILE *fpout, FILE *fpin, const char *feedname)
 {
 	char *fields[FieldLast];
 	struct tm *tm;
 	time_t parsedtime;
 	ssize_t linelen;
 
-	while ((linelen = getline(&line, &linesize, fp)) > 0) {
+	while ((linelen = getline(&line, &linesize, fpin)) > 0) {
 		if (line[linelen - 1] == '\n')
 			line[--linelen] = '\0';
 		if (!parseline(line, fields))
@@ -30,42 +35,85 @@ printfeed(FILE *fp, const char *feedname)
 		if (!(tm = gmtime(&parsedtime)))
 			err(1, "localtime");
 
-		fprintf(stdout, "%04d-%02d-%02dT%02d:%02d:%02dZ\t",
+		fprintf(fpout, "%04d-%02d-%02dT%02d:%02d:%02dZ\t",
 		        tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday,
 		        tm->tm_hour, tm->tm_min, tm->tm_sec);
 		if (feedname[0])
-			printf("[%s] ", feedname);
-		fputs(fields[FieldTitle], stdout);
+			fprintf(fpout, "[%s] ", feedname);
+		fputs(fields[FieldTitle], fpout);
 		if (fields[FieldLink][0]) {
-			fputs(": ", stdout);
-			fputs(fields[FieldLink], stdout);
+			fputs(": ", fpout);
+			fputs(fields[FieldLink], fpout);
 		}
-		putchar('\n');
+		putc('\n', fpout);
 	}
 }
 
-int
-main(int argc, char *argv[])
+static void
+formatfile(FILE *fpout, size_t i)
 {
 	FILE *fp;
 	char *name;
-	int i;
 
-	if (pledge(argc == 1 ? "stdio" : "stdio rpath", NULL) == -1)
+	if (!(fp = fopen(files[i], "r")))
+		err(1, "fopen: %s", files[i]);
+	name = ((name = strrchr(files[i], '/'))) ? name + 1 : files[i];
+	printfeed(fpout, fp, name);
+	if (ferror(fp))
+		err(1, "ferror: %s", files[i]);
+	fclose(fp);
+}
+
+static unsigned long long
+number(const char *s)
+{
+	unsigned long long n;
+	char *e;
+
+	errno = 0;
+	n = strtoull(s, &e, 10);
+	if (errno || !*s || *e || *s == '-')
+		errx(1, "invalid number: %s", s);
+
+	return n;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: %s [-j jobs] [file...]\n", argv0);
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int ch;
+
+	argv0 = argv[0];
+	while ((ch = getopt(argc, argv, "j:")) != -1) {
+		switch (ch) {
+		case 'j':
+			if (!(jobs = number(optarg)))
+				usage();
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (pledge(argc == 0 ? "stdio" : jobs > 1 ? "stdio rpath proc" :
+	    "stdio rpath", NULL) == -1)
 		err(1, "pledge");
 
-	if (argc == 1) {
-		printfeed(stdin, "");
+	if (argc == 0) {
+		printfeed(stdout, stdin, "");
 	} else {
-		for (i = 1; i < argc; i++) {
-			if (!(fp = fopen(argv[i], "r")))
-				err(1, "fopen: %s", argv[i]);
-			name = ((name = strrchr(argv[i], '/'))) ? name + 1 : argv[i];
-			printfeed(fp, name);
-			if (ferror(fp))
-				err(1, "ferror: %s", argv[i]);
-			fclose(fp);
-		}
+		files = argv;
+		if (formatjobs(stdout, argc, jobs, formatfile, NULL) == -1)
+			return 1;
 	}
 	return 0;
 }
@@ -0,0 +1,110 @@
+#!/bin/sh
+# regression test of sfeed_merge: the output is compared with the sort
+# pipeline which it replaces, without and with an index (-i), in upsert mode
+# (-u) and with the time index (-x). Run from the source directory after make.
+
+export LC_ALL=C
+
+PATH="$(pwd):${PATH}"
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "${dir}"' EXIT
+cd "${dir}" || exit 1
+status=0
+
+fail() {
+	echo "FAIL: $*" >&2
+	status=1
+}
+
+# gen(seed, n): n items of a pool of 40 items. The timestamps have many ties,
+# the content differs per seed, so a known item can have another version.
+# Some items have no id.
+gen() {
+	awk -v seed="$1" -v n="$2" 'BEGIN {
+		srand(seed);
+		for (i = 0; i < n; i++) {
+			k = int(rand() * 40);
+			ts = 1700000000 + int(rand() * 20) * 60;
+			id = (k % 5) ? "id" k : "";
+			printf("%d\ttitle %d\thttp://example.org/%d\tcontent %d\thtml\t%s\tauthor\t\tcat\n",
+				ts, k, k, seed, id);
+		}
+	}'
+}
+
+# the pipeline which is replaced by sfeed_merge
+refmerge() {
+	sort -t '	' -u -k6,6 -k2,2 -k3,3 "$1" "$2" | sort -t '	' -k1rn,1
+}
+
+# upsert: the first new version of a key replaces the old versions, the key is
+# the id, the link when the id is empty, else the whole line
+refupsert() {
+	awk -F '\t' '
+	function key() { return $6 != "" ? "i" $6 : $3 != "" ? "l" $3 : "w" $0; }
+	FNR == NR { if (!(key() in seen)) { seen[key()] = 1; print; } next; }
+	!(key() in seen) { print; }' "$2" "$1" | sort -t '	' -k1rn,1
+}
+
+# check the time index `$2` of feed file `$1`: the size of the file and per
+# line the timestamp and offset.
+checkidx() {
+	od -An -v -t u8 "$2" | tr -s ' ' '\n' | sed '/^$/d' | sed 1d > idx.got
+	awk -F '\t' '{ print $1; print off + 0; off += length($0) + 1; }
+	END { printf("%d\n%d\n", off, NR) > "idx.head"; }' "$1" > idx.body
+	cat idx.head idx.body | cmp -s - idx.got || fail "time index: $3"
+}
+
+# run(mode, rounds): merge rounds of new items into a feed file with and
+# without an index, each result is compared with the reference.
+run() {
+	mode=$1
+	: > old
+	rm -f index
+	r=1
+	while [ "${r}" -le "$2" ]; do
+		t="${mode:+${mode} }round ${r}"
+		gen "${r}" 30 > new
+		if [ "${mode}" = "-u" ]; then
+			refupsert old new > ref
+		else
+			refmerge old new > ref
+		fi
+
+		sfeed_merge ${mode} old new > out.plain || fail "sfeed_merge: ${t}"
+		cmp -s ref out.plain || fail "without index: ${t}"
+
+		sfeed_merge ${mode} -i index -x idx old new > out.index || fail "sfeed_merge -i: ${t}"
+		cmp -s ref out.index || fail "with index: ${t}"
+		checkidx out.index idx "${t}"
+
+		# the same new items again: nothing changes and the index is valid
+		sfeed_merge ${mode} -i index -c count out.index new > out.again
+		cmp -s ref out.again || fail "same items: ${t}"
+		[ "$(cat count)" = "0" ] || fail "count of same items: ${t}"
+
+		cp out.index old
+		# the index is stale: the first line of the feed file is edited
+		if [ $((r % 4)) -eq 0 ]; then
+			sed '1s/content/edited/' out.index > old
+		fi
+		r=$((r + 1))
+	done
+}
+
+run "" 12
+run "-u" 12
+
+# an index of the other mode is stale
+gen 100 30 > new
+: > old
+sfeed_merge -i index old new > old2
+gen 101 30 > new
+refupsert old2 new > ref
+sfeed_merge -u -i index old2 new > out || fail "sfeed_merge: mode switch"
+cmp -s ref out || fail "index of the other mode"
+
+if [ "${status}" -eq 0 ]; then
+	echo "merge: OK"
+fi
+exit "${status}"
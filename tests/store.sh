@@ -0,0 +1,273 @@
+#!/bin/sh
+# regression test of the on-disk stores: the store of sfeed_export and
+# sfeed_run, the full-text index of sfeed_index and sfeed_search and the read
+# items of sfeed_markread and the -r option of the formatters. The stores are
+# checked after an interrupted write or merge and when they are reopened. Run
+# from the source directory after make.
+
+export LC_ALL=C
+
+PATH="$(pwd):${PATH}"
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "${dir}"' EXIT
+cd "${dir}" || exit 1
+status=0
+
+fail() {
+	echo "FAIL: $*" >&2
+	status=1
+}
+
+# gen(seed, n): n items, the timestamps have ties. The title has the word
+# kwN of the item and the word of the batch, the content has a common word.
+gen() {
+	awk -v seed="$1" -v n="$2" 'BEGIN {
+		srand(seed);
+		for (i = 0; i < n; i++) {
+			k = int(rand() * 30);
+			ts = 1700000000 + int(rand() * 50) * 60;
+			printf("%d\tKw%d batch%d\thttp://example.org/%d/%d\tsome <b>common</b> text\thtml\tid%d.%d\tauthor%d\t\t\n",
+				ts, k, seed, seed, i, seed, i, k % 3);
+		}
+	}'
+}
+
+# the items of the store newest first, equal timestamps the last appended
+# first: from the lines "feed<TAB>line" of the file all in the order they are
+# appended. Only feed $1 if it is not empty and the timestamps $2 to $3.
+refexport() {
+	awk -F '\t' -v feed="$1" -v from="${2:-0}" -v to="${3:-9999999999}" '
+	(feed == "" || $1 == feed) && $2 >= from && $2 <= to {
+		printf("%s\t%d\t%s\n", $2, NR, substr($0, length($1) + 2));
+	}' all | sort -t '	' -k1,1rn -k2,2rn | cut -f 3-
+}
+
+# append(feed, seed, n): append items to the store and to the file all
+append() {
+	gen "$2" "$3" > batch
+	sfeed_export -i "$1" store < batch || fail "sfeed_export -i $1: batch $2"
+	awk -v feed="$1" '{ print feed "\t" $0; }' batch >> all
+}
+
+checkexport() {
+	sfeed_export store > out || fail "sfeed_export: $1"
+	refexport "" > ref
+	cmp -s ref out || fail "sfeed_export: $1"
+	sfeed_export -f b store > out || fail "sfeed_export -f: $1"
+	refexport b > ref
+	cmp -s ref out || fail "sfeed_export -f: $1"
+	sfeed_export -f a -s 1700000600 -e 1700001800 store > out || fail "sfeed_export -s -e: $1"
+	refexport a 1700000600 1700001800 > ref
+	cmp -s ref out || fail "sfeed_export -s -e: $1"
+}
+
+# the files of the runs or segments $1 in the store, one per line
+files() {
+	(cd store && ls | grep "^$1\.[0-9]*$")
+}
+
+# restore the files which are removed by a merge from the copy of the store:
+# the state of a merge which is interrupted before the merged files are
+# removed. The restored files are listed in the file restored.
+# returns 1 if no files were merged.
+restore() {
+	: > restored
+	for f in $(cd snap && ls | grep "^$1\.[0-9]*$"); do
+		[ -e "store/${f}" ] && continue
+		cp "snap/${f}" "store/${f}"
+		echo "${f}" >> restored
+	done
+	[ -s restored ]
+}
+
+# store: appends of decreasing size to merge runs, each append reopens the
+# store.
+: > all
+seed=1
+merged=0
+for n in 40 20 10 5 5 3 1 1 30 2 1; do
+	rm -rf snap
+	cp -R store snap 2>/dev/null
+	append a "${seed}" "${n}"
+	seed=$((seed + 1))
+	append b "${seed}" 3
+	seed=$((seed + 1))
+	checkexport "append ${seed}"
+
+	# a record is in two runs when a merge is interrupted
+	if [ -d snap ] && restore index; then
+		merged=1
+		checkexport "interrupted merge ${seed}"
+	fi
+done
+[ "${merged}" -eq 1 ] || fail "sfeed_export: no runs are merged"
+
+# a run which is not complete is skipped, also a temporary file
+last=$(files index | sed 's/^index\.//' | sort -n | tail -n 1)
+dd if="store/index.${last}" of="store/index.$((last + 1))" bs=100 count=1 2> /dev/null
+cp "store/index.${last}" "store/index.${last}.AbCdEf"
+checkexport "incomplete run"
+
+# data which is appended without a run is not an item, the next append works
+printf '1700000000\tlost\n' >> store/data
+checkexport "appended data without a run"
+append a "${seed}" 4
+seed=$((seed + 1))
+checkexport "append after an interrupted append"
+
+sfeed_export -l store > out || fail "sfeed_export -l"
+printf 'a\nb\n' | cmp -s - out || fail "sfeed_export -l"
+
+# full-text index: the indexed items match the queries. The items which are
+# appended after sfeed_index runs are not found.
+# search(query, awk condition): compare sfeed_search with the items of the
+# store at the time of the index which match the condition.
+search() {
+	q=$1
+	shift
+	awk -F '\t' '
+	function has(w) { return (w in t); }
+	function prefix(p,   w) {
+		for (w in t)
+			if (index(w, p) == 1)
+				return 1;
+		return 0;
+	}
+	{
+		split("", t);
+		n = split(tolower($2 " " $4 " " $7), a, /[^a-z0-9]+/);
+		for (i = 1; i <= n; i++)
+			if (length(a[i]) >= 2)
+				t[a[i]] = 1;
+	}
+	'"$1"' { print; }' indexed > ref
+	shift
+	sfeed_search store "$@" > out || fail "sfeed_search $*: ${q}"
+	cmp -s ref out || fail "sfeed_search $*: ${q}"
+}
+
+checksearch() {
+	search "$1" 'has("kw7")' kw7
+	search "$1" 'has("kw7") || has("kw11")' 'KW7|kw11'
+	search "$1" 'prefix("kw1")' 'kw1*'
+	search "$1" 'has("common") && !has("author1")' common '!author1'
+	search "$1" 'has("batch3") && has("kw2")' 'batch3-kw2'
+}
+
+for n in 20 10 5 3 1 1 8; do
+	rm -rf snap
+	cp -R store snap
+	sfeed_index store || fail "sfeed_index: ${n}"
+	sfeed_export store > indexed
+	checksearch "index ${n}"
+
+	# not indexed yet
+	append a "${seed}" "${n}"
+	seed=$((seed + 1))
+	checksearch "append ${n}"
+
+	# a segment which is covered by a later segment is skipped and removed
+	if restore text; then
+		merged=2
+		checksearch "interrupted merge ${n}"
+		sfeed_index store || fail "sfeed_index: ${n}"
+		sfeed_export store > indexed
+		checksearch "index after an interrupted merge ${n}"
+		for f in $(cat restored); do
+			[ -e "store/${f}" ] && fail "sfeed_index: ${f} is not removed"
+		done
+	fi
+done
+[ "${merged}" -eq 2 ] || fail "sfeed_index: no segments are merged"
+
+# sfeed_run: the added items are appended to the store, the items which can
+# not be appended are kept for the next run.
+mkdir -p run/feeds
+# atom(n): a feed of n items
+atom() {
+	awk -v n="$1" 'BEGIN {
+		print "<feed xmlns=\"http://www.w3.org/2005/Atom\">";
+		for (i = 0; i < n; i++) {
+			printf("<entry><title>item %d</title>", i);
+			printf("<link href=\"http://example.org/%d\"/>", i);
+			printf("<id>%d</id>", i);
+			printf("<updated>2024-01-%02dT00:00:00Z</updated></entry>\n",
+				i + 1);
+		}
+		print "</feed>";
+	}' > run/feed.xml
+}
+runfeeds() {
+	cat > run/sfeedrc <<!
+sfeedpath="${dir}/run/feeds"
+storepath="$1"
+fetch() { cat "${dir}/run/feed.xml"; }
+feeds() { feed "news" "http://example.org/feed"; }
+!
+	sfeed_run -a run/sfeedrc > /dev/null 2>&1 || fail "sfeed_run: $2"
+}
+atom 3
+runfeeds "${dir}/run/store" 1
+atom 5
+: > run/blocked
+runfeeds "${dir}/run/blocked/store" 2
+[ -s run/feeds/.news.added ] || fail "sfeed_run: the added items are not kept"
+atom 6
+runfeeds "${dir}/run/store" 3
+[ -e run/feeds/.news.added ] && fail "sfeed_run: the added items are not removed"
+sfeed_export run/store | sort > out
+sort run/feeds/news | cmp -s - out || fail "sfeed_run: store"
+
+# read items: the items which are not read are shown as new by the
+# formatters, the table grows and is rewritten when items are removed.
+# checkread(what): compare the new items with the links in the file read.
+checkread() {
+	sfeed_plain -r readfile items | awk '{ print substr($0, 1, 1), $NF; }' > out ||
+		fail "sfeed_plain -r: $1"
+	awk -F '\t' 'FILENAME == "read" { r[$0] = 1; next; }
+	{ print (($3 in r) ? " " : "N"), $3; }' read items > ref
+	cmp -s ref out || fail "sfeed_plain -r: $1"
+}
+
+gen 1 1 > items
+for s in 2 3 4 5 6 7 8; do
+	gen "${s}" 40 >> items
+done
+: > read
+checkread "missing file"
+for n in 1 2 5 10 20 40 80; do
+	awk -F '\t' -v n="${n}" 'NR % 7 == n % 7 && NR <= n * 4 { print $3; }' items > mark
+	sfeed_markread readfile < mark || fail "sfeed_markread: ${n}"
+	sort -u read mark > tmp && mv tmp read
+	checkread "mark ${n}"
+done
+head -n 30 read > unmark
+sfeed_markread -u readfile < unmark || fail "sfeed_markread -u"
+sort read unmark | uniq -u > tmp && mv tmp read
+checkread "unmark"
+
+# the items of a feed file are marked by their link
+awk 'NR <= 15' items > part
+sfeed_markread readfile part || fail "sfeed_markread file"
+cut -f 3 part | sort -u read - > tmp && mv tmp read
+checkread "mark a file"
+
+# a temporary file of an interrupted rewrite is not used
+cp readfile readfile.AbCdEf
+checkread "temporary file"
+
+# an invalid file is not used and not replaced
+cp readfile readfile.good
+dd if=readfile.good of=readfile bs=100 count=1 2> /dev/null
+cp readfile readfile.bad
+sfeed_plain -r readfile items > /dev/null 2>&1 && fail "sfeed_plain -r: invalid file is used"
+echo "http://example.org/1/0" | sfeed_markread readfile 2> /dev/null &&
+	fail "sfeed_markread: invalid file is used"
+cmp -s readfile readfile.bad || fail "sfeed_markread: invalid file is replaced"
+mv readfile.good readfile
+checkread "reopen"
+
+if [ "${status}" -eq 0 ]; then
+	echo "store: OK"
+fi
+exit "${status}"
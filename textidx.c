@@ -0,0 +1,900 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <dirent.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "util.h"
+#include "textidx.h"
+
+/* text index segment: magic, start and end of the byte range of the data
+ * file, amount of terms, size of the strings, size of the postings, the
+ * sorted terms, the strings and the postings. The postings of a term are
+ * per item the offset of its line (delta to the previous item of the term)
+ * and its feed id, both as variable-length integers. The data is in host
+ * byte-order. */
+#define TEXT_MAGIC   0x7366656564747831ULL /* "sfeedtx1" */
+#define TEXT_HDRSIZE (6 * sizeof(uint64_t))
+
+/* amount of data bytes which is indexed in memory before it is written */
+#define TEXT_BATCH   (64 * 1024 * 1024)
+
+/* flags of the text of a field */
+#define TEXT_HTML    1 /* skip the tags and entities */
+#define TEXT_ESCAPED 2 /* the escapes \n, \t and \\ separate words */
+
+/* term of the segment which is built: the postings are encoded as the items
+   are read */
+struct textacc {
+	char          *str;
+	uint32_t       len;
+	uint32_t       count;
+	uint64_t       hash;
+	uint64_t       last;
+	unsigned char *post;
+	size_t         postlen, postsize;
+};
+
+/* open-addressing table of the terms of the segment which is built */
+struct textbuild {
+	struct textacc *terms;
+	size_t          size;   /* power of 2 */
+	size_t          nterms;
+	uint64_t        offset; /* of the item which is indexed */
+	uint32_t        feed;
+};
+
+static size_t
+putvarint(unsigned char *p, uint64_t v)
+{
+	size_t n = 0;
+
+	for (; v >= 0x80; v >>= 7)
+		p[n++] = (v & 0x7f) | 0x80;
+	p[n++] = v;
+
+	return n;
+}
+
+static size_t
+getvarint(const unsigned char *p, uint64_t *v)
+{
+	size_t n = 0;
+	int shift;
+
+	*v = 0;
+	for (shift = 0; shift < 64; shift += 7) {
+		*v |= (uint64_t)(p[n] & 0x7f) << shift;
+		if (!(p[n++] & 0x80))
+			break;
+	}
+	return n;
+}
+
+/* decode the UTF-8 sequence at `s`, an invalid byte is U+FFFD.
+   returns the length of the sequence */
+static size_t
+utf8decode(const unsigned char *s, uint32_t *cp)
+{
+	uint32_t c;
+	size_t i, n;
+
+	if (s[0] < 0x80) {
+		*cp = s[0];
+		return 1;
+	} else if ((s[0] & 0xe0) == 0xc0) {
+		c = s[0] & 0x1f;
+		n = 2;
+	} else if ((s[0] & 0xf0) == 0xe0) {
+		c = s[0] & 0x0f;
+		n = 3;
+	} else if ((s[0] & 0xf8) == 0xf0) {
+		c = s[0] & 0x07;
+		n = 4;
+	} else {
+		*cp = 0xfffd;
+		return 1;
+	}
+	for (i = 1; i < n; i++) {
+		if ((s[i] & 0xc0) != 0x80) {
+			*cp = 0xfffd;
+			return 1;
+		}
+		c = (c << 6) | (s[i] & 0x3f);
+	}
+	*cp = c;
+
+	return n;
+}
+
+static size_t
+utf8encode(uint32_t c, char *s)
+{
+	if (c < 0x80) {
+		s[0] = c;
+		return 1;
+	} else if (c < 0x800) {
+		s[0] = 0xc0 | (c >> 6);
+		s[1] = 0x80 | (c & 0x3f);
+		return 2;
+	} else if (c < 0x10000) {
+		s[0] = 0xe0 | (c >> 12);
+		s[1] = 0x80 | ((c >> 6) & 0x3f);
+		s[2] = 0x80 | (c & 0x3f);
+		return 3;
+	}
+	s[0] = 0xf0 | ((c >> 18) & 0x07);
+	s[1] = 0x80 | ((c >> 12) & 0x3f);
+	s[2] = 0x80 | ((c >> 6) & 0x3f);
+	s[3] = 0x80 | (c & 0x3f);
+	return 4;
+}
+
+/* lower case of the letters of ASCII, Latin-1, Latin Extended-A, Greek and
+   Cyrillic, other characters are unchanged */
+static uint32_t
+textlower(uint32_t c)
+{
+	if (c >= 'A' && c <= 'Z')
+		return c + 32;
+	if (c < 0x80)
+		return c;
+	if (c >= 0xc0 && c <= 0xde && c != 0xd7)
+		return c + 32;
+	if ((c >= 0x100 && c <= 0x137 && !(c & 1)) ||
+	    (c >= 0x139 && c <= 0x148 && (c & 1)) ||
+	    (c >= 0x14a && c <= 0x177 && !(c & 1)) ||
+	    (c >= 0x179 && c <= 0x17e && (c & 1)))
+		return c + 1;
+	if (c == 0x178)
+		return 0xff;
+	if (c >= 0x391 && c <= 0x3ab && c != 0x3a2)
+		return c + 32;
+	if (c >= 0x410 && c <= 0x42f)
+		return c + 32;
+	if (c >= 0x400 && c <= 0x40f)
+		return c + 80;
+	return c;
+}
+
+/* characters which separate words: ASCII except letters and digits, control
+   characters and the punctuation and symbol blocks */
+static int
+textsep(uint32_t c)
+{
+	if (c < 0x80)
+		return !((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+		         (c >= 'A' && c <= 'Z'));
+	return c <= 0xbf || c == 0xd7 || c == 0xf7 ||
+	       (c >= 0x2000 && c <= 0x2bff) ||   /* punctuation, symbols */
+	       (c >= 0x3000 && c <= 0x303f) ||   /* CJK punctuation */
+	       (c >= 0xfe30 && c <= 0xfe4f) ||   /* CJK compatibility forms */
+	       (c >= 0xff00 && c <= 0xff0f) ||   /* fullwidth punctuation */
+	       (c >= 0xfff0 && c <= 0xffff) ||   /* specials */
+	       (c >= 0x1f000 && c <= 0x1faff);   /* emoji and symbols */
+}
+
+/* split the text `s` into words, the callback `fn` is called with each word
+   in lower case: words shorter than 2 bytes are skipped, longer words than
+   TEXT_MAXTOKEN bytes are truncated */
+static void
+tokenize(const char *s, int flags, void (*fn)(const char *, size_t, void *),
+	void *arg)
+{
+	char tok[TEXT_MAXTOKEN], buf[4];
+	uint32_t c;
+	size_t len = 0, n;
+
+	while (*s) {
+		if ((flags & TEXT_ESCAPED) && s[0] == '\\' &&
+		    (s[1] == 'n' || s[1] == 't' || s[1] == '\\')) {
+			s += 2;
+			c = ' ';
+		} else if ((flags & TEXT_HTML) && *s == '<') {
+			for (s++; *s && *s != '>'; s++)
+				;
+			if (*s)
+				s++;
+			c = ' ';
+		} else if ((flags & TEXT_HTML) && *s == '&') {
+			for (n = 1; n < 10 && s[n] && s[n] != ';' && s[n] != ' '; n++)
+				;
+			s += s[n] == ';' ? n + 1 : 1;
+			c = ' ';
+		} else {
+			s += utf8decode((const unsigned char *)s, &c);
+		}
+
+		if (textsep(c)) {
+			if (len >= 2)
+				fn(tok, len, arg);
+			len = 0;
+			continue;
+		}
+		n = utf8encode(textlower(c), buf);
+		if (len + n <= sizeof(tok)) {
+			memcpy(tok + len, buf, n);
+			len += n;
+		}
+	}
+	if (len >= 2)
+		fn(tok, len, arg);
+}
+
+/* split the text `s` of a query into words in the same way as the text of
+   the items is indexed */
+void
+textidx_tokens(const char *s, void (*fn)(const char *, size_t, void *),
+	void *arg)
+{
+	tokenize(s, 0, fn, arg);
+}
+
+static int
+termcmp(const char *s1, size_t l1, const char *s2, size_t l2)
+{
+	int r;
+
+	if ((r = memcmp(s1, s2, l1 < l2 ? l1 : l2)))
+		return r;
+	return l1 < l2 ? -1 : l1 > l2;
+}
+
+static int
+ulongcmp(const void *v1, const void *v2)
+{
+	unsigned long l1 = *(const unsigned long *)v1;
+	unsigned long l2 = *(const unsigned long *)v2;
+
+	return l1 < l2 ? -1 : l1 > l2;
+}
+
+/* the sequence numbers of the segments in the directory, sorted */
+static size_t
+textsegs(const char *dir, unsigned long **seqs)
+{
+	struct dirent *d;
+	DIR *dp;
+	unsigned long seq, *p;
+	size_t n = 0, size = 0;
+	char *e;
+
+	*seqs = NULL;
+	if (!(dp = opendir(dir)))
+		return 0;
+	while ((d = readdir(dp))) {
+		if (strncmp(d->d_name, "text.", 5))
+			continue;
+		errno = 0;
+		seq = strtoul(d->d_name + 5, &e, 10);
+		if (errno || e == d->d_name + 5 || *e)
+			continue;
+		if (n + 1 >= size) {
+			size = size ? size * 2 : 16;
+			if (!(p = realloc(*seqs, size * sizeof(*p))))
+				err(1, "realloc");
+			*seqs = p;
+		}
+		(*seqs)[n++] = seq;
+	}
+	closedir(dp);
+	qsort(*seqs, n, sizeof(**seqs), ulongcmp);
+
+	return n;
+}
+
+static int
+segopen(struct textseg *sg, const char *dir, unsigned long seq)
+{
+	char path[PATH_MAX];
+	struct stat st;
+	uint64_t *p;
+	void *map;
+	int fd;
+
+	memset(sg, 0, sizeof(*sg));
+	if (snprintf(path, sizeof(path), "%s/text.%lu", dir, seq) >= (int)sizeof(path))
+		return -1;
+	if ((fd = open(path, O_RDONLY)) == -1)
+		return -1;
+	if (fstat(fd, &st) == -1 || st.st_size < (off_t)TEXT_HDRSIZE) {
+		close(fd);
+		return -1;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	p = map;
+	if (p[0] != TEXT_MAGIC || p[1] > p[2] ||
+	    (off_t)(TEXT_HDRSIZE + p[3] * sizeof(struct textterm) + p[4] + p[5]) !=
+	    st.st_size) {
+		munmap(map, st.st_size);
+		return -1;
+	}
+	sg->start = p[1];
+	sg->end = p[2];
+	sg->nterms = p[3];
+	sg->terms = (const struct textterm *)&p[6];
+	sg->strs = (const char *)(sg->terms + sg->nterms);
+	sg->posts = (const unsigned char *)sg->strs + p[4];
+	sg->postsize = p[5];
+	sg->map = map;
+	sg->mapsize = st.st_size;
+	sg->seq = seq;
+
+	return 0;
+}
+
+static void
+segclose(struct textseg *sg)
+{
+	if (sg->map)
+		munmap(sg->map, sg->mapsize);
+	memset(sg, 0, sizeof(*sg));
+}
+
+/* size of the postings of term `i` of a segment */
+static size_t
+segpostlen(const struct textseg *sg, size_t i)
+{
+	return (i + 1 < sg->nterms ? sg->terms[i + 1].post : sg->postsize) -
+	       sg->terms[i].post;
+}
+
+/* One pass over the terms of segment `a` merged with the terms of the next
+ * segment `b` (can be NULL): pass 0 counts the terms and the sizes of the
+ * strings and postings in `hdr`, pass 1 writes the terms, pass 2 the
+ * strings and pass 3 the postings. The postings of the terms in both
+ * segments are concatenated: only the first offset of `b` is encoded again,
+ * relative to the last item of `a`. */
+static void
+segpass(FILE *fp, const struct textseg *a, const struct textseg *b, int pass,
+	uint64_t hdr[3])
+{
+	const struct textterm *ta, *tb;
+	struct textterm t;
+	unsigned char vbuf[10];
+	uint64_t first;
+	size_t i = 0, j = 0, nb = b ? b->nterms : 0, alen, blen, flen, vlen;
+	int c;
+
+	hdr[0] = hdr[1] = hdr[2] = 0;
+	while (i < a->nterms || j < nb) {
+		ta = i < a->nterms ? &(a->terms[i]) : NULL;
+		tb = j < nb ? &(b->terms[j]) : NULL;
+		if (ta && tb)
+			c = termcmp(a->strs + ta->str, ta->len,
+			            b->strs + tb->str, tb->len);
+		else
+			c = ta ? -1 : 1;
+		if (c > 0)
+			ta = NULL;
+		else
+			i++;
+		if (c < 0)
+			tb = NULL;
+		else
+			j++;
+
+		alen = ta ? segpostlen(a, i - 1) : 0;
+		blen = tb ? segpostlen(b, j - 1) : 0;
+		flen = vlen = 0;
+		if (ta && tb) {
+			flen = getvarint(b->posts + tb->post, &first);
+			vlen = putvarint(vbuf, first - ta->last);
+		}
+
+		t.str = hdr[1];
+		t.post = hdr[2];
+		t.len = ta ? ta->len : tb->len;
+		t.count = (ta ? ta->count : 0) + (tb ? tb->count : 0);
+		t.last = tb ? tb->last : ta->last;
+		switch (pass) {
+		case 1:
+			fwrite(&t, sizeof(t), 1, fp);
+			break;
+		case 2:
+			fwrite(ta ? a->strs + ta->str : b->strs + tb->str, 1,
+			       t.len, fp);
+			break;
+		case 3:
+			if (ta)
+				fwrite(a->posts + ta->post, 1, alen, fp);
+			if (tb) {
+				fwrite(vbuf, 1, vlen, fp);
+				fwrite(b->posts + tb->post + flen, 1, blen - flen, fp);
+			}
+			break;
+		}
+		hdr[0]++;
+		hdr[1] += t.len;
+		hdr[2] += alen + vlen + blen - flen;
+	}
+}
+
+/* write the segment `a` merged with the next segment `b` (can be NULL) as
+   segment `seq`: the file is written to a temporary file and then renamed */
+static int
+segwrite(const char *dir, unsigned long seq, const struct textseg *a,
+	const struct textseg *b)
+{
+	char path[PATH_MAX], tmppath[PATH_MAX];
+	uint64_t hdr[6];
+	FILE *fp;
+	int fd, r, pass;
+
+	if (snprintf(path, sizeof(path), "%s/text.%lu", dir, seq) >= (int)sizeof(path) ||
+	    snprintf(tmppath, sizeof(tmppath), "%s.XXXXXX", path) >= (int)sizeof(tmppath))
+		return -1;
+	if ((fd = mkstemp(tmppath)) == -1)
+		return -1;
+	if (!(fp = fdopen(fd, "wb"))) {
+		close(fd);
+		unlink(tmppath);
+		return -1;
+	}
+
+	hdr[0] = TEXT_MAGIC;
+	hdr[1] = a->start;
+	hdr[2] = b ? b->end : a->end;
+	segpass(NULL, a, b, 0, &hdr[3]);
+	fwrite(hdr, sizeof(hdr), 1, fp);
+	for (pass = 1; pass <= 3; pass++)
+		segpass(fp, a, b, pass, &hdr[3]);
+
+	r = (fflush(fp) || ferror(fp)) ? -1 : 0;
+	if (fclose(fp) == EOF)
+		r = -1;
+	if (r == -1 || rename(tmppath, path) == -1) {
+		unlink(tmppath);
+		return -1;
+	}
+	return 0;
+}
+
+/* Open the full-text index of the store in directory `dir`: the segments are
+ * mapped. A segment which is covered by a later segment is skipped: it is
+ * left by a merge which was interrupted.
+ * returns 0 on success or -1 on error. */
+int
+textidx_open(struct textidx *idx, const char *dir)
+{
+	struct textseg sg;
+	unsigned long *seqs;
+	size_t i, n;
+
+	memset(idx, 0, sizeof(*idx));
+	n = textsegs(dir, &seqs);
+	if (n && !(idx->segs = calloc(n, sizeof(*idx->segs))))
+		err(1, "calloc");
+	for (i = 0; i < n; i++) {
+		if (segopen(&sg, dir, seqs[i]) == -1)
+			continue;
+		while (idx->nsegs && idx->segs[idx->nsegs - 1].start >= sg.start)
+			segclose(&(idx->segs[--idx->nsegs]));
+		if (idx->nsegs && idx->segs[idx->nsegs - 1].end != sg.start) {
+			/* not contiguous: the index is not usable */
+			segclose(&sg);
+			free(seqs);
+			textidx_close(idx);
+			return -1;
+		}
+		idx->segs[idx->nsegs++] = sg;
+	}
+	free(seqs);
+
+	return 0;
+}
+
+void
+textidx_close(struct textidx *idx)
+{
+	size_t i;
+
+	for (i = 0; i < idx->nsegs; i++)
+		segclose(&(idx->segs[i]));
+	free(idx->segs);
+	memset(idx, 0, sizeof(*idx));
+}
+
+static int
+textpostcmp(const void *v1, const void *v2)
+{
+	const struct textpost *p1 = v1, *p2 = v2;
+
+	return p1->offset < p2->offset ? -1 : p1->offset > p2->offset;
+}
+
+/* Find the items which contain the term `term` of length `len` or with a
+ * word which starts with `term` if `prefix` is set: a binary search in the
+ * terms of each segment. The items are allocated in `posts` and ordered by
+ * their offset in the data file.
+ * returns the amount of items. */
+ssize_t
+textidx_find(const struct textidx *idx, const char *term, size_t len,
+	int prefix, struct textpost **posts)
+{
+	const struct textseg *sg;
+	const struct textterm *t;
+	const unsigned char *p;
+	struct textpost *np;
+	uint64_t off, v;
+	size_t i, j, k, lo, hi, m, n = 0, size = 0;
+
+	*posts = NULL;
+	for (i = 0; i < idx->nsegs; i++) {
+		sg = &(idx->segs[i]);
+		/* first term >= term: the terms with the prefix follow it */
+		for (lo = 0, hi = sg->nterms; lo < hi; ) {
+			m = lo + (hi - lo) / 2;
+			t = &(sg->terms[m]);
+			if (termcmp(sg->strs + t->str, t->len, term, len) < 0)
+				lo = m + 1;
+			else
+				hi = m;
+		}
+		for (k = lo; k < sg->nterms; k++) {
+			t = &(sg->terms[k]);
+			if (t->len < len || memcmp(sg->strs + t->str, term, len) ||
+			    (!prefix && t->len != len))
+				break;
+			if (n + t->count >= size) {
+				size = n + t->count + (size ? size : 1024);
+				if (!(np = realloc(*posts, size * sizeof(*np))))
+					err(1, "realloc");
+				*posts = np;
+			}
+			p = sg->posts + t->post;
+			for (j = 0, off = 0; j < t->count; j++) {
+				p += getvarint(p, &v);
+				off += v;
+				p += getvarint(p, &v);
+				(*posts)[n].offset = off;
+				(*posts)[n].feed = v;
+				n++;
+			}
+		}
+	}
+	qsort(*posts, n, sizeof(**posts), textpostcmp);
+
+	/* an item has several words with the prefix */
+	for (i = 0, j = 0; i < n; i++) {
+		if (!j || (*posts)[i].offset != (*posts)[j - 1].offset)
+			(*posts)[j++] = (*posts)[i];
+	}
+	return j;
+}
+
+/* add the word to the postings of the item which is indexed */
+static void
+addterm(const char *tok, size_t len, void *arg)
+{
+	struct textbuild *b = arg;
+	struct textacc *t, *old;
+	unsigned char vbuf[20];
+	unsigned char *p;
+	uint64_t h;
+	size_t i, j, n, oldsize;
+
+	if (2 * (b->nterms + 1) > b->size) {
+		old = b->terms;
+		oldsize = b->size;
+		b->size = b->size ? b->size * 2 : 4096;
+		if (!(b->terms = calloc(b->size, sizeof(*b->terms))))
+			err(1, "calloc");
+		for (i = 0; i < oldsize; i++) {
+			if (!old[i].str)
+				continue;
+			for (j = old[i].hash & (b->size - 1); b->terms[j].str;
+			     j = (j + 1) & (b->size - 1))
+				;
+			b->terms[j] = old[i];
+		}
+		free(old);
+	}
+
+	h = hashbuf(HASHINIT, tok, len);
+	for (i = h & (b->size - 1); ; i = (i + 1) & (b->size - 1)) {
+		t = &(b->terms[i]);
+		if (!t->str) {
+			if (!(t->str = malloc(len)))
+				err(1, "malloc");
+			memcpy(t->str, tok, len);
+			t->len = len;
+			t->hash = h;
+			b->nterms++;
+			break;
+		}
+		if (t->hash == h && t->len == len && !memcmp(t->str, tok, len))
+			break;
+	}
+
+	/* one posting per item */
+	if (t->count && t->last == b->offset)
+		return;
+	n = putvarint(vbuf, b->offset - t->last);
+	n += putvarint(vbuf + n, b->feed);
+	if (t->postlen + n > t->postsize) {
+		t->postsize = t->postsize ? t->postsize * 2 : 16;
+		if (!(p = realloc(t->post, t->postsize)))
+			err(1, "realloc");
+		t->post = p;
+	}
+	memcpy(t->post + t->postlen, vbuf, n);
+	t->postlen += n;
+	t->last = b->offset;
+	t->count++;
+}
+
+static void
+buildfree(struct textbuild *b)
+{
+	size_t i;
+
+	for (i = 0; i < b->size; i++) {
+		free(b->terms[i].str);
+		free(b->terms[i].post);
+	}
+	free(b->terms);
+	memset(b, 0, sizeof(*b));
+}
+
+static int
+textacccmp(const void *v1, const void *v2)
+{
+	const struct textacc *t1 = *(const struct textacc **)v1;
+	const struct textacc *t2 = *(const struct textacc **)v2;
+
+	return termcmp(t1->str, t1->len, t2->str, t2->len);
+}
+
+/* write the terms which are built as segment `seq` of the byte range
+   `start` to `end` of the data file, then the terms are cleared */
+static int
+buildwrite(const char *dir, unsigned long seq, struct textbuild *b,
+	uint64_t start, uint64_t end)
+{
+	struct textseg sg;
+	struct textacc **sorted;
+	struct textterm *terms;
+	unsigned char *posts;
+	char *strs;
+	size_t i, n = 0, strsize = 0, postsize = 0;
+	int r;
+
+	if (!(sorted = calloc(b->nterms ? b->nterms : 1, sizeof(*sorted))))
+		err(1, "calloc");
+	for (i = 0; i < b->size; i++) {
+		if (b->terms[i].str) {
+			sorted[n++] = &(b->terms[i]);
+			strsize += b->terms[i].len;
+			postsize += b->terms[i].postlen;
+		}
+	}
+	qsort(sorted, n, sizeof(*sorted), textacccmp);
+
+	if (!(terms = calloc(n ? n : 1, sizeof(*terms))) ||
+	    !(strs = malloc(strsize ? strsize : 1)) ||
+	    !(posts = malloc(postsize ? postsize : 1)))
+		err(1, "malloc");
+	for (i = 0, strsize = postsize = 0; i < n; i++) {
+		terms[i].str = strsize;
+		terms[i].post = postsize;
+		terms[i].last = sorted[i]->last;
+		terms[i].len = sorted[i]->len;
+		terms[i].count = sorted[i]->count;
+		memcpy(strs + strsize, sorted[i]->str, sorted[i]->len);
+		memcpy(posts + postsize, sorted[i]->post, sorted[i]->postlen);
+		strsize += sorted[i]->len;
+		postsize += sorted[i]->postlen;
+	}
+
+	memset(&sg, 0, sizeof(sg));
+	sg.terms = terms;
+	sg.nterms = n;
+	sg.strs = strs;
+	sg.posts = posts;
+	sg.postsize = postsize;
+	sg.start = start;
+	sg.end = end;
+	r = segwrite(dir, seq, &sg, NULL);
+
+	free(sorted);
+	free(terms);
+	free(strs);
+	free(posts);
+	buildfree(b);
+
+	return r;
+}
+
+/* merge the last two segments into a new segment while a segment is not
+   larger than half of the segment before it, like the runs of the store */
+static int
+segmerge(const char *dir)
+{
+	struct textseg s1, s2;
+	unsigned long *seqs;
+	char path[PATH_MAX];
+	size_t i, n;
+	int ret = 0;
+
+	n = textsegs(dir, &seqs);
+	while (n >= 2) {
+		if (segopen(&s1, dir, seqs[n - 2]) == -1)
+			break;
+		if (segopen(&s2, dir, seqs[n - 1]) == -1) {
+			segclose(&s1);
+			break;
+		}
+		if (s1.mapsize > 2 * s2.mapsize || s1.end != s2.start) {
+			segclose(&s1);
+			segclose(&s2);
+			break;
+		}
+		ret = segwrite(dir, seqs[n - 1] + 1, &s1, &s2);
+		segclose(&s1);
+		segclose(&s2);
+		if (ret == -1)
+			break;
+		for (i = n - 2; i < n; i++) {
+			snprintf(path, sizeof(path), "%s/text.%lu", dir, seqs[i]);
+			unlink(path);
+		}
+		seqs[n - 2] = seqs[n - 1] + 1;
+		n--;
+	}
+	free(seqs);
+
+	return ret;
+}
+
+/* sequence number of a new segment */
+static unsigned long
+segnext(const char *dir)
+{
+	unsigned long *seqs, seq;
+	size_t n;
+
+	n = textsegs(dir, &seqs);
+	seq = n ? seqs[n - 1] + 1 : 1;
+	free(seqs);
+
+	return seq;
+}
+
+static int
+recoffsetcmp(const void *v1, const void *v2)
+{
+	const struct storerec *r1 = v1, *r2 = v2;
+
+	return r1->offset < r2->offset ? -1 : r1->offset > r2->offset;
+}
+
+/* Index the items which are appended to the store in directory `dir` since
+ * the last update: the title, author and content of the items after the end
+ * of the last segment are indexed in new segments, per TEXT_BATCH bytes of
+ * data, then the last segments are merged. The store is locked while it is
+ * indexed.
+ * returns 0 on success or -1 on error. */
+int
+textidx_update(const char *dir)
+{
+	struct store s;
+	struct textidx idx;
+	struct textbuild b;
+	struct storerec *recs = NULL, *p;
+	const struct storerec *rec;
+	struct stat st;
+	struct flock fl;
+	unsigned long *seqs;
+	char path[PATH_MAX], *line = NULL, *fields[FieldLast];
+	size_t i, j, n = 0, size = 0, linesize = 0, nseqs;
+	uint64_t start, batch;
+	int fd, ret = -1, flags;
+
+	/* the feeds file is the lock of the store */
+	if (snprintf(path, sizeof(path), "%s/feeds", dir) >= (int)sizeof(path) ||
+	    (fd = open(path, O_RDWR)) == -1)
+		return -1;
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = F_WRLCK;
+	fl.l_whence = SEEK_SET;
+	while (fcntl(fd, F_SETLKW, &fl) == -1) {
+		if (errno != EINTR) {
+			close(fd);
+			return -1;
+		}
+	}
+	memset(&b, 0, sizeof(b));
+	if (store_open(&s, dir) == -1) {
+		close(fd);
+		return -1;
+	}
+	if (textidx_open(&idx, dir) == -1)
+		goto end;
+	start = idx.nsegs ? idx.segs[idx.nsegs - 1].end : 0;
+
+	/* remove the segments which are left by an interrupted merge */
+	nseqs = textsegs(dir, &seqs);
+	for (i = 0; i < nseqs; i++) {
+		for (j = 0; j < idx.nsegs && idx.segs[j].seq != seqs[i]; j++)
+			;
+		if (j == idx.nsegs) {
+			snprintf(path, sizeof(path), "%s/text.%lu", dir, seqs[i]);
+			unlink(path);
+		}
+	}
+	free(seqs);
+	textidx_close(&idx);
+
+	if (fstat(s.datafd, &st) == -1)
+		goto end;
+	if ((uint64_t)st.st_size <= start) {
+		ret = 0;
+		goto end;
+	}
+
+	/* the records of the new items, in the order of the data file */
+	for (i = 0; i < s.nruns; i++) {
+		for (j = 0; j < s.runs[i].len; j++) {
+			rec = &(s.runs[i].recs[j]);
+			if (rec->offset < start)
+				continue;
+			if (n + 1 >= size) {
+				size = size ? size * 2 : 1024;
+				if (!(p = realloc(recs, size * sizeof(*p))))
+					err(1, "realloc");
+				recs = p;
+			}
+			recs[n++] = *rec;
+		}
+	}
+	qsort(recs, n, sizeof(*recs), recoffsetcmp);
+
+	for (i = 0, batch = start; i < n; i++) {
+		/* a record can be in two runs when a merge was interrupted */
+		if (i && recs[i].offset == recs[i - 1].offset)
+			continue;
+		if (recs[i].offset - batch >= TEXT_BATCH) {
+			if (buildwrite(dir, segnext(dir), &b, batch,
+			    recs[i].offset) == -1 || segmerge(dir) == -1)
+				goto end;
+			batch = recs[i].offset;
+		}
+		if (store_readline(&s, &recs[i], &line, &linesize) == -1)
+			goto end;
+		parseline(line, fields);
+		b.offset = recs[i].offset;
+		b.feed = recs[i].feed;
+		tokenize(fields[FieldTitle], 0, addterm, &b);
+		tokenize(fields[FieldAuthor], 0, addterm, &b);
+		flags = TEXT_ESCAPED;
+		if (!strcmp(fields[FieldContentType], "html"))
+			flags |= TEXT_HTML;
+		tokenize(fields[FieldContent], flags, addterm, &b);
+	}
+	if (buildwrite(dir, segnext(dir), &b, batch, st.st_size) == -1 ||
+	    segmerge(dir) == -1)
+		goto end;
+	ret = 0;
+end:
+	buildfree(&b);
+	free(recs);
+	free(line);
+	store_close(&s);
+	close(fd); /* releases the lock */
+
+	return ret;
+}
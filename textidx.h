@@ -0,0 +1,51 @@
+#ifndef _TEXTIDX_H
+#define _TEXTIDX_H
+
+#include <stdint.h>
+
+/* longest token in bytes, longer tokens are truncated */
+#define TEXT_MAXTOKEN 64
+
+/* term of a segment, the terms are sorted by their bytes */
+struct textterm {
+	uint64_t str;    /* offset of the term in the strings */
+	uint64_t post;   /* offset of the postings of the term */
+	uint64_t last;   /* offset of the last item of the postings */
+	uint32_t len;    /* length of the term */
+	uint32_t count;  /* amount of postings */
+};
+
+/* segment of the index: the items of a byte range of the data file */
+struct textseg {
+	const struct textterm *terms;
+	size_t                 nterms;
+	const char            *strs;
+	const unsigned char   *posts;
+	uint64_t               postsize;
+	uint64_t               start, end; /* byte range of the data file */
+	unsigned long          seq;
+	void                  *map;
+	size_t                 mapsize;
+};
+
+/* full-text index of a store: the segments ordered by the data */
+struct textidx {
+	struct textseg *segs;
+	size_t          nsegs;
+};
+
+/* item which contains a term */
+struct textpost {
+	uint64_t offset;  /* of the line in the data file */
+	uint32_t feed;
+};
+
+void    textidx_close(struct textidx *);
+ssize_t textidx_find(const struct textidx *, const char *, size_t, int,
+                     struct textpost **);
+int     textidx_open(struct textidx *, const char *);
+void    textidx_tokens(const char *, void (*)(const char *, size_t, void *),
+                       void *);
+int     textidx_update(const char *);
+
+#endif
@@ -1,17 +1,37 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 
 #include <ctype.h>
+#include <dirent.h>
+#include <err.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <time.h>
-#include <wchar.h>
+#include <unistd.h>
 
 #include "util.h"
 
+/* hashfile: magic, amount of hashes, user header, sorted hashes.
+ * The data is in host byte-order, a file from a host with a different
+ * byte-order has a different magic and is not used. */
+#define HASHFILE_MAGIC   0x7366656564686631ULL /* "sfeedhf1" */
+#define HASHFILE_HDRSIZE (6 * sizeof(uint64_t))
+
+/* keyset: open-addressing hash table of keys: magic, amount of slots (a
+ * power of 2), amount of keys, generation, the slots. An empty slot is 0.
+ * The data is in host byte-order. */
+#define KEYSET_MAGIC     0x73666565646b7331ULL /* "sfeedks1" */
+#define KEYSET_HDRSIZE   (4 * sizeof(uint64_t))
+#define KEYSET_MINSLOTS  1024
+
 int
 parseuri(const char *s, struct uri *u, int rel)
 {
@@ -176,94 +196,2219 @@ absuri(char *buf, size_t bufsiz, const char *link, const char *base)
 	return encodeuri(buf, bufsiz, tmp);
 }
 
-/* Read a field-separated line from 'fp',
- * separated by a character 'separator',
- * 'fields' is a list of pointers with a size of FieldLast (must be >0).
- * 'line' buffer is allocated using malloc, 'size' will contain the allocated
- * buffer size.
- * returns: amount of fields read (>0) or -1 on error. */
-size_t
-parseline(char *line, char *fields[FieldLast])
+/* FNV-1a, `h` is HASHINIT or the hash of the preceding data */
+uint64_t
+hashbuf(uint64_t h, const char *s, size_t len)
 {
-	char *prev, *s;
 	size_t i;
 
-	for (prev = line, i = 0;
-	    (s = strchr(prev, '\t')) && i < FieldLast - 1;
-	    i++) {
-		*s = '\0';
-		fields[i] = prev;
-		prev = s + 1;
+	for (i = 0; i < len; i++) {
+		h ^= (unsigned char)s[i];
+		h *= 0x100000001b3ULL;
 	}
-	fields[i++] = prev;
-	/* make non-parsed fields empty. */
-	for (; i < FieldLast; i++)
-		fields[i] = "";
+	return h;
+}
 
-	return i;
+/* Open and map a hashfile.
+ * returns 0 on success or -1 when the file is missing or invalid. */
+int
+hashfile_open(struct hashfile *h, const char *path)
+{
+	struct stat st;
+	uint64_t *p;
+	void *map;
+	int fd;
+
+	memset(h, 0, sizeof(*h));
+	if ((fd = open(path, O_RDONLY)) == -1)
+		return -1;
+	if (fstat(fd, &st) == -1 || st.st_size < (off_t)HASHFILE_HDRSIZE ||
+	    (st.st_size - HASHFILE_HDRSIZE) % sizeof(uint64_t)) {
+		close(fd);
+		return -1;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	p = map;
+	if (p[0] != HASHFILE_MAGIC ||
+	    p[1] != (st.st_size - HASHFILE_HDRSIZE) / sizeof(uint64_t)) {
+		munmap(map, st.st_size);
+		return -1;
+	}
+	h->len = p[1];
+	memcpy(h->hdr, &p[2], sizeof(h->hdr));
+	h->hashes = &p[6];
+	h->map = map;
+	h->mapsize = st.st_size;
+
+	return 0;
 }
 
-/* Parse time to time_t, assumes time_t is signed, ignores fractions. */
+void
+hashfile_close(struct hashfile *h)
+{
+	if (h->map)
+		munmap(h->map, h->mapsize);
+	memset(h, 0, sizeof(*h));
+}
+
+/* binary search, returns 1 if the hash is in the set or 0 if it is not. */
 int
-strtotime(const char *s, time_t *t)
+hashfile_find(const struct hashfile *h, uint64_t v)
 {
-	long long l;
-	char *e;
+	size_t lo = 0, hi = h->len, m;
 
-	errno = 0;
-	l = strtoll(s, &e, 10);
-	if (errno || *s == '\0' || *e)
+	while (lo < hi) {
+		m = lo + (hi - lo) / 2;
+		if (v < h->hashes[m])
+			hi = m;
+		else if (v > h->hashes[m])
+			lo = m + 1;
+		else
+			return 1;
+	}
+	return 0;
+}
+
+static int
+hashcmp(const void *v1, const void *v2)
+{
+	uint64_t h1 = *(const uint64_t *)v1, h2 = *(const uint64_t *)v2;
+
+	return h1 < h2 ? -1 : h1 > h2;
+}
+
+/* Write the hashes of `old` (can be NULL) and `add` with the header data
+ * `hdr` to the file `path`. `add` is sorted in-place, duplicate hashes are
+ * written once. The file is written to a temporary file first and then
+ * renamed, so it is replaced atomically.
+ * returns 0 on success or -1 on error. */
+int
+hashfile_write(const char *path, const struct hashfile *old, uint64_t *add,
+	size_t addlen, const uint64_t hdr[4])
+{
+	char tmppath[PATH_MAX];
+	FILE *fp;
+	uint64_t v, prev = 0, head[2];
+	size_t i = 0, j = 0, n = 0, oldlen = old ? old->len : 0;
+	int fd, r;
+
+	r = snprintf(tmppath, sizeof(tmppath), "%s.XXXXXX", path);
+	if (r < 0 || (size_t)r >= sizeof(tmppath))
 		return -1;
-	/* NOTE: assumes time_t is 64-bit on 64-bit platforms:
-	         long long (atleast 32-bit) to time_t. */
-	if (t)
-		*t = (time_t)l;
+	if ((fd = mkstemp(tmppath)) == -1)
+		return -1;
+	if (!(fp = fdopen(fd, "wb"))) {
+		close(fd);
+		unlink(tmppath);
+		return -1;
+	}
+
+	qsort(add, addlen, sizeof(*add), hashcmp);
+
+	/* the amount is written after the hashes are merged */
+	head[0] = HASHFILE_MAGIC;
+	head[1] = 0;
+	fwrite(head, sizeof(head), 1, fp);
+	fwrite(hdr, sizeof(uint64_t), 4, fp);
+	while (i < oldlen || j < addlen) {
+		if (j >= addlen || (i < oldlen && old->hashes[i] <= add[j]))
+			v = old->hashes[i++];
+		else
+			v = add[j++];
+		if (n && v == prev)
+			continue;
+		fwrite(&v, sizeof(v), 1, fp);
+		prev = v;
+		n++;
+	}
+	head[1] = n;
+	r = (fflush(fp) || ferror(fp) || fseek(fp, 0, SEEK_SET) == -1 ||
+	     fwrite(head, sizeof(head), 1, fp) != 1 || fflush(fp)) ? -1 : 0;
+	if (fclose(fp) == EOF)
+		r = -1;
+	if (r == -1 || rename(tmppath, path) == -1) {
+		unlink(tmppath);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* key of an item in a keyset: the hash of its link or of its id if it has no
+   link, never 0 */
+uint64_t
+keyset_itemkey(const char *link, const char *id)
+{
+	const char *s = link[0] ? link : id;
+	uint64_t key;
+
+	key = hashbuf(HASHINIT, s, strlen(s));
+
+	return key ? key : 1;
+}
+
+/* first slot of a key in a table with `mask` + 1 slots */
+static uint64_t
+keyset_slot(uint64_t key, uint64_t mask)
+{
+	return (key ^ (key >> 29) ^ (key >> 47)) & mask;
+}
+
+static int
+keyset_valid(const uint64_t *p, off_t size)
+{
+	return size >= (off_t)KEYSET_HDRSIZE && p[0] == KEYSET_MAGIC &&
+	       p[1] && !(p[1] & (p[1] - 1)) &&
+	       (off_t)(KEYSET_HDRSIZE + p[1] * sizeof(uint64_t)) == size;
+}
+
+/* Open and map a keyset read-only: a lookup reads one or a few slots of the
+ * mapping, the set is not read into memory.
+ * returns 0 on success or -1 when the file is missing or invalid. */
+int
+keyset_open(struct keyset *k, const char *path)
+{
+	struct stat st;
+	uint64_t *p;
+	void *map;
+	int fd;
+
+	memset(k, 0, sizeof(*k));
+	if ((fd = open(path, O_RDONLY)) == -1)
+		return -1;
+	if (fstat(fd, &st) == -1 || st.st_size < (off_t)KEYSET_HDRSIZE) {
+		close(fd);
+		return -1;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	p = map;
+	if (!keyset_valid(p, st.st_size)) {
+		munmap(map, st.st_size);
+		return -1;
+	}
+	k->mask = p[1] - 1;
+	k->gen = p[3];
+	k->slots = &p[4];
+	k->map = map;
+	k->mapsize = st.st_size;
 
 	return 0;
 }
 
-/* Escape characters below as HTML 2.0 / XML 1.0. */
 void
-xmlencode(const char *s, FILE *fp)
+keyset_close(struct keyset *k)
 {
-	for (; *s; ++s) {
-		switch (*s) {
-		case '<':  fputs("&lt;",   fp); break;
-		case '>':  fputs("&gt;",   fp); break;
-		case '\'': fputs("&#39;",  fp); break;
-		case '&':  fputs("&amp;",  fp); break;
-		case '"':  fputs("&quot;", fp); break;
-		default:   fputc(*s, fp);
+	if (k->map)
+		munmap(k->map, k->mapsize);
+	memset(k, 0, sizeof(*k));
+}
+
+/* returns 1 if the key is in the set or 0 if it is not. */
+int
+keyset_find(const struct keyset *k, uint64_t key)
+{
+	uint64_t i;
+
+	if (!k->slots)
+		return 0;
+	for (i = keyset_slot(key, k->mask); k->slots[i]; i = (i + 1) & k->mask) {
+		if (k->slots[i] == key)
+			return 1;
+	}
+	return 0;
+}
+
+/* add a key to the slots, returns 1 if it is added or 0 if it was in it */
+static int
+keyset_insert(uint64_t *slots, uint64_t mask, uint64_t key)
+{
+	uint64_t i;
+
+	for (i = keyset_slot(key, mask); slots[i]; i = (i + 1) & mask) {
+		if (slots[i] == key)
+			return 0;
+	}
+	slots[i] = key;
+
+	return 1;
+}
+
+/* Write a new table with the keys of `old` (can be NULL) except the sorted
+ * keys `del`, and the keys `add`: it is written in a mapping of a temporary
+ * file which is renamed to `path`.
+ * returns 0 on success or -1 on error. */
+static int
+keyset_rebuild(const char *path, const uint64_t *old, const uint64_t *add,
+	size_t nadd, const uint64_t *del, size_t ndel)
+{
+	char tmppath[PATH_MAX];
+	uint64_t *p, *slots, nslots, count = 0, mask, i;
+	size_t size, j;
+	void *map;
+	int fd, r;
+
+	/* at most a quarter of the slots is used after a rebuild, the table
+	   grows when half of the slots are used */
+	for (nslots = KEYSET_MINSLOTS;
+	     nslots < 4 * ((old ? old[2] : 0) + nadd); nslots *= 2)
+		;
+	size = KEYSET_HDRSIZE + nslots * sizeof(uint64_t);
+
+	r = snprintf(tmppath, sizeof(tmppath), "%s.XXXXXX", path);
+	if (r < 0 || (size_t)r >= sizeof(tmppath))
+		return -1;
+	if ((fd = mkstemp(tmppath)) == -1)
+		return -1;
+	if (ftruncate(fd, size) == -1 ||
+	    (map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+	    0)) == MAP_FAILED) {
+		close(fd);
+		unlink(tmppath);
+		return -1;
+	}
+	p = map;
+	slots = &p[4];
+	mask = nslots - 1;
+	if (old) {
+		for (i = 0; i < old[1]; i++) {
+			if (old[4 + i] && !(ndel && bsearch(&old[4 + i], del, ndel,
+			    sizeof(*del), hashcmp)))
+				count += keyset_insert(slots, mask, old[4 + i]);
 		}
 	}
+	for (j = 0; j < nadd; j++)
+		count += keyset_insert(slots, mask, add[j]);
+	p[0] = KEYSET_MAGIC;
+	p[1] = nslots;
+	p[2] = count;
+	p[3] = old ? old[3] + 1 : 1;
+
+	munmap(map, size);
+	if (close(fd) == -1 || rename(tmppath, path) == -1) {
+		unlink(tmppath);
+		return -1;
+	}
+	return 0;
 }
 
-/* print `len' columns of characters. If string is shorter pad the rest with
- * characters `pad`. */
+/* Add the keys `add` to and remove the keys `del` from the keyset `path`, a
+ * missing file is an empty set. The file is locked while it is updated.
+ * Added keys are written in place, each slot at once, so a reader sees the
+ * set before or after each key. When the table is half full or keys are
+ * removed a new table is written and renamed. `del` is sorted in-place.
+ * returns 0 on success or -1 on error. */
+int
+keyset_update(const char *path, const uint64_t *add, size_t nadd,
+	uint64_t *del, size_t ndel)
+{
+	struct stat st, pst;
+	struct flock fl;
+	uint64_t *p = NULL;
+	size_t i;
+	int fd, r = -1;
+
+	/* lock the file, it can be replaced while it is waited on */
+	for (;;) {
+		if ((fd = open(path, O_RDWR | O_CREAT, 0666)) == -1)
+			return -1;
+		memset(&fl, 0, sizeof(fl));
+		fl.l_type = F_WRLCK;
+		fl.l_whence = SEEK_SET;
+		while (fcntl(fd, F_SETLKW, &fl) == -1) {
+			if (errno != EINTR) {
+				close(fd);
+				return -1;
+			}
+		}
+		if (fstat(fd, &st) == -1) {
+			close(fd);
+			return -1;
+		}
+		if (stat(path, &pst) == 0 && pst.st_dev == st.st_dev &&
+		    pst.st_ino == st.st_ino)
+			break;
+		close(fd);
+	}
+
+	/* a new file is empty, an invalid file is not replaced */
+	if (st.st_size) {
+		p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (p == MAP_FAILED)
+			goto end;
+		if (!keyset_valid(p, st.st_size)) {
+			munmap(p, st.st_size);
+			goto end;
+		}
+	}
+
+	if (ndel)
+		qsort(del, ndel, sizeof(*del), hashcmp);
+	if (!p || ndel || 2 * (p[2] + nadd) > p[1]) {
+		r = keyset_rebuild(path, p, add, nadd, del, ndel);
+	} else {
+		for (i = 0; i < nadd; i++)
+			p[2] += keyset_insert(&p[4], p[1] - 1, add[i]);
+		p[3]++;
+		r = 0;
+	}
+	if (p)
+		munmap(p, st.st_size);
+end:
+	close(fd); /* releases the lock */
+
+	return r;
+}
+
+/* Initialize an in-memory set of hashes for about `n` hashes: the table
+ * grows when it is half full. */
 void
-printutf8pad(FILE *fp, const char *s, size_t len, int pad)
+hashset_init(struct hashset *s, size_t n)
 {
-	wchar_t wc;
-	size_t col = 0, i, slen;
-	int rl, w;
+	size_t size;
 
-	if (!len)
-		return;
+	for (size = 64; size < 2 * n; size *= 2)
+		;
+	if (!(s->slots = calloc(size, sizeof(*s->slots))))
+		err(1, "calloc");
+	s->mask = size - 1;
+	s->len = 0;
+}
 
-	slen = strlen(s);
-	for (i = 0; i < slen; i += rl) {
-		if ((rl = mbtowc(&wc, s + i, slen - i < 4 ? slen - i : 4)) <= 0)
-			break;
-		if ((w = wcwidth(wc)) == -1)
-			continue;
-		if (col + w > len || (col + w == len && s[i + rl])) {
-			fputs("\xe2\x80\xa6", fp);
-			col++;
+/* Add a hash to the set.
+ * returns 1 if it is added or 0 if it was in the set. */
+int
+hashset_add(struct hashset *s, uint64_t h)
+{
+	uint64_t *old;
+	size_t i, oldsize;
+
+	if (!h)
+		h = 1; /* 0 is an empty slot */
+	if (2 * (s->len + 1) > s->mask + 1) {
+		old = s->slots;
+		oldsize = s->mask + 1;
+		if (!(s->slots = calloc(2 * oldsize, sizeof(*s->slots))))
+			err(1, "calloc");
+		s->mask = 2 * oldsize - 1;
+		for (i = 0; i < oldsize; i++) {
+			if (old[i])
+				keyset_insert(s->slots, s->mask, old[i]);
+		}
+		free(old);
+	}
+	if (!keyset_insert(s->slots, s->mask, h))
+		return 0;
+	s->len++;
+
+	return 1;
+}
+
+void
+hashset_clear(struct hashset *s)
+{
+	memset(s->slots, 0, (s->mask + 1) * sizeof(*s->slots));
+	s->len = 0;
+}
+
+/* Hash of the normalized link of an item, or of its id if it has no link:
+ * the scheme, a "www." prefix and default port of the host, a trailing '/'
+ * of the path, the utm_ tracking parameters of the query and the fragment
+ * are ignored and the host is compared case-insensitively. */
+uint64_t
+linkkey(const char *link, const char *id)
+{
+	const char *s = link, *e, *hostend;
+	uint64_t h;
+	char c;
+
+	if (!link[0])
+		return hashbuf(hashbuf(HASHINIT, "i", 1), id, strlen(id));
+	h = hashbuf(HASHINIT, "l", 1);
+
+	if ((e = strstr(s, "://")) && (size_t)(e - s) == strcspn(s, ":/?#"))
+		s = e + 3;
+	hostend = s + strcspn(s, "/?#");
+	if (hostend - s > 4 && !strncasecmp(s, "www.", 4))
+		s += 4;
+	e = hostend;
+	if (e - s > 3 && !memcmp(e - 3, ":80", 3))
+		e -= 3;
+	else if (e - s > 4 && !memcmp(e - 4, ":443", 4))
+		e -= 4;
+	for (; s < e; s++) {
+		c = tolower((unsigned char)*s);
+		h = hashbuf(h, &c, 1);
+	}
+
+	s = hostend;
+	e = s + strcspn(s, "?#");
+	for (hostend = e; hostend > s && hostend[-1] == '/'; hostend--)
+		;
+	h = hashbuf(h, s, hostend - s);
+
+	for (s = e; *s == '?' || *s == '&'; s = e) {
+		s++;
+		e = s + strcspn(s, "&#");
+		if (e > s && strncmp(s, "utm_", 4)) {
+			h = hashbuf(h, "&", 1);
+			h = hashbuf(h, s, e - s);
+		}
+	}
+	return h;
+}
+
+/* time index of a feed file: magic, size of the feed file, amount of
+ * entries and per line the timestamp and offset. The data is in host
+ * byte-order. */
+#define FEEDIDX_MAGIC   0x7366656564697831ULL /* "sfeedix1" */
+#define FEEDIDX_HDRSIZE (3 * sizeof(uint64_t))
+
+/* path of the time index of a feed file: .name.idx in the same directory.
+ * returns 0 on success or -1 if the path is too long. */
+int
+feedidx_path(char *buf, size_t bufsiz, const char *feedpath)
+{
+	const char *name;
+	int r;
+
+	if ((name = strrchr(feedpath, '/')))
+		r = snprintf(buf, bufsiz, "%.*s/.%s.idx",
+		             (int)(name - feedpath), feedpath, name + 1);
+	else
+		r = snprintf(buf, bufsiz, ".%s.idx", feedpath);
+
+	return (r < 0 || (size_t)r >= bufsiz) ? -1 : 0;
+}
+
+/* Open the time index of the feed file `feedpath` which is opened as `fd`.
+ * The index is stale if the size of the feed file differs or the feed file
+ * is modified after the index was written.
+ * returns 0 on success or -1 if there is no valid index. */
+int
+feedidx_open(struct feedidx *x, const char *feedpath, int fd)
+{
+	char path[PATH_MAX];
+	struct stat st, ist;
+	uint64_t *p;
+	void *map;
+	int ifd;
+
+	memset(x, 0, sizeof(*x));
+	if (feedidx_path(path, sizeof(path), feedpath) == -1 ||
+	    fstat(fd, &st) == -1 || !S_ISREG(st.st_mode))
+		return -1;
+	if ((ifd = open(path, O_RDONLY)) == -1)
+		return -1;
+	if (fstat(ifd, &ist) == -1 || ist.st_size < (off_t)FEEDIDX_HDRSIZE ||
+	    (ist.st_size - FEEDIDX_HDRSIZE) % sizeof(struct feedidxent) ||
+	    st.st_mtim.tv_sec > ist.st_mtim.tv_sec ||
+	    (st.st_mtim.tv_sec == ist.st_mtim.tv_sec &&
+	    st.st_mtim.tv_nsec > ist.st_mtim.tv_nsec)) {
+		close(ifd);
+		return -1;
+	}
+	map = mmap(NULL, ist.st_size, PROT_READ, MAP_SHARED, ifd, 0);
+	close(ifd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	p = map;
+	if (p[0] != FEEDIDX_MAGIC || p[1] != (uint64_t)st.st_size ||
+	    p[2] != (ist.st_size - FEEDIDX_HDRSIZE) / sizeof(struct feedidxent)) {
+		munmap(map, ist.st_size);
+		return -1;
+	}
+	x->size = p[1];
+	x->len = p[2];
+	x->ents = (const struct feedidxent *)&p[3];
+	x->map = map;
+	x->mapsize = ist.st_size;
+
+	return 0;
+}
+
+void
+feedidx_close(struct feedidx *x)
+{
+	if (x->map)
+		munmap(x->map, x->mapsize);
+	memset(x, 0, sizeof(*x));
+}
+
+/* Find the byte range from `start` to `end` of the lines with a timestamp
+ * from `from` to `to` (inclusive): the lines are ordered by timestamp
+ * (newest first), so it is a binary search for both ends. */
+void
+feedidx_range(const struct feedidx *x, long long from, long long to,
+	uint64_t *start, uint64_t *end)
+{
+	size_t lo, hi, m;
+
+	/* first line with a timestamp <= to */
+	for (lo = 0, hi = x->len; lo < hi; ) {
+		m = lo + (hi - lo) / 2;
+		if (x->ents[m].timestamp > to)
+			lo = m + 1;
+		else
+			hi = m;
+	}
+	*start = lo < x->len ? x->ents[lo].offset : x->size;
+
+	/* first line with a timestamp < from */
+	for (hi = x->len; lo < hi; ) {
+		m = lo + (hi - lo) / 2;
+		if (x->ents[m].timestamp >= from)
+			lo = m + 1;
+		else
+			hi = m;
+	}
+	*end = lo < x->len ? x->ents[lo].offset : x->size;
+}
+
+/* Write the time index with the entries `ents` of a feed file with size
+ * `size` to `path`. The file is written to a temporary file first and then
+ * renamed.
+ * returns 0 on success or -1 on error. */
+int
+feedidx_write(const char *path, const struct feedidxent *ents, size_t len,
+	uint64_t size)
+{
+	char tmppath[PATH_MAX];
+	uint64_t hdr[3];
+	FILE *fp;
+	int fd, r;
+
+	r = snprintf(tmppath, sizeof(tmppath), "%s.XXXXXX", path);
+	if (r < 0 || (size_t)r >= sizeof(tmppath))
+		return -1;
+	if ((fd = mkstemp(tmppath)) == -1)
+		return -1;
+	if (!(fp = fdopen(fd, "wb"))) {
+		close(fd);
+		unlink(tmppath);
+		return -1;
+	}
+	hdr[0] = FEEDIDX_MAGIC;
+	hdr[1] = size;
+	hdr[2] = len;
+	fwrite(hdr, sizeof(hdr), 1, fp);
+	fwrite(ents, sizeof(*ents), len, fp);
+	r = (fflush(fp) || ferror(fp)) ? -1 : 0;
+	if (fclose(fp) == EOF)
+		r = -1;
+	if (r == -1 || rename(tmppath, path) == -1) {
+		unlink(tmppath);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+ulongcmp(const void *v1, const void *v2)
+{
+	unsigned long l1 = *(const unsigned long *)v1;
+	unsigned long l2 = *(const unsigned long *)v2;
+
+	return l1 < l2 ? -1 : l1 > l2;
+}
+
+static int
+writeall(int fd, const char *buf, size_t len)
+{
+	ssize_t n;
+	size_t off;
+
+	for (off = 0; off < len; off += n) {
+		if ((n = write(fd, buf + off, len - off)) == -1) {
+			if (errno != EINTR)
+				return -1;
+			n = 0;
+		}
+	}
+	return 0;
+}
+
+/* returns the amount of bytes read: less than `len` only at EOF, or -1 */
+static ssize_t
+readall(int fd, char *buf, size_t len)
+{
+	ssize_t n;
+	size_t off;
+
+	for (off = 0; off < len; off += n) {
+		if ((n = read(fd, buf + off, len - off)) == -1) {
+			if (errno != EINTR)
+				return -1;
+			n = 0;
+		} else if (n == 0) {
 			break;
 		}
-		fwrite(&s[i], 1, rl, fp);
-		col += w;
 	}
-	for (; col < len; ++col)
-		putc(pad, fp);
+	return off;
+}
+
+/* store: sorted run of records: magic, amount of records, the records
+ * ordered by timestamp, offset and the indices of the records ordered by
+ * feed, timestamp, offset. The data is in host byte-order. */
+#define STORE_MAGIC   0x7366656564737431ULL /* "sfeedst1" */
+#define STORE_HDRSIZE (2 * sizeof(uint64_t))
+#define STORE_RUNSIZE(n) (STORE_HDRSIZE + (n) * sizeof(struct storerec) + \
+                          (n) * sizeof(uint32_t))
+
+/* records of the run which is sorted by storebyfeedcmp() */
+static const struct storerec *storesortrecs;
+
+static int
+storereccmp(const void *v1, const void *v2)
+{
+	const struct storerec *r1 = v1, *r2 = v2;
+
+	if (r1->timestamp != r2->timestamp)
+		return r1->timestamp < r2->timestamp ? -1 : 1;
+	return r1->offset < r2->offset ? -1 : r1->offset > r2->offset;
+}
+
+static int
+storebyfeedcmp(const void *v1, const void *v2)
+{
+	const struct storerec *r1 = &storesortrecs[*(const uint32_t *)v1];
+	const struct storerec *r2 = &storesortrecs[*(const uint32_t *)v2];
+
+	if (r1->feed != r2->feed)
+		return r1->feed < r2->feed ? -1 : 1;
+	return storereccmp(r1, r2);
+}
+
+/* newest first, the records of a query */
+static int
+storereccmpdesc(const void *v1, const void *v2)
+{
+	return storereccmp(v2, v1);
+}
+
+/* the sequence numbers of the runs in the directory, sorted */
+static size_t
+storeruns(const char *dir, unsigned long **seqs)
+{
+	struct dirent *d;
+	DIR *dp;
+	unsigned long seq, *p;
+	size_t n = 0, size = 0;
+	char *e;
+
+	*seqs = NULL;
+	if (!(dp = opendir(dir)))
+		return 0;
+	while ((d = readdir(dp))) {
+		if (strncmp(d->d_name, "index.", 6))
+			continue;
+		errno = 0;
+		seq = strtoul(d->d_name + 6, &e, 10);
+		if (errno || e == d->d_name + 6 || *e)
+			continue;
+		if (n + 1 >= size) {
+			size = size ? size * 2 : 16;
+			if (!(p = realloc(*seqs, size * sizeof(*p)))) {
+				free(*seqs);
+				*seqs = NULL;
+				closedir(dp);
+				return 0;
+			}
+			*seqs = p;
+		}
+		(*seqs)[n++] = seq;
+	}
+	closedir(dp);
+	qsort(*seqs, n, sizeof(**seqs), ulongcmp);
+
+	return n;
+}
+
+static int
+storerunopen(struct storerun *r, const char *dir, unsigned long seq)
+{
+	char path[PATH_MAX];
+	struct stat st;
+	uint64_t *p;
+	void *map;
+	int fd;
+
+	memset(r, 0, sizeof(*r));
+	if (snprintf(path, sizeof(path), "%s/index.%lu", dir, seq) >= (int)sizeof(path))
+		return -1;
+	if ((fd = open(path, O_RDONLY)) == -1)
+		return -1;
+	if (fstat(fd, &st) == -1 || st.st_size < (off_t)STORE_HDRSIZE) {
+		close(fd);
+		return -1;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	p = map;
+	if (p[0] != STORE_MAGIC || (off_t)STORE_RUNSIZE(p[1]) != st.st_size) {
+		munmap(map, st.st_size);
+		return -1;
+	}
+	r->len = p[1];
+	r->recs = (const struct storerec *)&p[2];
+	r->byfeed = (const uint32_t *)(r->recs + r->len);
+	r->map = map;
+	r->mapsize = st.st_size;
+	r->seq = seq;
+
+	return 0;
+}
+
+static void
+storerunclose(struct storerun *r)
+{
+	if (r->map)
+		munmap(r->map, r->mapsize);
+	memset(r, 0, sizeof(*r));
+}
+
+/* write a run: `recs` is sorted in-place. The file is written to a temporary
+ * file first and then renamed. */
+static int
+storerunwrite(const char *dir, unsigned long seq, struct storerec *recs,
+	size_t n)
+{
+	char path[PATH_MAX], tmppath[PATH_MAX];
+	uint64_t hdr[2];
+	uint32_t *byfeed;
+	size_t i;
+	FILE *fp;
+	int fd, r;
+
+	if (snprintf(path, sizeof(path), "%s/index.%lu", dir, seq) >= (int)sizeof(path) ||
+	    snprintf(tmppath, sizeof(tmppath), "%s.XXXXXX", path) >= (int)sizeof(tmppath))
+		return -1;
+
+	qsort(recs, n, sizeof(*recs), storereccmp);
+	if (!(byfeed = calloc(n ? n : 1, sizeof(*byfeed))))
+		return -1;
+	for (i = 0; i < n; i++)
+		byfeed[i] = i;
+	storesortrecs = recs;
+	qsort(byfeed, n, sizeof(*byfeed), storebyfeedcmp);
+
+	if ((fd = mkstemp(tmppath)) == -1) {
+		free(byfeed);
+		return -1;
+	}
+	if (!(fp = fdopen(fd, "wb"))) {
+		close(fd);
+		unlink(tmppath);
+		free(byfeed);
+		return -1;
+	}
+	hdr[0] = STORE_MAGIC;
+	hdr[1] = n;
+	fwrite(hdr, sizeof(hdr), 1, fp);
+	fwrite(recs, sizeof(*recs), n, fp);
+	fwrite(byfeed, sizeof(*byfeed), n, fp);
+	free(byfeed);
+	r = (fflush(fp) || ferror(fp)) ? -1 : 0;
+	if (fclose(fp) == EOF)
+		r = -1;
+	if (r == -1 || rename(tmppath, path) == -1) {
+		unlink(tmppath);
+		return -1;
+	}
+	return 0;
+}
+
+/* read the feed names, one per line: the line number is the feed id */
+static int
+storereadfeeds(FILE *fp, char ***feeds, size_t *nfeeds)
+{
+	char *line = NULL, **p;
+	size_t linesize = 0, size = 0;
+	ssize_t n;
+
+	*feeds = NULL;
+	*nfeeds = 0;
+	while ((n = getline(&line, &linesize, fp)) > 0) {
+		if (line[n - 1] == '\n')
+			line[--n] = '\0';
+		if (*nfeeds + 1 >= size) {
+			size = size ? size * 2 : 64;
+			if (!(p = realloc(*feeds, size * sizeof(*p))))
+				goto fail;
+			*feeds = p;
+		}
+		if (!((*feeds)[*nfeeds] = strdup(line)))
+			goto fail;
+		(*nfeeds)++;
+	}
+	free(line);
+	return ferror(fp) ? -1 : 0;
+fail:
+	free(line);
+	return -1;
+}
+
+/* Open the store in directory `dir` for reading: the data file, the feed
+ * names and the runs of the index are mapped.
+ * returns 0 on success or -1 on error. */
+int
+store_open(struct store *s, const char *dir)
+{
+	char path[PATH_MAX];
+	unsigned long *seqs;
+	size_t i, n;
+	FILE *fp;
+
+	memset(s, 0, sizeof(*s));
+	s->datafd = -1;
+	if (snprintf(path, sizeof(path), "%s/feeds", dir) >= (int)sizeof(path))
+		return -1;
+	if (!(fp = fopen(path, "r")))
+		return -1;
+	if (storereadfeeds(fp, &(s->feeds), &(s->nfeeds)) == -1) {
+		fclose(fp);
+		store_close(s);
+		return -1;
+	}
+	fclose(fp);
+
+	if (snprintf(path, sizeof(path), "%s/data", dir) >= (int)sizeof(path) ||
+	    (s->datafd = open(path, O_RDONLY)) == -1) {
+		store_close(s);
+		return -1;
+	}
+
+	/* a run which is not complete is skipped */
+	n = storeruns(dir, &seqs);
+	if (n && !(s->runs = calloc(n, sizeof(*s->runs)))) {
+		free(seqs);
+		store_close(s);
+		return -1;
+	}
+	for (i = 0; i < n; i++) {
+		if (storerunopen(&(s->runs[s->nruns]), dir, seqs[i]) == 0)
+			s->nruns++;
+	}
+	free(seqs);
+
+	return 0;
+}
+
+void
+store_close(struct store *s)
+{
+	size_t i;
+
+	for (i = 0; i < s->nruns; i++)
+		storerunclose(&(s->runs[i]));
+	free(s->runs);
+	for (i = 0; i < s->nfeeds; i++)
+		free(s->feeds[i]);
+	free(s->feeds);
+	if (s->datafd != -1)
+		close(s->datafd);
+	memset(s, 0, sizeof(*s));
+	s->datafd = -1;
+}
+
+/* returns the id of the feed with name `name` or -1 if it is not found */
+long
+store_findfeed(const struct store *s, const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < s->nfeeds; i++) {
+		if (!strcmp(s->feeds[i], name))
+			return i;
+	}
+	return -1;
+}
+
+/* Query the records with a timestamp from `from` to `to` (inclusive) of the
+ * feed with id `feed` or all feeds if it is -1: a binary search per run. The
+ * records are allocated in `recs` and ordered newest first.
+ * returns the amount of records or -1 on error. */
+ssize_t
+store_query(const struct store *s, long feed, long long from, long long to,
+	struct storerec **recs)
+{
+	const struct storerun *r;
+	const struct storerec *rec;
+	struct storerec *p;
+	size_t i, j, lo, hi, m, n = 0, size = 0;
+
+	*recs = NULL;
+	for (i = 0; i < s->nruns; i++) {
+		r = &(s->runs[i]);
+		/* first record with timestamp >= from (of the feed) */
+		for (lo = 0, hi = r->len; lo < hi; ) {
+			m = lo + (hi - lo) / 2;
+			rec = feed == -1 ? &(r->recs[m]) : &(r->recs[r->byfeed[m]]);
+			if ((feed != -1 && rec->feed < (uint32_t)feed) ||
+			    ((feed == -1 || rec->feed == (uint32_t)feed) &&
+			    rec->timestamp < from))
+				lo = m + 1;
+			else
+				hi = m;
+		}
+		for (j = lo; j < r->len; j++) {
+			rec = feed == -1 ? &(r->recs[j]) : &(r->recs[r->byfeed[j]]);
+			if ((feed != -1 && rec->feed != (uint32_t)feed) ||
+			    rec->timestamp > to)
+				break;
+			if (n + 1 >= size) {
+				size = size ? size * 2 : 1024;
+				if (!(p = realloc(*recs, size * sizeof(*p)))) {
+					free(*recs);
+					*recs = NULL;
+					return -1;
+				}
+				*recs = p;
+			}
+			(*recs)[n++] = *rec;
+		}
+	}
+	qsort(*recs, n, sizeof(**recs), storereccmpdesc);
+
+	/* a record can be in two runs when a merge of runs was interrupted */
+	for (i = 0, j = 0; i < n; i++) {
+		if (!j || (*recs)[i].offset != (*recs)[j - 1].offset)
+			(*recs)[j++] = (*recs)[i];
+	}
+	return j;
+}
+
+/* Read the line of record `rec` in `line` (without newline), the buffer is
+ * allocated and resized when needed.
+ * returns 0 on success or -1 on error. */
+int
+store_readline(const struct store *s, const struct storerec *rec, char **line,
+	size_t *linesize)
+{
+	ssize_t n;
+	size_t off;
+	char *p;
+
+	if (rec->length + 1 > *linesize) {
+		if (!(p = realloc(*line, rec->length + 1)))
+			return -1;
+		*line = p;
+		*linesize = rec->length + 1;
+	}
+	for (off = 0; off < rec->length; off += n) {
+		n = pread(s->datafd, *line + off, rec->length - off,
+		          (off_t)(rec->offset + off));
+		if (n == -1 && errno == EINTR)
+			n = 0;
+		else if (n <= 0)
+			return -1;
+	}
+	(*line)[rec->length] = '\0';
+
+	return 0;
+}
+
+/* Append the feed data (TSV) `data` of feed `name` to the store in the
+ * directory `dir`: the lines are appended to the data file and a new run
+ * of the index is written. The last runs are merged while a run is not
+ * larger than half of the run before it, so the amount of runs stays
+ * logarithmic. The store is locked while it is written.
+ * returns 0 on success or -1 on error. */
+int
+store_append(const char *dir, const char *name, const char *data, size_t len)
+{
+	struct storerun r1, r2;
+	struct storerec *recs = NULL, *p;
+	struct flock fl;
+	unsigned long *seqs = NULL;
+	char path[PATH_MAX], **feeds = NULL;
+	const char *s, *e;
+	size_t i, n = 0, size = 0, nfeeds = 0, nseqs;
+	off_t base;
+	long feed = -1;
+	int fd = -1, datafd = -1, ret = -1;
+	FILE *fp = NULL;
+
+	if (mkdir(dir, 0777) == -1 && errno != EEXIST)
+		return -1;
+
+	/* the feeds file is the lock of the store */
+	if (snprintf(path, sizeof(path), "%s/feeds", dir) >= (int)sizeof(path) ||
+	    (fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0666)) == -1)
+		return -1;
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = F_WRLCK;
+	fl.l_whence = SEEK_SET;
+	while (fcntl(fd, F_SETLKW, &fl) == -1) {
+		if (errno != EINTR)
+			goto end;
+	}
+	if (!(fp = fdopen(fd, "r+")))
+		goto end;
+	fd = -1;
+	if (storereadfeeds(fp, &feeds, &nfeeds) == -1)
+		goto end;
+	for (i = 0; i < nfeeds; i++) {
+		if (!strcmp(feeds[i], name))
+			feed = i;
+	}
+	if (feed == -1) {
+		if (fprintf(fp, "%s\n", name) < 0 || fflush(fp))
+			goto end;
+		feed = nfeeds;
+	}
+
+	if (snprintf(path, sizeof(path), "%s/data", dir) >= (int)sizeof(path) ||
+	    (datafd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0666)) == -1 ||
+	    (base = lseek(datafd, 0, SEEK_END)) == -1)
+		goto end;
+
+	for (s = data; s < data + len; s = e + 1) {
+		if (!(e = memchr(s, '\n', data + len - s)))
+			e = data + len;
+		if (e == s)
+			continue;
+		if (n + 1 >= size) {
+			size = size ? size * 2 : 256;
+			if (!(p = realloc(recs, size * sizeof(*p))))
+				goto end;
+			recs = p;
+		}
+		recs[n].timestamp = strtoll(s, NULL, 10);
+		recs[n].offset = base + (s - data);
+		recs[n].length = e - s;
+		recs[n].feed = feed;
+		n++;
+	}
+	if (!n) {
+		ret = 0;
+		goto end;
+	}
+	if (writeall(datafd, data, len) == -1 ||
+	    (data[len - 1] != '\n' && writeall(datafd, "\n", 1) == -1) ||
+	    close(datafd) == -1) {
+		datafd = -1;
+		goto end;
+	}
+	datafd = -1;
+
+	nseqs = storeruns(dir, &seqs);
+	if (storerunwrite(dir, nseqs ? seqs[nseqs - 1] + 1 : 1, recs, n) == -1)
+		goto end;
+	free(seqs);
+	nseqs = storeruns(dir, &seqs);
+
+	/* merge the last two runs into a new run, then remove them */
+	while (nseqs >= 2) {
+		if (storerunopen(&r1, dir, seqs[nseqs - 2]) == -1)
+			break;
+		if (storerunopen(&r2, dir, seqs[nseqs - 1]) == -1) {
+			storerunclose(&r1);
+			break;
+		}
+		if (r1.len > 2 * r2.len) {
+			storerunclose(&r1);
+			storerunclose(&r2);
+			break;
+		}
+		if (r1.len + r2.len > size) {
+			size = r1.len + r2.len;
+			if (!(p = realloc(recs, size * sizeof(*p)))) {
+				storerunclose(&r1);
+				storerunclose(&r2);
+				goto end;
+			}
+			recs = p;
+		}
+		memcpy(recs, r1.recs, r1.len * sizeof(*recs));
+		memcpy(recs + r1.len, r2.recs, r2.len * sizeof(*recs));
+		n = r1.len + r2.len;
+		storerunclose(&r1);
+		storerunclose(&r2);
+		if (storerunwrite(dir, seqs[nseqs - 1] + 1, recs, n) == -1)
+			goto end;
+		for (i = nseqs - 2; i < nseqs; i++) {
+			snprintf(path, sizeof(path), "%s/index.%lu", dir, seqs[i]);
+			unlink(path);
+		}
+		seqs[nseqs - 2] = seqs[nseqs - 1] + 1;
+		nseqs--;
+	}
+	ret = 0;
+end:
+	free(seqs);
+	free(recs);
+	for (i = 0; i < nfeeds; i++)
+		free(feeds[i]);
+	free(feeds);
+	if (datafd != -1)
+		close(datafd);
+	if (fd != -1)
+		close(fd);
+	if (fp)
+		fclose(fp); /* releases the lock */
+
+	return ret;
+}
+
+/* returns 1 if the current item of input `a` comes before that of `b` in the
+   timeline: newest first, equal timestamps in the order of the inputs */
+static int
+tlbefore(const struct tlinput *a, const struct tlinput *b)
+{
+	if (a->timestamp != b->timestamp)
+		return a->timestamp > b->timestamp;
+	return a->feed < b->feed;
+}
+
+/* read the next item with a valid timestamp of an input, returns 0 at the
+   end of the input or on a read error */
+static int
+tlread(struct tlinput *in)
+{
+	ssize_t n;
+	char *s;
+	int r;
+
+	while ((n = getline(&(in->line), &(in->linesize), in->fp)) > 0) {
+		if (in->line[n - 1] == '\n')
+			in->line[--n] = '\0';
+		if ((s = strchr(in->line, '\t')))
+			*s = '\0';
+		r = strtotime(in->line, &(in->timestamp));
+		if (s)
+			*s = '\t';
+		if (!r)
+			return 1;
+	}
+	return 0;
+}
+
+static void
+tlsiftdown(struct timeline *tl, size_t i)
+{
+	struct tlinput *tmp;
+	size_t c;
+
+	for (; (c = 2 * i + 1) < tl->len; i = c) {
+		if (c + 1 < tl->len && tlbefore(tl->heap[c + 1], tl->heap[c]))
+			c++;
+		if (!tlbefore(tl->heap[c], tl->heap[i]))
+			break;
+		tmp = tl->heap[i];
+		tl->heap[i] = tl->heap[c];
+		tl->heap[c] = tmp;
+	}
+}
+
+/* Merge the feed files `fps`, each sorted newest first, to one timeline:
+ * a binary heap of the inputs ordered by their current item. Only the
+ * current line of each input is kept in memory.
+ * returns 0 on success or -1 on error. */
+int
+timeline_open(struct timeline *tl, FILE **fps, size_t n)
+{
+	size_t i;
+
+	memset(tl, 0, sizeof(*tl));
+	if (!(tl->inputs = calloc(n ? n : 1, sizeof(*tl->inputs))) ||
+	    !(tl->heap = calloc(n ? n : 1, sizeof(*tl->heap)))) {
+		free(tl->inputs);
+		return -1;
+	}
+	for (i = 0; i < n; i++) {
+		tl->inputs[i].fp = fps[i];
+		tl->inputs[i].feed = i;
+		if (tlread(&(tl->inputs[i])))
+			tl->heap[tl->len++] = &(tl->inputs[i]);
+	}
+	tl->n = n;
+	for (i = tl->len / 2; i > 0; i--)
+		tlsiftdown(tl, i - 1);
+
+	return 0;
+}
+
+/* Returns the input with the next item of the timeline in its `line`, which
+ * the caller may modify, or NULL at the end. The line is valid until the
+ * next call. Read errors end an input early: check ferror() of the files. */
+struct tlinput *
+timeline_next(struct timeline *tl)
+{
+	/* advance the input of the previous item, it is at the top */
+	if (tl->cur) {
+		if (!tlread(tl->cur))
+			tl->heap[0] = tl->heap[--tl->len];
+		tlsiftdown(tl, 0);
+		tl->cur = NULL;
+	}
+	if (!tl->len)
+		return NULL;
+
+	return (tl->cur = tl->heap[0]);
+}
+
+void
+timeline_close(struct timeline *tl)
+{
+	size_t i;
+
+	for (i = 0; i < tl->n; i++)
+		free(tl->inputs[i].line);
+	free(tl->inputs);
+	free(tl->heap);
+	memset(tl, 0, sizeof(*tl));
+}
+
+/* result of a job, written by a worker before the output of the feed */
+struct jobresult {
+	size_t      len;  /* length of the output */
+	struct feed feed; /* counts of the feed, the name is not used */
+};
+
+/* worker: format the feeds with the indices read from `tfd`, write the
+   results to `rfd` */
+static void
+jobworker(int tfd, int rfd, void (*fn)(FILE *, size_t), struct feed **feeds)
+{
+	struct jobresult res;
+	FILE *fp;
+	char *buf = NULL;
+	size_t i, size = 0;
+
+	while (readall(tfd, (char *)&i, sizeof(i)) == sizeof(i)) {
+		if (!(fp = open_memstream(&buf, &size)))
+			err(1, "open_memstream");
+		fn(fp, i);
+		if (fclose(fp) == EOF)
+			err(1, "fclose");
+		memset(&res, 0, sizeof(res));
+		res.len = size;
+		if (feeds)
+			res.feed = *feeds[i];
+		if (writeall(rfd, (char *)&res, sizeof(res)) == -1 ||
+		    writeall(rfd, buf, size) == -1)
+			err(1, "write");
+		free(buf);
+		buf = NULL;
+	}
+	_exit(0);
+}
+
+/* Format the feeds 0 to n - 1 with fn(fp, i), using `jobs` worker
+ * processes. The output of each feed is written to `out` in the order of
+ * the feeds, so it is the same as calling fn(out, i) for each feed in
+ * order. If `feeds` is not NULL the counts a worker sets in feeds[i] are
+ * copied back. Each worker has at most two feeds queued: the output of a
+ * feed which is not written yet waits in the pipe of its worker.
+ * returns 0 on success or -1 on error: a worker prints its own error. */
+int
+formatjobs(FILE *out, size_t n, int jobs, void (*fn)(FILE *, size_t),
+	struct feed **feeds)
+{
+	struct jobresult res;
+	struct { pid_t pid; int tfd, rfd; } *w;
+	char buf[BUFSIZ], *name;
+	size_t i, d, *owner, len;
+	ssize_t r;
+	int k, j, tp[2], rp[2], status, ret = -1;
+
+	if (jobs <= 1 || n <= 1) {
+		for (i = 0; i < n; i++)
+			fn(out, i);
+		return 0;
+	}
+	if ((size_t)jobs > n)
+		jobs = n;
+	if (!(w = calloc(jobs, sizeof(*w))) ||
+	    !(owner = calloc(n, sizeof(*owner)))) {
+		warn("calloc");
+		free(w);
+		return -1;
+	}
+
+	/* buffered output would be written again by a worker which exits */
+	fflush(NULL);
+	for (k = 0; k < jobs; k++) {
+		if (pipe(tp) == -1) {
+			warn("pipe");
+			goto end;
+		}
+		if (pipe(rp) == -1) {
+			warn("pipe");
+			close(tp[0]);
+			close(tp[1]);
+			goto end;
+		}
+		switch ((w[k].pid = fork())) {
+		case -1:
+			warn("fork");
+			close(tp[0]);
+			close(tp[1]);
+			close(rp[0]);
+			close(rp[1]);
+			goto end;
+		case 0:
+			for (j = 0; j < k; j++) {
+				close(w[j].tfd);
+				close(w[j].rfd);
+			}
+			close(tp[1]);
+			close(rp[0]);
+			jobworker(tp[0], rp[1], fn, feeds);
+		}
+		close(tp[0]);
+		close(rp[1]);
+		w[k].tfd = tp[1];
+		w[k].rfd = rp[0];
+	}
+
+	for (d = 0; d < n && d < 2 * (size_t)jobs; d++) {
+		owner[d] = d % jobs;
+		if (writeall(w[owner[d]].tfd, (char *)&d, sizeof(d)) == -1) {
+			warn("write");
+			goto end;
+		}
+	}
+	for (i = 0; i < n; i++) {
+		k = owner[i];
+		if (readall(w[k].rfd, (char *)&res, sizeof(res)) != sizeof(res))
+			goto end; /* the worker failed */
+		for (len = res.len; len > 0; len -= r) {
+			r = readall(w[k].rfd, buf, len < sizeof(buf) ? len : sizeof(buf));
+			if (r <= 0)
+				goto end;
+			fwrite(buf, 1, r, out);
+		}
+		if (feeds) {
+			name = feeds[i]->name;
+			*feeds[i] = res.feed;
+			feeds[i]->name = name;
+		}
+		/* the worker is ready for the next feed */
+		if (d < n) {
+			owner[d] = k;
+			if (writeall(w[k].tfd, (char *)&d, sizeof(d)) == -1) {
+				warn("write");
+				goto end;
+			}
+			d++;
+		}
+	}
+	ret = 0;
+end:
+	for (k = 0; k < jobs; k++) {
+		if (w[k].pid <= 0)
+			continue;
+		close(w[k].tfd);
+		close(w[k].rfd);
+	}
+	for (k = 0; k < jobs; k++) {
+		if (w[k].pid <= 0)
+			continue;
+		while (waitpid(w[k].pid, &status, 0) == -1 && errno == EINTR)
+			;
+		if (!WIFEXITED(status) || WEXITSTATUS(status))
+			ret = -1;
+	}
+	free(owner);
+	free(w);
+
+	return ret;
+}
+
+static int
+feednamecmp(const void *v1, const void *v2)
+{
+	return strcmp(((const struct feed *)v1)->name,
+	              ((const struct feed *)v2)->name);
+}
+
+/* Read the manifest at `path`: the first line is the header `hdr`, then per
+ * feed a line with the TAB-separated fields: name, modification time and
+ * size of the feed file, newest, oldest new and oldest shown timestamp and
+ * the amount of new and total items. A manifest which does not exist or
+ * with another header has no feeds.
+ * returns 0 on success or -1 on error. */
+int
+manifest_open(struct manifest *m, const char *path, const char *hdr)
+{
+	struct feed *f;
+	FILE *fp;
+	char *line = NULL, *fields[8], *s;
+	size_t linesize = 0, size = 0, i;
+	ssize_t n;
+	int ret = 0;
+
+	memset(m, 0, sizeof(*m));
+	if (!(fp = fopen(path, "r")))
+		return errno == ENOENT ? 0 : -1;
+	if ((n = getline(&line, &linesize, fp)) <= 0)
+		goto end;
+	if (line[n - 1] == '\n')
+		line[--n] = '\0';
+	if (strcmp(line, hdr))
+		goto end;
+
+	while ((n = getline(&line, &linesize, fp)) > 0) {
+		if (line[n - 1] != '\n')
+			break; /* truncated */
+		line[n - 1] = '\0';
+		fields[0] = line;
+		for (i = 1; i < 8; i++) {
+			if (!(s = strchr(fields[i - 1], '\t')))
+				break;
+			*s = '\0';
+			fields[i] = s + 1;
+		}
+		if (i < 8)
+			continue;
+
+		if (m->len + 1 >= size) {
+			size = size ? size * 2 : 64;
+			if (!(f = realloc(m->feeds, size * sizeof(*m->feeds)))) {
+				ret = -1;
+				break;
+			}
+			m->feeds = f;
+		}
+		f = &(m->feeds[m->len]);
+		memset(f, 0, sizeof(*f));
+		if (!(f->name = strdup(fields[0]))) {
+			ret = -1;
+			break;
+		}
+		f->mtime = strtoll(fields[1], NULL, 10);
+		f->size = strtoll(fields[2], NULL, 10);
+		f->timenewest = (time_t)strtoll(fields[3], NULL, 10);
+		f->timeoldestnew = (time_t)strtoll(fields[4], NULL, 10);
+		f->timeoldest = (time_t)strtoll(fields[5], NULL, 10);
+		f->totalnew = strtoul(fields[6], NULL, 10);
+		f->total = strtoul(fields[7], NULL, 10);
+		m->len++;
+	}
+	if (ferror(fp))
+		ret = -1;
+	qsort(m->feeds, m->len, sizeof(*m->feeds), feednamecmp);
+end:
+	free(line);
+	fclose(fp);
+	if (ret == -1)
+		manifest_close(m);
+
+	return ret;
+}
+
+void
+manifest_close(struct manifest *m)
+{
+	size_t i;
+
+	for (i = 0; i < m->len; i++)
+		free(m->feeds[i].name);
+	free(m->feeds);
+	memset(m, 0, sizeof(*m));
+}
+
+/* returns the feed with the name `name` in the manifest or NULL */
+const struct feed *
+manifest_find(const struct manifest *m, const char *name)
+{
+	struct feed key;
+
+	if (!m->len)
+		return NULL;
+	key.name = (char *)name;
+
+	return bsearch(&key, m->feeds, m->len, sizeof(*m->feeds), feednamecmp);
+}
+
+/* Write the manifest with the header `hdr` and the `len` feeds `feeds` to
+ * `path`. The file is written to a temporary file first and then renamed.
+ * returns 0 on success or -1 on error. */
+int
+manifest_write(const char *path, const char *hdr, struct feed **feeds,
+	size_t len)
+{
+	char tmppath[PATH_MAX];
+	struct feed *f;
+	FILE *fp;
+	size_t i;
+	int fd, r;
+
+	r = snprintf(tmppath, sizeof(tmppath), "%s.XXXXXX", path);
+	if (r < 0 || (size_t)r >= sizeof(tmppath))
+		return -1;
+	if ((fd = mkstemp(tmppath)) == -1)
+		return -1;
+	if (!(fp = fdopen(fd, "wb"))) {
+		close(fd);
+		unlink(tmppath);
+		return -1;
+	}
+	fprintf(fp, "%s\n", hdr);
+	for (i = 0; i < len; i++) {
+		f = feeds[i];
+		fprintf(fp, "%s\t%lld\t%lld\t%lld\t%lld\t%lld\t%lu\t%lu\n",
+		        f->name, f->mtime, f->size, (long long)f->timenewest,
+		        (long long)f->timeoldestnew, (long long)f->timeoldest,
+		        f->totalnew, f->total);
+	}
+	r = (fflush(fp) || ferror(fp)) ? -1 : 0;
+	if (fclose(fp) == EOF)
+		r = -1;
+	if (r == -1 || rename(tmppath, path) == -1) {
+		unlink(tmppath);
+		return -1;
+	}
+	return 0;
+}
+
+/* Read a field-separated line from 'fp',
+ * separated by a character 'separator',
+ * 'fields' is a list of pointers with a size of FieldLast (must be >0).
+ * 'line' buffer is allocated using malloc, 'size' will contain the allocated
+ * buffer size.
+ * returns: amount of fields read (>0) or -1 on error. */
+size_t
+parseline(char *line, char *fields[FieldLast])
+{
+	char *prev, *s;
+	size_t i;
+
+	for (prev = line, i = 0;
+	    (s = strchr(prev, '\t')) && i < FieldLast - 1;
+	    i++) {
+		*s = '\0';
+		fields[i] = prev;
+		prev = s + 1;
+	}
+	fields[i++] = prev;
+	/* make non-parsed fields empty. */
+	for (; i < FieldLast; i++)
+		fields[i] = "";
+
+	return i;
+}
+
+/* Parse time to time_t, assumes time_t is signed, ignores fractions. */
+int
+strtotime(const char *s, time_t *t)
+{
+	long long l;
+	char *e;
+
+	errno = 0;
+	l = strtoll(s, &e, 10);
+	if (errno || *s == '\0' || *e)
+		return -1;
+	/* NOTE: assumes time_t is 64-bit on 64-bit platforms:
+	         long long (atleast 32-bit) to time_t. */
+	if (t)
+		*t = (time_t)l;
+
+	return 0;
+}
+
+/* Escape characters below as HTML 2.0 / XML 1.0. */
+void
+xmlencode(const char *s, FILE *fp)
+{
+	for (; *s; ++s) {
+		switch (*s) {
+		case '<':  fputs("&lt;",   fp); break;
+		case '>':  fputs("&gt;",   fp); break;
+		case '\'': fputs("&#39;",  fp); break;
+		case '&':  fputs("&amp;",  fp); break;
+		case '"':  fputs("&quot;", fp); break;
+		default:   fputc(*s, fp);
+		}
+	}
+}
+
+/* Column width ranges of codepoints, sorted, generated from Unicode 14.0:
+ * zero-width: general category Mn, Me, Cf (except U+00AD and the prepended
+ * concatenation marks), Hangul medial vowels and final consonants.
+ * wide: East Asian Width W and F.
+ * unassigned: codepoints without a width, including surrogates and
+ * noncharacters. This matches glibc wcwidth(3) in a UTF-8 locale. */
+struct range {
+	uint32_t first;
+	uint32_t last;
+};
+
+static const struct range zerowidth[] = {
+	{ 0x0300, 0x036f }, { 0x0483, 0x0489 }, { 0x0591, 0x05bd },
+	{ 0x05bf, 0x05bf }, { 0x05c1, 0x05c2 }, { 0x05c4, 0x05c5 },
+	{ 0x05c7, 0x05c7 }, { 0x0610, 0x061a }, { 0x061c, 0x061c },
+	{ 0x064b, 0x065f }, { 0x0670, 0x0670 }, { 0x06d6, 0x06dc },
+	{ 0x06df, 0x06e4 }, { 0x06e7, 0x06e8 }, { 0x06ea, 0x06ed },
+	{ 0x0711, 0x0711 }, { 0x0730, 0x074a }, { 0x07a6, 0x07b0 },
+	{ 0x07eb, 0x07f3 }, { 0x07fd, 0x07fd }, { 0x0816, 0x0819 },
+	{ 0x081b, 0x0823 }, { 0x0825, 0x0827 }, { 0x0829, 0x082d },
+	{ 0x0859, 0x085b }, { 0x0898, 0x089f }, { 0x08ca, 0x08e1 },
+	{ 0x08e3, 0x0902 }, { 0x093a, 0x093a }, { 0x093c, 0x093c },
+	{ 0x0941, 0x0948 }, { 0x094d, 0x094d }, { 0x0951, 0x0957 },
+	{ 0x0962, 0x0963 }, { 0x0981, 0x0981 }, { 0x09bc, 0x09bc },
+	{ 0x09c1, 0x09c4 }, { 0x09cd, 0x09cd }, { 0x09e2, 0x09e3 },
+	{ 0x09fe, 0x09fe }, { 0x0a01, 0x0a02 }, { 0x0a3c, 0x0a3c },
+	{ 0x0a41, 0x0a42 }, { 0x0a47, 0x0a48 }, { 0x0a4b, 0x0a4d },
+	{ 0x0a51, 0x0a51 }, { 0x0a70, 0x0a71 }, { 0x0a75, 0x0a75 },
+	{ 0x0a81, 0x0a82 }, { 0x0abc, 0x0abc }, { 0x0ac1, 0x0ac5 },
+	{ 0x0ac7, 0x0ac8 }, { 0x0acd, 0x0acd }, { 0x0ae2, 0x0ae3 },
+	{ 0x0afa, 0x0aff }, { 0x0b01, 0x0b01 }, { 0x0b3c, 0x0b3c },
+	{ 0x0b3f, 0x0b3f }, { 0x0b41, 0x0b44 }, { 0x0b4d, 0x0b4d },
+	{ 0x0b55, 0x0b56 }, { 0x0b62, 0x0b63 }, { 0x0b82, 0x0b82 },
+	{ 0x0bc0, 0x0bc0 }, { 0x0bcd, 0x0bcd }, { 0x0c00, 0x0c00 },
+	{ 0x0c04, 0x0c04 }, { 0x0c3c, 0x0c3c }, { 0x0c3e, 0x0c40 },
+	{ 0x0c46, 0x0c48 }, { 0x0c4a, 0x0c4d }, { 0x0c55, 0x0c56 },
+	{ 0x0c62, 0x0c63 }, { 0x0c81, 0x0c81 }, { 0x0cbc, 0x0cbc },
+	{ 0x0cbf, 0x0cbf }, { 0x0cc6, 0x0cc6 }, { 0x0ccc, 0x0ccd },
+	{ 0x0ce2, 0x0ce3 }, { 0x0d00, 0x0d01 }, { 0x0d3b, 0x0d3c },
+	{ 0x0d41, 0x0d44 }, { 0x0d4d, 0x0d4d }, { 0x0d62, 0x0d63 },
+	{ 0x0d81, 0x0d81 }, { 0x0dca, 0x0dca }, { 0x0dd2, 0x0dd4 },
+	{ 0x0dd6, 0x0dd6 }, { 0x0e31, 0x0e31 }, { 0x0e34, 0x0e3a },
+	{ 0x0e47, 0x0e4e }, { 0x0eb1, 0x0eb1 }, { 0x0eb4, 0x0ebc },
+	{ 0x0ec8, 0x0ecd }, { 0x0f18, 0x0f19 }, { 0x0f35, 0x0f35 },
+	{ 0x0f37, 0x0f37 }, { 0x0f39, 0x0f39 }, { 0x0f71, 0x0f7e },
+	{ 0x0f80, 0x0f84 }, { 0x0f86, 0x0f87 }, { 0x0f8d, 0x0f97 },
+	{ 0x0f99, 0x0fbc }, { 0x0fc6, 0x0fc6 }, { 0x102d, 0x1030 },
+	{ 0x1032, 0x1037 }, { 0x1039, 0x103a }, { 0x103d, 0x103e },
+	{ 0x1058, 0x1059 }, { 0x105e, 0x1060 }, { 0x1071, 0x1074 },
+	{ 0x1082, 0x1082 }, { 0x1085, 0x1086 }, { 0x108d, 0x108d },
+	{ 0x109d, 0x109d }, { 0x1160, 0x11ff }, { 0x135d, 0x135f },
+	{ 0x1712, 0x1714 }, { 0x1732, 0x1733 }, { 0x1752, 0x1753 },
+	{ 0x1772, 0x1773 }, { 0x17b4, 0x17b5 }, { 0x17b7, 0x17bd },
+	{ 0x17c6, 0x17c6 }, { 0x17c9, 0x17d3 }, { 0x17dd, 0x17dd },
+	{ 0x180b, 0x180f }, { 0x1885, 0x1886 }, { 0x18a9, 0x18a9 },
+	{ 0x1920, 0x1922 }, { 0x1927, 0x1928 }, { 0x1932, 0x1932 },
+	{ 0x1939, 0x193b }, { 0x1a17, 0x1a18 }, { 0x1a1b, 0x1a1b },
+	{ 0x1a56, 0x1a56 }, { 0x1a58, 0x1a5e }, { 0x1a60, 0x1a60 },
+	{ 0x1a62, 0x1a62 }, { 0x1a65, 0x1a6c }, { 0x1a73, 0x1a7c },
+	{ 0x1a7f, 0x1a7f }, { 0x1ab0, 0x1ace }, { 0x1b00, 0x1b03 },
+	{ 0x1b34, 0x1b34 }, { 0x1b36, 0x1b3a }, { 0x1b3c, 0x1b3c },
+	{ 0x1b42, 0x1b42 }, { 0x1b6b, 0x1b73 }, { 0x1b80, 0x1b81 },
+	{ 0x1ba2, 0x1ba5 }, { 0x1ba8, 0x1ba9 }, { 0x1bab, 0x1bad },
+	{ 0x1be6, 0x1be6 }, { 0x1be8, 0x1be9 }, { 0x1bed, 0x1bed },
+	{ 0x1bef, 0x1bf1 }, { 0x1c2c, 0x1c33 }, { 0x1c36, 0x1c37 },
+	{ 0x1cd0, 0x1cd2 }, { 0x1cd4, 0x1ce0 }, { 0x1ce2, 0x1ce8 },
+	{ 0x1ced, 0x1ced }, { 0x1cf4, 0x1cf4 }, { 0x1cf8, 0x1cf9 },
+	{ 0x1dc0, 0x1dff }, { 0x200b, 0x200f }, { 0x202a, 0x202e },
+	{ 0x2060, 0x2064 }, { 0x2066, 0x206f }, { 0x20d0, 0x20f0 },
+	{ 0x2cef, 0x2cf1 }, { 0x2d7f, 0x2d7f }, { 0x2de0, 0x2dff },
+	{ 0x302a, 0x302d }, { 0x3099, 0x309a }, { 0xa66f, 0xa672 },
+	{ 0xa674, 0xa67d }, { 0xa69e, 0xa69f }, { 0xa6f0, 0xa6f1 },
+	{ 0xa802, 0xa802 }, { 0xa806, 0xa806 }, { 0xa80b, 0xa80b },
+	{ 0xa825, 0xa826 }, { 0xa82c, 0xa82c }, { 0xa8c4, 0xa8c5 },
+	{ 0xa8e0, 0xa8f1 }, { 0xa8ff, 0xa8ff }, { 0xa926, 0xa92d },
+	{ 0xa947, 0xa951 }, { 0xa980, 0xa982 }, { 0xa9b3, 0xa9b3 },
+	{ 0xa9b6, 0xa9b9 }, { 0xa9bc, 0xa9bd }, { 0xa9e5, 0xa9e5 },
+	{ 0xaa29, 0xaa2e }, { 0xaa31, 0xaa32 }, { 0xaa35, 0xaa36 },
+	{ 0xaa43, 0xaa43 }, { 0xaa4c, 0xaa4c }, { 0xaa7c, 0xaa7c },
+	{ 0xaab0, 0xaab0 }, { 0xaab2, 0xaab4 }, { 0xaab7, 0xaab8 },
+	{ 0xaabe, 0xaabf }, { 0xaac1, 0xaac1 }, { 0xaaec, 0xaaed },
+	{ 0xaaf6, 0xaaf6 }, { 0xabe5, 0xabe5 }, { 0xabe8, 0xabe8 },
+	{ 0xabed, 0xabed }, { 0xd7b0, 0xd7c6 }, { 0xd7cb, 0xd7fb },
+	{ 0xfb1e, 0xfb1e }, { 0xfe00, 0xfe0f }, { 0xfe20, 0xfe2f },
+	{ 0xfeff, 0xfeff }, { 0xfff9, 0xfffb }, { 0x101fd, 0x101fd },
+	{ 0x102e0, 0x102e0 }, { 0x10376, 0x1037a }, { 0x10a01, 0x10a03 },
+	{ 0x10a05, 0x10a06 }, { 0x10a0c, 0x10a0f }, { 0x10a38, 0x10a3a },
+	{ 0x10a3f, 0x10a3f }, { 0x10ae5, 0x10ae6 }, { 0x10d24, 0x10d27 },
+	{ 0x10eab, 0x10eac }, { 0x10f46, 0x10f50 }, { 0x10f82, 0x10f85 },
+	{ 0x11001, 0x11001 }, { 0x11038, 0x11046 }, { 0x11070, 0x11070 },
+	{ 0x11073, 0x11074 }, { 0x1107f, 0x11081 }, { 0x110b3, 0x110b6 },
+	{ 0x110b9, 0x110ba }, { 0x110c2, 0x110c2 }, { 0x11100, 0x11102 },
+	{ 0x11127, 0x1112b }, { 0x1112d, 0x11134 }, { 0x11173, 0x11173 },
+	{ 0x11180, 0x11181 }, { 0x111b6, 0x111be }, { 0x111c9, 0x111cc },
+	{ 0x111cf, 0x111cf }, { 0x1122f, 0x11231 }, { 0x11234, 0x11234 },
+	{ 0x11236, 0x11237 }, { 0x1123e, 0x1123e }, { 0x112df, 0x112df },
+	{ 0x112e3, 0x112ea }, { 0x11300, 0x11301 }, { 0x1133b, 0x1133c },
+	{ 0x11340, 0x11340 }, { 0x11366, 0x1136c }, { 0x11370, 0x11374 },
+	{ 0x11438, 0x1143f }, { 0x11442, 0x11444 }, { 0x11446, 0x11446 },
+	{ 0x1145e, 0x1145e }, { 0x114b3, 0x114b8 }, { 0x114ba, 0x114ba },
+	{ 0x114bf, 0x114c0 }, { 0x114c2, 0x114c3 }, { 0x115b2, 0x115b5 },
+	{ 0x115bc, 0x115bd }, { 0x115bf, 0x115c0 }, { 0x115dc, 0x115dd },
+	{ 0x11633, 0x1163a }, { 0x1163d, 0x1163d }, { 0x1163f, 0x11640 },
+	{ 0x116ab, 0x116ab }, { 0x116ad, 0x116ad }, { 0x116b0, 0x116b5 },
+	{ 0x116b7, 0x116b7 }, { 0x1171d, 0x1171f }, { 0x11722, 0x11725 },
+	{ 0x11727, 0x1172b }, { 0x1182f, 0x11837 }, { 0x11839, 0x1183a },
+	{ 0x1193b, 0x1193c }, { 0x1193e, 0x1193e }, { 0x11943, 0x11943 },
+	{ 0x119d4, 0x119d7 }, { 0x119da, 0x119db }, { 0x119e0, 0x119e0 },
+	{ 0x11a01, 0x11a0a }, { 0x11a33, 0x11a38 }, { 0x11a3b, 0x11a3e },
+	{ 0x11a47, 0x11a47 }, { 0x11a51, 0x11a56 }, { 0x11a59, 0x11a5b },
+	{ 0x11a8a, 0x11a96 }, { 0x11a98, 0x11a99 }, { 0x11c30, 0x11c36 },
+	{ 0x11c38, 0x11c3d }, { 0x11c3f, 0x11c3f }, { 0x11c92, 0x11ca7 },
+	{ 0x11caa, 0x11cb0 }, { 0x11cb2, 0x11cb3 }, { 0x11cb5, 0x11cb6 },
+	{ 0x11d31, 0x11d36 }, { 0x11d3a, 0x11d3a }, { 0x11d3c, 0x11d3d },
+	{ 0x11d3f, 0x11d45 }, { 0x11d47, 0x11d47 }, { 0x11d90, 0x11d91 },
+	{ 0x11d95, 0x11d95 }, { 0x11d97, 0x11d97 }, { 0x11ef3, 0x11ef4 },
+	{ 0x13430, 0x13438 }, { 0x16af0, 0x16af4 }, { 0x16b30, 0x16b36 },
+	{ 0x16f4f, 0x16f4f }, { 0x16f8f, 0x16f92 }, { 0x16fe4, 0x16fe4 },
+	{ 0x1bc9d, 0x1bc9e }, { 0x1bca0, 0x1bca3 }, { 0x1cf00, 0x1cf2d },
+	{ 0x1cf30, 0x1cf46 }, { 0x1d167, 0x1d169 }, { 0x1d173, 0x1d182 },
+	{ 0x1d185, 0x1d18b }, { 0x1d1aa, 0x1d1ad }, { 0x1d242, 0x1d244 },
+	{ 0x1da00, 0x1da36 }, { 0x1da3b, 0x1da6c }, { 0x1da75, 0x1da75 },
+	{ 0x1da84, 0x1da84 }, { 0x1da9b, 0x1da9f }, { 0x1daa1, 0x1daaf },
+	{ 0x1e000, 0x1e006 }, { 0x1e008, 0x1e018 }, { 0x1e01b, 0x1e021 },
+	{ 0x1e023, 0x1e024 }, { 0x1e026, 0x1e02a }, { 0x1e130, 0x1e136 },
+	{ 0x1e2ae, 0x1e2ae }, { 0x1e2ec, 0x1e2ef }, { 0x1e8d0, 0x1e8d6 },
+	{ 0x1e944, 0x1e94a }, { 0xe0001, 0xe0001 }, { 0xe0020, 0xe007f },
+	{ 0xe0100, 0xe01ef }
+};
+
+static const struct range widewidth[] = {
+	{ 0x1100, 0x115f }, { 0x231a, 0x231b }, { 0x2329, 0x232a },
+	{ 0x23e9, 0x23ec }, { 0x23f0, 0x23f0 }, { 0x23f3, 0x23f3 },
+	{ 0x25fd, 0x25fe }, { 0x2614, 0x2615 }, { 0x2648, 0x2653 },
+	{ 0x267f, 0x267f }, { 0x2693, 0x2693 }, { 0x26a1, 0x26a1 },
+	{ 0x26aa, 0x26ab }, { 0x26bd, 0x26be }, { 0x26c4, 0x26c5 },
+	{ 0x26ce, 0x26ce }, { 0x26d4, 0x26d4 }, { 0x26ea, 0x26ea },
+	{ 0x26f2, 0x26f3 }, { 0x26f5, 0x26f5 }, { 0x26fa, 0x26fa },
+	{ 0x26fd, 0x26fd }, { 0x2705, 0x2705 }, { 0x270a, 0x270b },
+	{ 0x2728, 0x2728 }, { 0x274c, 0x274c }, { 0x274e, 0x274e },
+	{ 0x2753, 0x2755 }, { 0x2757, 0x2757 }, { 0x2795, 0x2797 },
+	{ 0x27b0, 0x27b0 }, { 0x27bf, 0x27bf }, { 0x2b1b, 0x2b1c },
+	{ 0x2b50, 0x2b50 }, { 0x2b55, 0x2b55 }, { 0x2e80, 0x2e99 },
+	{ 0x2e9b, 0x2ef3 }, { 0x2f00, 0x2fd5 }, { 0x2ff0, 0x2ffb },
+	{ 0x3000, 0x3029 }, { 0x302e, 0x303e }, { 0x3041, 0x3096 },
+	{ 0x309b, 0x30ff }, { 0x3105, 0x312f }, { 0x3131, 0x318e },
+	{ 0x3190, 0x31e3 }, { 0x31f0, 0x321e }, { 0x3220, 0xa48c },
+	{ 0xa490, 0xa4c6 }, { 0xa960, 0xa97c }, { 0xac00, 0xd7a3 },
+	{ 0xf900, 0xfa6d }, { 0xfa70, 0xfad9 }, { 0xfe10, 0xfe19 },
+	{ 0xfe30, 0xfe52 }, { 0xfe54, 0xfe66 }, { 0xfe68, 0xfe6b },
+	{ 0xff01, 0xff60 }, { 0xffe0, 0xffe6 }, { 0x16fe0, 0x16fe3 },
+	{ 0x16ff0, 0x16ff1 }, { 0x17000, 0x187f7 }, { 0x18800, 0x18cd5 },
+	{ 0x18d00, 0x18d08 }, { 0x1aff0, 0x1aff3 }, { 0x1aff5, 0x1affb },
+	{ 0x1affd, 0x1affe }, { 0x1b000, 0x1b122 }, { 0x1b150, 0x1b152 },
+	{ 0x1b164, 0x1b167 }, { 0x1b170, 0x1b2fb }, { 0x1f004, 0x1f004 },
+	{ 0x1f0cf, 0x1f0cf }, { 0x1f18e, 0x1f18e }, { 0x1f191, 0x1f19a },
+	{ 0x1f200, 0x1f202 }, { 0x1f210, 0x1f23b }, { 0x1f240, 0x1f248 },
+	{ 0x1f250, 0x1f251 }, { 0x1f260, 0x1f265 }, { 0x1f300, 0x1f320 },
+	{ 0x1f32d, 0x1f335 }, { 0x1f337, 0x1f37c }, { 0x1f37e, 0x1f393 },
+	{ 0x1f3a0, 0x1f3ca }, { 0x1f3cf, 0x1f3d3 }, { 0x1f3e0, 0x1f3f0 },
+	{ 0x1f3f4, 0x1f3f4 }, { 0x1f3f8, 0x1f43e }, { 0x1f440, 0x1f440 },
+	{ 0x1f442, 0x1f4fc }, { 0x1f4ff, 0x1f53d }, { 0x1f54b, 0x1f54e },
+	{ 0x1f550, 0x1f567 }, { 0x1f57a, 0x1f57a }, { 0x1f595, 0x1f596 },
+	{ 0x1f5a4, 0x1f5a4 }, { 0x1f5fb, 0x1f64f }, { 0x1f680, 0x1f6c5 },
+	{ 0x1f6cc, 0x1f6cc }, { 0x1f6d0, 0x1f6d2 }, { 0x1f6d5, 0x1f6d7 },
+	{ 0x1f6dd, 0x1f6df }, { 0x1f6eb, 0x1f6ec }, { 0x1f6f4, 0x1f6fc },
+	{ 0x1f7e0, 0x1f7eb }, { 0x1f7f0, 0x1f7f0 }, { 0x1f90c, 0x1f93a },
+	{ 0x1f93c, 0x1f945 }, { 0x1f947, 0x1f9ff }, { 0x1fa70, 0x1fa74 },
+	{ 0x1fa78, 0x1fa7c }, { 0x1fa80, 0x1fa86 }, { 0x1fa90, 0x1faac },
+	{ 0x1fab0, 0x1faba }, { 0x1fac0, 0x1fac5 }, { 0x1fad0, 0x1fad9 },
+	{ 0x1fae0, 0x1fae7 }, { 0x1faf0, 0x1faf6 }, { 0x20000, 0x2fffd },
+	{ 0x30000, 0x3fffd }
+};
+
+static const struct range unassigned[] = {
+	{ 0x0378, 0x0379 }, { 0x0380, 0x0383 }, { 0x038b, 0x038b },
+	{ 0x038d, 0x038d }, { 0x03a2, 0x03a2 }, { 0x0530, 0x0530 },
+	{ 0x0557, 0x0558 }, { 0x058b, 0x058c }, { 0x0590, 0x0590 },
+	{ 0x05c8, 0x05cf }, { 0x05eb, 0x05ee }, { 0x05f5, 0x05ff },
+	{ 0x070e, 0x070e }, { 0x074b, 0x074c }, { 0x07b2, 0x07bf },
+	{ 0x07fb, 0x07fc }, { 0x082e, 0x082f }, { 0x083f, 0x083f },
+	{ 0x085c, 0x085d }, { 0x085f, 0x085f }, { 0x086b, 0x086f },
+	{ 0x088f, 0x088f }, { 0x0892, 0x0897 }, { 0x0984, 0x0984 },
+	{ 0x098d, 0x098e }, { 0x0991, 0x0992 }, { 0x09a9, 0x09a9 },
+	{ 0x09b1, 0x09b1 }, { 0x09b3, 0x09b5 }, { 0x09ba, 0x09bb },
+	{ 0x09c5, 0x09c6 }, { 0x09c9, 0x09ca }, { 0x09cf, 0x09d6 },
+	{ 0x09d8, 0x09db }, { 0x09de, 0x09de }, { 0x09e4, 0x09e5 },
+	{ 0x09ff, 0x0a00 }, { 0x0a04, 0x0a04 }, { 0x0a0b, 0x0a0e },
+	{ 0x0a11, 0x0a12 }, { 0x0a29, 0x0a29 }, { 0x0a31, 0x0a31 },
+	{ 0x0a34, 0x0a34 }, { 0x0a37, 0x0a37 }, { 0x0a3a, 0x0a3b },
+	{ 0x0a3d, 0x0a3d }, { 0x0a43, 0x0a46 }, { 0x0a49, 0x0a4a },
+	{ 0x0a4e, 0x0a50 }, { 0x0a52, 0x0a58 }, { 0x0a5d, 0x0a5d },
+	{ 0x0a5f, 0x0a65 }, { 0x0a77, 0x0a80 }, { 0x0a84, 0x0a84 },
+	{ 0x0a8e, 0x0a8e }, { 0x0a92, 0x0a92 }, { 0x0aa9, 0x0aa9 },
+	{ 0x0ab1, 0x0ab1 }, { 0x0ab4, 0x0ab4 }, { 0x0aba, 0x0abb },
+	{ 0x0ac6, 0x0ac6 }, { 0x0aca, 0x0aca }, { 0x0ace, 0x0acf },
+	{ 0x0ad1, 0x0adf }, { 0x0ae4, 0x0ae5 }, { 0x0af2, 0x0af8 },
+	{ 0x0b00, 0x0b00 }, { 0x0b04, 0x0b04 }, { 0x0b0d, 0x0b0e },
+	{ 0x0b11, 0x0b12 }, { 0x0b29, 0x0b29 }, { 0x0b31, 0x0b31 },
+	{ 0x0b34, 0x0b34 }, { 0x0b3a, 0x0b3b }, { 0x0b45, 0x0b46 },
+	{ 0x0b49, 0x0b4a }, { 0x0b4e, 0x0b54 }, { 0x0b58, 0x0b5b },
+	{ 0x0b5e, 0x0b5e }, { 0x0b64, 0x0b65 }, { 0x0b78, 0x0b81 },
+	{ 0x0b84, 0x0b84 }, { 0x0b8b, 0x0b8d }, { 0x0b91, 0x0b91 },
+	{ 0x0b96, 0x0b98 }, { 0x0b9b, 0x0b9b }, { 0x0b9d, 0x0b9d },
+	{ 0x0ba0, 0x0ba2 }, { 0x0ba5, 0x0ba7 }, { 0x0bab, 0x0bad },
+	{ 0x0bba, 0x0bbd }, { 0x0bc3, 0x0bc5 }, { 0x0bc9, 0x0bc9 },
+	{ 0x0bce, 0x0bcf }, { 0x0bd1, 0x0bd6 }, { 0x0bd8, 0x0be5 },
+	{ 0x0bfb, 0x0bff }, { 0x0c0d, 0x0c0d }, { 0x0c11, 0x0c11 },
+	{ 0x0c29, 0x0c29 }, { 0x0c3a, 0x0c3b }, { 0x0c45, 0x0c45 },
+	{ 0x0c49, 0x0c49 }, { 0x0c4e, 0x0c54 }, { 0x0c57, 0x0c57 },
+	{ 0x0c5b, 0x0c5c }, { 0x0c5e, 0x0c5f }, { 0x0c64, 0x0c65 },
+	{ 0x0c70, 0x0c76 }, { 0x0c8d, 0x0c8d }, { 0x0c91, 0x0c91 },
+	{ 0x0ca9, 0x0ca9 }, { 0x0cb4, 0x0cb4 }, { 0x0cba, 0x0cbb },
+	{ 0x0cc5, 0x0cc5 }, { 0x0cc9, 0x0cc9 }, { 0x0cce, 0x0cd4 },
+	{ 0x0cd7, 0x0cdc }, { 0x0cdf, 0x0cdf }, { 0x0ce4, 0x0ce5 },
+	{ 0x0cf0, 0x0cf0 }, { 0x0cf3, 0x0cff }, { 0x0d0d, 0x0d0d },
+	{ 0x0d11, 0x0d11 }, { 0x0d45, 0x0d45 }, { 0x0d49, 0x0d49 },
+	{ 0x0d50, 0x0d53 }, { 0x0d64, 0x0d65 }, { 0x0d80, 0x0d80 },
+	{ 0x0d84, 0x0d84 }, { 0x0d97, 0x0d99 }, { 0x0db2, 0x0db2 },
+	{ 0x0dbc, 0x0dbc }, { 0x0dbe, 0x0dbf }, { 0x0dc7, 0x0dc9 },
+	{ 0x0dcb, 0x0dce }, { 0x0dd5, 0x0dd5 }, { 0x0dd7, 0x0dd7 },
+	{ 0x0de0, 0x0de5 }, { 0x0df0, 0x0df1 }, { 0x0df5, 0x0e00 },
+	{ 0x0e3b, 0x0e3e }, { 0x0e5c, 0x0e80 }, { 0x0e83, 0x0e83 },
+	{ 0x0e85, 0x0e85 }, { 0x0e8b, 0x0e8b }, { 0x0ea4, 0x0ea4 },
+	{ 0x0ea6, 0x0ea6 }, { 0x0ebe, 0x0ebf }, { 0x0ec5, 0x0ec5 },
+	{ 0x0ec7, 0x0ec7 }, { 0x0ece, 0x0ecf }, { 0x0eda, 0x0edb },
+	{ 0x0ee0, 0x0eff }, { 0x0f48, 0x0f48 }, { 0x0f6d, 0x0f70 },
+	{ 0x0f98, 0x0f98 }, { 0x0fbd, 0x0fbd }, { 0x0fcd, 0x0fcd },
+	{ 0x0fdb, 0x0fff }, { 0x10c6, 0x10c6 }, { 0x10c8, 0x10cc },
+	{ 0x10ce, 0x10cf }, { 0x1249, 0x1249 }, { 0x124e, 0x124f },
+	{ 0x1257, 0x1257 }, { 0x1259, 0x1259 }, { 0x125e, 0x125f },
+	{ 0x1289, 0x1289 }, { 0x128e, 0x128f }, { 0x12b1, 0x12b1 },
+	{ 0x12b6, 0x12b7 }, { 0x12bf, 0x12bf }, { 0x12c1, 0x12c1 },
+	{ 0x12c6, 0x12c7 }, { 0x12d7, 0x12d7 }, { 0x1311, 0x1311 },
+	{ 0x1316, 0x1317 }, { 0x135b, 0x135c }, { 0x137d, 0x137f },
+	{ 0x139a, 0x139f }, { 0x13f6, 0x13f7 }, { 0x13fe, 0x13ff },
+	{ 0x169d, 0x169f }, { 0x16f9, 0x16ff }, { 0x1716, 0x171e },
+	{ 0x1737, 0x173f }, { 0x1754, 0x175f }, { 0x176d, 0x176d },
+	{ 0x1771, 0x1771 }, { 0x1774, 0x177f }, { 0x17de, 0x17df },
+	{ 0x17ea, 0x17ef }, { 0x17fa, 0x17ff }, { 0x181a, 0x181f },
+	{ 0x1879, 0x187f }, { 0x18ab, 0x18af }, { 0x18f6, 0x18ff },
+	{ 0x191f, 0x191f }, { 0x192c, 0x192f }, { 0x193c, 0x193f },
+	{ 0x1941, 0x1943 }, { 0x196e, 0x196f }, { 0x1975, 0x197f },
+	{ 0x19ac, 0x19af }, { 0x19ca, 0x19cf }, { 0x19db, 0x19dd },
+	{ 0x1a1c, 0x1a1d }, { 0x1a5f, 0x1a5f }, { 0x1a7d, 0x1a7e },
+	{ 0x1a8a, 0x1a8f }, { 0x1a9a, 0x1a9f }, { 0x1aae, 0x1aaf },
+	{ 0x1acf, 0x1aff }, { 0x1b4d, 0x1b4f }, { 0x1b7f, 0x1b7f },
+	{ 0x1bf4, 0x1bfb }, { 0x1c38, 0x1c3a }, { 0x1c4a, 0x1c4c },
+	{ 0x1c89, 0x1c8f }, { 0x1cbb, 0x1cbc }, { 0x1cc8, 0x1ccf },
+	{ 0x1cfb, 0x1cff }, { 0x1f16, 0x1f17 }, { 0x1f1e, 0x1f1f },
+	{ 0x1f46, 0x1f47 }, { 0x1f4e, 0x1f4f }, { 0x1f58, 0x1f58 },
+	{ 0x1f5a, 0x1f5a }, { 0x1f5c, 0x1f5c }, { 0x1f5e, 0x1f5e },
+	{ 0x1f7e, 0x1f7f }, { 0x1fb5, 0x1fb5 }, { 0x1fc5, 0x1fc5 },
+	{ 0x1fd4, 0x1fd5 }, { 0x1fdc, 0x1fdc }, { 0x1ff0, 0x1ff1 },
+	{ 0x1ff5, 0x1ff5 }, { 0x1fff, 0x1fff }, { 0x2065, 0x2065 },
+	{ 0x2072, 0x2073 }, { 0x208f, 0x208f }, { 0x209d, 0x209f },
+	{ 0x20c1, 0x20cf }, { 0x20f1, 0x20ff }, { 0x218c, 0x218f },
+	{ 0x2427, 0x243f }, { 0x244b, 0x245f }, { 0x2b74, 0x2b75 },
+	{ 0x2b96, 0x2b96 }, { 0x2cf4, 0x2cf8 }, { 0x2d26, 0x2d26 },
+	{ 0x2d28, 0x2d2c }, { 0x2d2e, 0x2d2f }, { 0x2d68, 0x2d6e },
+	{ 0x2d71, 0x2d7e }, { 0x2d97, 0x2d9f }, { 0x2da7, 0x2da7 },
+	{ 0x2daf, 0x2daf }, { 0x2db7, 0x2db7 }, { 0x2dbf, 0x2dbf },
+	{ 0x2dc7, 0x2dc7 }, { 0x2dcf, 0x2dcf }, { 0x2dd7, 0x2dd7 },
+	{ 0x2ddf, 0x2ddf }, { 0x2e5e, 0x2e7f }, { 0x2e9a, 0x2e9a },
+	{ 0x2ef4, 0x2eff }, { 0x2fd6, 0x2fef }, { 0x2ffc, 0x2fff },
+	{ 0x3040, 0x3040 }, { 0x3097, 0x3098 }, { 0x3100, 0x3104 },
+	{ 0x3130, 0x3130 }, { 0x318f, 0x318f }, { 0x31e4, 0x31ef },
+	{ 0x321f, 0x321f }, { 0xa48d, 0xa48f }, { 0xa4c7, 0xa4cf },
+	{ 0xa62c, 0xa63f }, { 0xa6f8, 0xa6ff }, { 0xa7cb, 0xa7cf },
+	{ 0xa7d2, 0xa7d2 }, { 0xa7d4, 0xa7d4 }, { 0xa7da, 0xa7f1 },
+	{ 0xa82d, 0xa82f }, { 0xa83a, 0xa83f }, { 0xa878, 0xa87f },
+	{ 0xa8c6, 0xa8cd }, { 0xa8da, 0xa8df }, { 0xa954, 0xa95e },
+	{ 0xa97d, 0xa97f }, { 0xa9ce, 0xa9ce }, { 0xa9da, 0xa9dd },
+	{ 0xa9ff, 0xa9ff }, { 0xaa37, 0xaa3f }, { 0xaa4e, 0xaa4f },
+	{ 0xaa5a, 0xaa5b }, { 0xaac3, 0xaada }, { 0xaaf7, 0xab00 },
+	{ 0xab07, 0xab08 }, { 0xab0f, 0xab10 }, { 0xab17, 0xab1f },
+	{ 0xab27, 0xab27 }, { 0xab2f, 0xab2f }, { 0xab6c, 0xab6f },
+	{ 0xabee, 0xabef }, { 0xabfa, 0xabff }, { 0xd7a4, 0xd7af },
+	{ 0xd7c7, 0xd7ca }, { 0xd7fc, 0xdfff }, { 0xfa6e, 0xfa6f },
+	{ 0xfada, 0xfaff }, { 0xfb07, 0xfb12 }, { 0xfb18, 0xfb1c },
+	{ 0xfb37, 0xfb37 }, { 0xfb3d, 0xfb3d }, { 0xfb3f, 0xfb3f },
+	{ 0xfb42, 0xfb42 }, { 0xfb45, 0xfb45 }, { 0xfbc3, 0xfbd2 },
+	{ 0xfd90, 0xfd91 }, { 0xfdc8, 0xfdce }, { 0xfdd0, 0xfdef },
+	{ 0xfe1a, 0xfe1f }, { 0xfe53, 0xfe53 }, { 0xfe67, 0xfe67 },
+	{ 0xfe6c, 0xfe6f }, { 0xfe75, 0xfe75 }, { 0xfefd, 0xfefe },
+	{ 0xff00, 0xff00 }, { 0xffbf, 0xffc1 }, { 0xffc8, 0xffc9 },
+	{ 0xffd0, 0xffd1 }, { 0xffd8, 0xffd9 }, { 0xffdd, 0xffdf },
+	{ 0xffe7, 0xffe7 }, { 0xffef, 0xfff8 }, { 0xfffe, 0xffff },
+	{ 0x1000c, 0x1000c }, { 0x10027, 0x10027 }, { 0x1003b, 0x1003b },
+	{ 0x1003e, 0x1003e }, { 0x1004e, 0x1004f }, { 0x1005e, 0x1007f },
+	{ 0x100fb, 0x100ff }, { 0x10103, 0x10106 }, { 0x10134, 0x10136 },
+	{ 0x1018f, 0x1018f }, { 0x1019d, 0x1019f }, { 0x101a1, 0x101cf },
+	{ 0x101fe, 0x1027f }, { 0x1029d, 0x1029f }, { 0x102d1, 0x102df },
+	{ 0x102fc, 0x102ff }, { 0x10324, 0x1032c }, { 0x1034b, 0x1034f },
+	{ 0x1037b, 0x1037f }, { 0x1039e, 0x1039e }, { 0x103c4, 0x103c7 },
+	{ 0x103d6, 0x103ff }, { 0x1049e, 0x1049f }, { 0x104aa, 0x104af },
+	{ 0x104d4, 0x104d7 }, { 0x104fc, 0x104ff }, { 0x10528, 0x1052f },
+	{ 0x10564, 0x1056e }, { 0x1057b, 0x1057b }, { 0x1058b, 0x1058b },
+	{ 0x10593, 0x10593 }, { 0x10596, 0x10596 }, { 0x105a2, 0x105a2 },
+	{ 0x105b2, 0x105b2 }, { 0x105ba, 0x105ba }, { 0x105bd, 0x105ff },
+	{ 0x10737, 0x1073f }, { 0x10756, 0x1075f }, { 0x10768, 0x1077f },
+	{ 0x10786, 0x10786 }, { 0x107b1, 0x107b1 }, { 0x107bb, 0x107ff },
+	{ 0x10806, 0x10807 }, { 0x10809, 0x10809 }, { 0x10836, 0x10836 },
+	{ 0x10839, 0x1083b }, { 0x1083d, 0x1083e }, { 0x10856, 0x10856 },
+	{ 0x1089f, 0x108a6 }, { 0x108b0, 0x108df }, { 0x108f3, 0x108f3 },
+	{ 0x108f6, 0x108fa }, { 0x1091c, 0x1091e }, { 0x1093a, 0x1093e },
+	{ 0x10940, 0x1097f }, { 0x109b8, 0x109bb }, { 0x109d0, 0x109d1 },
+	{ 0x10a04, 0x10a04 }, { 0x10a07, 0x10a0b }, { 0x10a14, 0x10a14 },
+	{ 0x10a18, 0x10a18 }, { 0x10a36, 0x10a37 }, { 0x10a3b, 0x10a3e },
+	{ 0x10a49, 0x10a4f }, { 0x10a59, 0x10a5f }, { 0x10aa0, 0x10abf },
+	{ 0x10ae7, 0x10aea }, { 0x10af7, 0x10aff }, { 0x10b36, 0x10b38 },
+	{ 0x10b56, 0x10b57 }, { 0x10b73, 0x10b77 }, { 0x10b92, 0x10b98 },
+	{ 0x10b9d, 0x10ba8 }, { 0x10bb0, 0x10bff }, { 0x10c49, 0x10c7f },
+	{ 0x10cb3, 0x10cbf }, { 0x10cf3, 0x10cf9 }, { 0x10d28, 0x10d2f },
+	{ 0x10d3a, 0x10e5f }, { 0x10e7f, 0x10e7f }, { 0x10eaa, 0x10eaa },
+	{ 0x10eae, 0x10eaf }, { 0x10eb2, 0x10eff }, { 0x10f28, 0x10f2f },
+	{ 0x10f5a, 0x10f6f }, { 0x10f8a, 0x10faf }, { 0x10fcc, 0x10fdf },
+	{ 0x10ff7, 0x10fff }, { 0x1104e, 0x11051 }, { 0x11076, 0x1107e },
+	{ 0x110c3, 0x110cc }, { 0x110ce, 0x110cf }, { 0x110e9, 0x110ef },
+	{ 0x110fa, 0x110ff }, { 0x11135, 0x11135 }, { 0x11148, 0x1114f },
+	{ 0x11177, 0x1117f }, { 0x111e0, 0x111e0 }, { 0x111f5, 0x111ff },
+	{ 0x11212, 0x11212 }, { 0x1123f, 0x1127f }, { 0x11287, 0x11287 },
+	{ 0x11289, 0x11289 }, { 0x1128e, 0x1128e }, { 0x1129e, 0x1129e },
+	{ 0x112aa, 0x112af }, { 0x112eb, 0x112ef }, { 0x112fa, 0x112ff },
+	{ 0x11304, 0x11304 }, { 0x1130d, 0x1130e }, { 0x11311, 0x11312 },
+	{ 0x11329, 0x11329 }, { 0x11331, 0x11331 }, { 0x11334, 0x11334 },
+	{ 0x1133a, 0x1133a }, { 0x11345, 0x11346 }, { 0x11349, 0x1134a },
+	{ 0x1134e, 0x1134f }, { 0x11351, 0x11356 }, { 0x11358, 0x1135c },
+	{ 0x11364, 0x11365 }, { 0x1136d, 0x1136f }, { 0x11375, 0x113ff },
+	{ 0x1145c, 0x1145c }, { 0x11462, 0x1147f }, { 0x114c8, 0x114cf },
+	{ 0x114da, 0x1157f }, { 0x115b6, 0x115b7 }, { 0x115de, 0x115ff },
+	{ 0x11645, 0x1164f }, { 0x1165a, 0x1165f }, { 0x1166d, 0x1167f },
+	{ 0x116ba, 0x116bf }, { 0x116ca, 0x116ff }, { 0x1171b, 0x1171c },
+	{ 0x1172c, 0x1172f }, { 0x11747, 0x117ff }, { 0x1183c, 0x1189f },
+	{ 0x118f3, 0x118fe }, { 0x11907, 0x11908 }, { 0x1190a, 0x1190b },
+	{ 0x11914, 0x11914 }, { 0x11917, 0x11917 }, { 0x11936, 0x11936 },
+	{ 0x11939, 0x1193a }, { 0x11947, 0x1194f }, { 0x1195a, 0x1199f },
+	{ 0x119a8, 0x119a9 }, { 0x119d8, 0x119d9 }, { 0x119e5, 0x119ff },
+	{ 0x11a48, 0x11a4f }, { 0x11aa3, 0x11aaf }, { 0x11af9, 0x11bff },
+	{ 0x11c09, 0x11c09 }, { 0x11c37, 0x11c37 }, { 0x11c46, 0x11c4f },
+	{ 0x11c6d, 0x11c6f }, { 0x11c90, 0x11c91 }, { 0x11ca8, 0x11ca8 },
+	{ 0x11cb7, 0x11cff }, { 0x11d07, 0x11d07 }, { 0x11d0a, 0x11d0a },
+	{ 0x11d37, 0x11d39 }, { 0x11d3b, 0x11d3b }, { 0x11d3e, 0x11d3e },
+	{ 0x11d48, 0x11d4f }, { 0x11d5a, 0x11d5f }, { 0x11d66, 0x11d66 },
+	{ 0x11d69, 0x11d69 }, { 0x11d8f, 0x11d8f }, { 0x11d92, 0x11d92 },
+	{ 0x11d99, 0x11d9f }, { 0x11daa, 0x11edf }, { 0x11ef9, 0x11faf },
+	{ 0x11fb1, 0x11fbf }, { 0x11ff2, 0x11ffe }, { 0x1239a, 0x123ff },
+	{ 0x1246f, 0x1246f }, { 0x12475, 0x1247f }, { 0x12544, 0x12f8f },
+	{ 0x12ff3, 0x12fff }, { 0x1342f, 0x1342f }, { 0x13439, 0x143ff },
+	{ 0x14647, 0x167ff }, { 0x16a39, 0x16a3f }, { 0x16a5f, 0x16a5f },
+	{ 0x16a6a, 0x16a6d }, { 0x16abf, 0x16abf }, { 0x16aca, 0x16acf },
+	{ 0x16aee, 0x16aef }, { 0x16af6, 0x16aff }, { 0x16b46, 0x16b4f },
+	{ 0x16b5a, 0x16b5a }, { 0x16b62, 0x16b62 }, { 0x16b78, 0x16b7c },
+	{ 0x16b90, 0x16e3f }, { 0x16e9b, 0x16eff }, { 0x16f4b, 0x16f4e },
+	{ 0x16f88, 0x16f8e }, { 0x16fa0, 0x16fdf }, { 0x16fe5, 0x16fef },
+	{ 0x16ff2, 0x16fff }, { 0x187f8, 0x187ff }, { 0x18cd6, 0x18cff },
+	{ 0x18d09, 0x1afef }, { 0x1aff4, 0x1aff4 }, { 0x1affc, 0x1affc },
+	{ 0x1afff, 0x1afff }, { 0x1b123, 0x1b14f }, { 0x1b153, 0x1b163 },
+	{ 0x1b168, 0x1b16f }, { 0x1b2fc, 0x1bbff }, { 0x1bc6b, 0x1bc6f },
+	{ 0x1bc7d, 0x1bc7f }, { 0x1bc89, 0x1bc8f }, { 0x1bc9a, 0x1bc9b },
+	{ 0x1bca4, 0x1ceff }, { 0x1cf2e, 0x1cf2f }, { 0x1cf47, 0x1cf4f },
+	{ 0x1cfc4, 0x1cfff }, { 0x1d0f6, 0x1d0ff }, { 0x1d127, 0x1d128 },
+	{ 0x1d1eb, 0x1d1ff }, { 0x1d246, 0x1d2df }, { 0x1d2f4, 0x1d2ff },
+	{ 0x1d357, 0x1d35f }, { 0x1d379, 0x1d3ff }, { 0x1d455, 0x1d455 },
+	{ 0x1d49d, 0x1d49d }, { 0x1d4a0, 0x1d4a1 }, { 0x1d4a3, 0x1d4a4 },
+	{ 0x1d4a7, 0x1d4a8 }, { 0x1d4ad, 0x1d4ad }, { 0x1d4ba, 0x1d4ba },
+	{ 0x1d4bc, 0x1d4bc }, { 0x1d4c4, 0x1d4c4 }, { 0x1d506, 0x1d506 },
+	{ 0x1d50b, 0x1d50c }, { 0x1d515, 0x1d515 }, { 0x1d51d, 0x1d51d },
+	{ 0x1d53a, 0x1d53a }, { 0x1d53f, 0x1d53f }, { 0x1d545, 0x1d545 },
+	{ 0x1d547, 0x1d549 }, { 0x1d551, 0x1d551 }, { 0x1d6a6, 0x1d6a7 },
+	{ 0x1d7cc, 0x1d7cd }, { 0x1da8c, 0x1da9a }, { 0x1daa0, 0x1daa0 },
+	{ 0x1dab0, 0x1deff }, { 0x1df1f, 0x1dfff }, { 0x1e007, 0x1e007 },
+	{ 0x1e019, 0x1e01a }, { 0x1e022, 0x1e022 }, { 0x1e025, 0x1e025 },
+	{ 0x1e02b, 0x1e0ff }, { 0x1e12d, 0x1e12f }, { 0x1e13e, 0x1e13f },
+	{ 0x1e14a, 0x1e14d }, { 0x1e150, 0x1e28f }, { 0x1e2af, 0x1e2bf },
+	{ 0x1e2fa, 0x1e2fe }, { 0x1e300, 0x1e7df }, { 0x1e7e7, 0x1e7e7 },
+	{ 0x1e7ec, 0x1e7ec }, { 0x1e7ef, 0x1e7ef }, { 0x1e7ff, 0x1e7ff },
+	{ 0x1e8c5, 0x1e8c6 }, { 0x1e8d7, 0x1e8ff }, { 0x1e94c, 0x1e94f },
+	{ 0x1e95a, 0x1e95d }, { 0x1e960, 0x1ec70 }, { 0x1ecb5, 0x1ed00 },
+	{ 0x1ed3e, 0x1edff }, { 0x1ee04, 0x1ee04 }, { 0x1ee20, 0x1ee20 },
+	{ 0x1ee23, 0x1ee23 }, { 0x1ee25, 0x1ee26 }, { 0x1ee28, 0x1ee28 },
+	{ 0x1ee33, 0x1ee33 }, { 0x1ee38, 0x1ee38 }, { 0x1ee3a, 0x1ee3a },
+	{ 0x1ee3c, 0x1ee41 }, { 0x1ee43, 0x1ee46 }, { 0x1ee48, 0x1ee48 },
+	{ 0x1ee4a, 0x1ee4a }, { 0x1ee4c, 0x1ee4c }, { 0x1ee50, 0x1ee50 },
+	{ 0x1ee53, 0x1ee53 }, { 0x1ee55, 0x1ee56 }, { 0x1ee58, 0x1ee58 },
+	{ 0x1ee5a, 0x1ee5a }, { 0x1ee5c, 0x1ee5c }, { 0x1ee5e, 0x1ee5e },
+	{ 0x1ee60, 0x1ee60 }, { 0x1ee63, 0x1ee63 }, { 0x1ee65, 0x1ee66 },
+	{ 0x1ee6b, 0x1ee6b }, { 0x1ee73, 0x1ee73 }, { 0x1ee78, 0x1ee78 },
+	{ 0x1ee7d, 0x1ee7d }, { 0x1ee7f, 0x1ee7f }, { 0x1ee8a, 0x1ee8a },
+	{ 0x1ee9c, 0x1eea0 }, { 0x1eea4, 0x1eea4 }, { 0x1eeaa, 0x1eeaa },
+	{ 0x1eebc, 0x1eeef }, { 0x1eef2, 0x1efff }, { 0x1f02c, 0x1f02f },
+	{ 0x1f094, 0x1f09f }, { 0x1f0af, 0x1f0b0 }, { 0x1f0c0, 0x1f0c0 },
+	{ 0x1f0d0, 0x1f0d0 }, { 0x1f0f6, 0x1f0ff }, { 0x1f1ae, 0x1f1e5 },
+	{ 0x1f203, 0x1f20f }, { 0x1f23c, 0x1f23f }, { 0x1f249, 0x1f24f },
+	{ 0x1f252, 0x1f25f }, { 0x1f266, 0x1f2ff }, { 0x1f6d8, 0x1f6dc },
+	{ 0x1f6ed, 0x1f6ef }, { 0x1f6fd, 0x1f6ff }, { 0x1f774, 0x1f77f },
+	{ 0x1f7d9, 0x1f7df }, { 0x1f7ec, 0x1f7ef }, { 0x1f7f1, 0x1f7ff },
+	{ 0x1f80c, 0x1f80f }, { 0x1f848, 0x1f84f }, { 0x1f85a, 0x1f85f },
+	{ 0x1f888, 0x1f88f }, { 0x1f8ae, 0x1f8af }, { 0x1f8b2, 0x1f8ff },
+	{ 0x1fa54, 0x1fa5f }, { 0x1fa6e, 0x1fa6f }, { 0x1fa75, 0x1fa77 },
+	{ 0x1fa7d, 0x1fa7f }, { 0x1fa87, 0x1fa8f }, { 0x1faad, 0x1faaf },
+	{ 0x1fabb, 0x1fabf }, { 0x1fac6, 0x1facf }, { 0x1fada, 0x1fadf },
+	{ 0x1fae8, 0x1faef }, { 0x1faf7, 0x1faff }, { 0x1fb93, 0x1fb93 },
+	{ 0x1fbcb, 0x1fbef }, { 0x1fbfa, 0x1ffff }, { 0x2a6e0, 0x2a6ff },
+	{ 0x2b739, 0x2b73f }, { 0x2b81e, 0x2b81f }, { 0x2cea2, 0x2ceaf },
+	{ 0x2ebe1, 0x2f7ff }, { 0x2fa1e, 0x2ffff }, { 0x3134b, 0xe0000 },
+	{ 0xe0002, 0xe001f }, { 0xe0080, 0xe00ff }, { 0xe01f0, 0xeffff },
+	{ 0xffffe, 0xfffff }, { 0x10fffe, 0x10ffff }
+};
+
+static int
+inrange(const struct range *r, size_t n, uint32_t cp)
+{
+	size_t lo = 0, hi = n, m;
+
+	if (cp < r[0].first || cp > r[n - 1].last)
+		return 0;
+	while (lo < hi) {
+		m = lo + (hi - lo) / 2;
+		if (cp < r[m].first)
+			hi = m;
+		else if (cp > r[m].last)
+			lo = m + 1;
+		else
+			return 1;
+	}
+	return 0;
+}
+
+/* Column width of codepoint, -1 for control characters and unassigned
+   codepoints, like wcwidth(3). */
+static int
+codepointwidth(uint32_t cp)
+{
+	if (cp < 0x20 || (cp >= 0x7f && cp < 0xa0) ||
+	    cp == 0x2028 || cp == 0x2029)
+		return -1;
+	if (cp < 0x300)
+		return 1;
+	if (inrange(unassigned, sizeof(unassigned) / sizeof(*unassigned), cp))
+		return -1;
+	if (inrange(zerowidth, sizeof(zerowidth) / sizeof(*zerowidth), cp))
+		return 0;
+	if (inrange(widewidth, sizeof(widewidth) / sizeof(*widewidth), cp))
+		return 2;
+	return 1;
+}
+
+/* Decode one UTF-8 sequence from the NUL-terminated string `s`.
+ * Returns the length of the sequence or -1 on an invalid, overlong or
+ * incomplete sequence. */
+static int
+utf8decode(const char *s, uint32_t *cp)
+{
+	const unsigned char *p = (const unsigned char *)s;
+	uint32_t c;
+	int i, n;
+
+	if (p[0] < 0x80) {
+		*cp = p[0];
+		return 1;
+	} else if ((p[0] & 0xe0) == 0xc0) {
+		c = p[0] & 0x1f;
+		n = 2;
+	} else if ((p[0] & 0xf0) == 0xe0) {
+		c = p[0] & 0x0f;
+		n = 3;
+	} else if ((p[0] & 0xf8) == 0xf0) {
+		c = p[0] & 0x07;
+		n = 4;
+	} else {
+		return -1;
+	}
+	for (i = 1; i < n; i++) {
+		if ((p[i] & 0xc0) != 0x80)
+			return -1; /* also stops at NUL */
+		c = (c << 6) | (p[i] & 0x3f);
+	}
+	/* overlong, surrogate or out of range */
+	if ((n == 2 && c < 0x80) || (n == 3 && c < 0x800) ||
+	    (n == 4 && c < 0x10000) || c > 0x10ffff ||
+	    (c >= 0xd800 && c <= 0xdfff))
+		return -1;
+	*cp = c;
+
+	return n;
+}
+
+/* returns 1 if the `len` bytes of `s` are valid UTF-8, else 0 */
+int
+utf8valid(const char *s, size_t len)
+{
+	char tail[5];
+	uint32_t cp;
+	size_t i, n;
+	int r;
+
+	for (i = 0; i < len; i += r) {
+		/* runs of ASCII */
+		for (; i < len && !((unsigned char)s[i] & 0x80); i++)
+			;
+		if (i == len)
+			break;
+		/* the sequence is decoded from a NUL-terminated copy at the
+		   end of the data */
+		if (len - i < 4) {
+			n = len - i;
+			memcpy(tail, s + i, n);
+			memset(tail + n, 0, sizeof(tail) - n);
+			if ((r = utf8decode(tail, &cp)) == -1 || (size_t)r > n)
+				return 0;
+		} else if ((r = utf8decode(s + i, &cp)) == -1) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* print `len' columns of characters. If string is shorter pad the rest with
+ * characters `pad`. The string is assumed to be UTF-8 encoded, runs of
+ * printable ASCII are written at once. */
+void
+printutf8pad(FILE *fp, const char *s, size_t len, int pad)
+{
+	char padbuf[64];
+	uint32_t cp;
+	size_t col = 0, i, n;
+	int rl, w;
+
+	if (!len)
+		return;
+
+	for (i = 0; s[i]; i += rl) {
+		/* printable ASCII: each character is one column */
+		for (n = 0; (unsigned char)s[i + n] >= 0x20 &&
+		     (unsigned char)s[i + n] < 0x7f; n++)
+			;
+		if (n) {
+			if (col + n < len) {
+				fwrite(&s[i], 1, n, fp);
+				col += n;
+				rl = n;
+				continue;
+			}
+			/* run reaches the last column: the last character
+			   is only printed if it is the end of the string */
+			n = len - col;
+			fwrite(&s[i], 1, n - 1, fp);
+			if (s[i + n])
+				fputs("\xe2\x80\xa6", fp);
+			else
+				putc(s[i + n - 1], fp);
+			col = len;
+			break;
+		}
+
+		if ((rl = utf8decode(&s[i], &cp)) == -1)
+			break;
+		if ((w = codepointwidth(cp)) == -1)
+			continue;
+		if (col + w > len || (col + w == len && s[i + rl])) {
+			fputs("\xe2\x80\xa6", fp);
+			col++;
+			break;
+		}
+		fwrite(&s[i], 1, rl, fp);
+		col += w;
+	}
+	if (col >= len)
+		return;
+	memset(padbuf, pad, sizeof(padbuf));
+	for (; col + sizeof(padbuf) < len; col += sizeof(padbuf))
+		fwrite(padbuf, 1, sizeof(padbuf), fp);
+	fwrite(padbuf, 1, len - col, fp);
 }
@@ -19,6 +19,19 @@ struct feed {
 	unsigned long total;    /* total items */
 	time_t        timenewest;
 	char          timenewestformat[64];
+	/* for the cached output of the feed in a manifest */
+	time_t        timeoldest;    /* oldest item shown */
+	time_t        timeoldestnew; /* oldest new item shown */
+	long long     mtime;         /* of the feed file, in nanoseconds */
+	long long     size;          /* of the feed file */
+	/* page with the newest item, 0: the newest page, see formatpages */
+	unsigned long long page;
+};
+
+/* feeds of a manifest, sorted by name */
+struct manifest {
+	struct feed *feeds;
+	size_t       len;
 };
 
 /* uri */
@@ -29,14 +42,143 @@ struct uri {
 	char port[6];     /* numeric port */
 };
 
+/* file with a sorted array of 64-bit hashes, used as a set */
+struct hashfile {
+	const uint64_t *hashes;  /* sorted hashes */
+	size_t          len;     /* amount of hashes */
+	uint64_t        hdr[4];  /* data stored in the header by the user */
+	void           *map;
+	size_t          mapsize;
+};
+
+/* file with an open-addressing hash table of 64-bit keys, used as a set */
+struct keyset {
+	const uint64_t *slots;
+	uint64_t        mask;    /* amount of slots - 1 */
+	uint64_t        gen;     /* generation: changed by each update */
+	void           *map;
+	size_t          mapsize;
+};
+
+/* in-memory open-addressing set of 64-bit hashes */
+struct hashset {
+	uint64_t *slots;  /* 0: empty slot */
+	size_t    mask;   /* amount of slots - 1 */
+	size_t    len;    /* amount of hashes */
+};
+
+/* entry of the time index of a feed file: a line */
+struct feedidxent {
+	int64_t  timestamp;
+	uint64_t offset;
+};
+
+/* time index of a feed file, ordered like the file: newest first */
+struct feedidx {
+	const struct feedidxent *ents;
+	size_t                   len;   /* amount of entries */
+	uint64_t                 size;  /* size of the feed file */
+	void                    *map;
+	size_t                   mapsize;
+};
+
+/* record of an item in a store: its line in the data file */
+struct storerec {
+	int64_t  timestamp;
+	uint64_t offset;
+	uint32_t length;  /* length of the line without newline */
+	uint32_t feed;    /* feed id: index of the feed name */
+};
+
+/* run of the index of a store, sorted by timestamp and by feed */
+struct storerun {
+	const struct storerec *recs;   /* ordered by timestamp */
+	const uint32_t        *byfeed; /* indices of recs ordered by feed */
+	size_t                 len;    /* amount of records */
+	unsigned long          seq;    /* sequence number of the run */
+	void                  *map;
+	size_t                 mapsize;
+};
+
+/* store opened for reading */
+struct store {
+	int              datafd;
+	char           **feeds;  /* feed names */
+	size_t           nfeeds;
+	struct storerun *runs;
+	size_t           nruns;
+};
+
+/* input of a merged timeline: a feed file sorted newest first */
+struct tlinput {
+	FILE   *fp;
+	char   *line;      /* current item, without newline */
+	size_t  linesize;
+	time_t  timestamp; /* of the current item */
+	size_t  feed;      /* index of the input */
+};
+
+/* feed files merged to one timeline, newest first */
+struct timeline {
+	struct tlinput  *inputs;
+	struct tlinput **heap;  /* inputs with items, heap on the current item */
+	size_t           len;   /* amount of inputs in the heap */
+	size_t           n;     /* amount of inputs */
+	struct tlinput  *cur;   /* input of the last returned item */
+};
+
+/* initial value of hashbuf() */
+#define HASHINIT 0xcbf29ce484222325ULL
+
 enum {
 	FieldUnixTimestamp = 0, FieldTitle, FieldLink, FieldContent,
 	FieldContentType, FieldId, FieldAuthor, FieldEnclosure, FieldLast
 };
 
 int     absuri(char *, size_t, const char *, const char *);
+void    feedidx_close(struct feedidx *);
+int     feedidx_open(struct feedidx *, const char *, int);
+int     feedidx_path(char *, size_t, const char *);
+void    feedidx_range(const struct feedidx *, long long, long long,
+                      uint64_t *, uint64_t *);
+int     feedidx_write(const char *, const struct feedidxent *, size_t,
+                      uint64_t);
+int     formatjobs(FILE *, size_t, int, void (*)(FILE *, size_t),
+                   struct feed **);
+uint64_t hashbuf(uint64_t, const char *, size_t);
+void    hashfile_close(struct hashfile *);
+int     hashfile_find(const struct hashfile *, uint64_t);
+int     hashfile_open(struct hashfile *, const char *);
+int     hashfile_write(const char *, const struct hashfile *, uint64_t *,
+                       size_t, const uint64_t [4]);
+int     hashset_add(struct hashset *, uint64_t);
+void    hashset_clear(struct hashset *);
+void    hashset_init(struct hashset *, size_t);
+void    keyset_close(struct keyset *);
+int     keyset_find(const struct keyset *, uint64_t);
+uint64_t keyset_itemkey(const char *, const char *);
+int     keyset_open(struct keyset *, const char *);
+int     keyset_update(const char *, const uint64_t *, size_t, uint64_t *,
+                      size_t);
+uint64_t linkkey(const char *, const char *);
 size_t  parseline(char *, char *[FieldLast]);
+int     store_append(const char *, const char *, const char *, size_t);
+void    store_close(struct store *);
+long    store_findfeed(const struct store *, const char *);
+int     store_open(struct store *, const char *);
+ssize_t store_query(const struct store *, long, long long, long long,
+                    struct storerec **);
+int     store_readline(const struct store *, const struct storerec *, char **,
+                       size_t *);
+void    manifest_close(struct manifest *);
+const struct feed *manifest_find(const struct manifest *, const char *);
+int     manifest_open(struct manifest *, const char *, const char *);
+int     manifest_write(const char *, const char *, struct feed **, size_t);
 int     parseuri(const char *, struct uri *, int);
 void    printutf8pad(FILE *, const char *, size_t, int);
 int     strtotime(const char *, time_t *);
+void    timeline_close(struct timeline *);
+struct tlinput *timeline_next(struct timeline *);
+int     timeline_open(struct timeline *, FILE **, size_t);
+int     utf8valid(const char *, size_t);
 void    xmlencode(const char *, FILE *);